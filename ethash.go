@@ -41,7 +41,6 @@ import (
 	"unsafe"
 
 	"github.com/ethereum/go-ethereum/common"
-	"github.com/ethereum/go-ethereum/crypto"
 	"github.com/ethereum/go-ethereum/log"
 )
 
@@ -72,9 +71,10 @@ func defaultDir() string {
 // cache wraps an ethash_light_t with some metadata
 // and automatic memory management.
 type cache struct {
-	epoch uint64
-	used  time.Time
-	test  bool
+	epoch  uint64
+	used   time.Time
+	test   bool
+	shared bool
 
 	gen sync.Once // ensures cache is only generated once.
 	ptr *C.struct_ethash_light
@@ -92,7 +92,9 @@ func (cache *cache) generate() {
 		if cache.test {
 			size = cacheSizeForTesting
 		}
-		cache.ptr = C.ethash_light_new_internal(size, (*C.ethash_h256_t)(unsafe.Pointer(&seedHash[0])))
+		var params C.ethash_light_params_t
+		params.shared = C.bool(cache.shared)
+		cache.ptr = C.ethash_light_new_internal_with_params(size, (*C.ethash_h256_t)(unsafe.Pointer(&seedHash[0])), &params)
 		runtime.SetFinalizer(cache, freeCache)
 		log.Debug(fmt.Sprintf("Done generating cache for epoch %d, it took %v", cache.epoch, time.Since(started)))
 	})
@@ -121,7 +123,8 @@ type Light struct {
 	caches map[uint64]*cache // Currently maintained verification caches
 	future *cache            // Pre-generated cache for the estimated future DAG
 
-	NumCaches int // Maximum number of caches to keep before eviction (only init, don't modify)
+	NumCaches int  // Maximum number of caches to keep before eviction (only init, don't modify)
+	Shared    bool // Share the caches with the other processes of the host (only init, don't modify)
 }
 
 // Verify checks whether the block's nonce is valid.
@@ -174,6 +177,15 @@ func hashToH256(in common.Hash) C.ethash_h256_t {
 	return C.ethash_h256_t{b: *(*[32]C.uint8_t)(unsafe.Pointer(&in[0]))}
 }
 
+// boundaryToH256 converts a search target to the big endian boundary taken by
+// ethash_full_search. The target of difficulty 1 is 2^256, which is clamped.
+func boundaryToH256(target *big.Int) C.ethash_h256_t {
+	if target.BitLen() > 256 {
+		target = new(big.Int).Sub(maxUint256, big.NewInt(1))
+	}
+	return hashToH256(common.BigToHash(target))
+}
+
 func (l *Light) getCache(blockNum uint64) *cache {
 	var c *cache
 	epoch := blockNum / epochLength
@@ -205,14 +217,14 @@ func (l *Light) getCache(blockNum uint64) *cache {
 			c, l.future = l.future, nil
 		} else {
 			log.Debug(fmt.Sprintf("No pre-generated DAG available, creating new for epoch %d", epoch))
-			c = &cache{epoch: epoch, test: l.test}
+			c = &cache{epoch: epoch, test: l.test, shared: l.Shared}
 		}
 		l.caches[epoch] = c
 
 		// If we just used up the future cache, or need a refresh, regenerate
 		if l.future == nil || l.future.epoch <= epoch {
 			log.Debug(fmt.Sprintf("Pre-generating DAG for epoch %d", epoch+1))
-			l.future = &cache{epoch: epoch + 1, test: l.test}
+			l.future = &cache{epoch: epoch + 1, test: l.test, shared: l.Shared}
 			go l.future.generate()
 		}
 	}
@@ -332,6 +344,10 @@ func (pow *Full) getDAG(blockNum uint64) (d *dag) {
 	return d
 }
 
+// searchBatch is the number of nonces hashed per call into C. It bounds how
+// long a stop request can go unnoticed.
+const searchBatch = 1 << 10
+
 func (pow *Full) Search(block Block, stop <-chan struct{}, index int) (nonce uint64, mixDigest []byte) {
 	dag := pow.getDAG(block.NumberU64())
 
@@ -346,38 +362,36 @@ func (pow *Full) Search(block Block, stop <-chan struct{}, index int) (nonce uin
 	nonce = uint64(r.Int63())
 	hash := hashToH256(block.HashNoNonce())
 	target := new(big.Int).Div(maxUint256, diff)
+	boundary := boundaryToH256(target)
+	var found C.ethash_search_result_t
 	for {
 		select {
 		case <-stop:
 			atomic.AddInt32(&pow.hashRate, -previousHashrate)
 			return 0, nil
 		default:
-			i++
+			// TODO: disagrees with the spec https://github.com/ethereum/wiki/wiki/Ethash#mining
+			if C.ethash_full_search(dag.ptr, hash, C.uint64_t(nonce), searchBatch, &boundary, &found, 1) != 0 {
+				mixDigest = C.GoBytes(unsafe.Pointer(&found.mix_hash), C.int(32))
+				atomic.AddInt32(&pow.hashRate, -previousHashrate)
+				return uint64(found.nonce), mixDigest
+			}
+			nonce += searchBatch
+			i += searchBatch
 
-			// we don't have to update hash rate on every nonce, so update after
-			// first nonce check and then after 2^X nonces
-			if i == 2 || ((i % (1 << 16)) == 0) {
+			// we don't have to update hash rate on every batch, so update after
+			// the first one and then after 2^X nonces
+			if i == searchBatch || ((i % (1 << 16)) == 0) {
 				elapsed := time.Now().UnixNano() - start
 				hashes := (float64(1e9) / float64(elapsed)) * float64(i-starti)
 				hashrateDiff := int32(hashes) - previousHashrate
 				previousHashrate = int32(hashes)
 				atomic.AddInt32(&pow.hashRate, hashrateDiff)
 			}
-
-			ret := C.ethash_full_compute(dag.ptr, hash, C.uint64_t(nonce))
-			result := h256ToHash(ret.result).Big()
-
-			// TODO: disagrees with the spec https://github.com/ethereum/wiki/wiki/Ethash#mining
-			if ret.success && result.Cmp(target) <= 0 {
-				mixDigest = C.GoBytes(unsafe.Pointer(&ret.mix_hash), C.int(32))
-				atomic.AddInt32(&pow.hashRate, -previousHashrate)
-				return nonce, mixDigest
-			}
-			nonce += 1
 		}
 
 		if !pow.turbo {
-			time.Sleep(20 * time.Microsecond)
+			time.Sleep(searchBatch * 20 * time.Microsecond)
 		}
 	}
 }
@@ -431,9 +445,18 @@ func GetSeedHash(blockNum uint64) ([]byte, error) {
 	return sh[:], nil
 }
 
-func makeSeedHash(epoch uint64) (sh common.Hash) {
-	for ; epoch > 0; epoch-- {
-		sh = crypto.Sha3Hash(sh[:])
+// GetEpoch returns the epoch of a seed hash, e.g. of a work package.
+func GetEpoch(seedHash []byte) (uint64, error) {
+	if len(seedHash) != 32 {
+		return 0, fmt.Errorf("seed hash must be 32 bytes, got %d", len(seedHash))
+	}
+	var epoch C.uint64_t
+	if !C.ethash_get_epoch(hashToH256(common.BytesToHash(seedHash)), &epoch) {
+		return 0, fmt.Errorf("unknown seed hash %x", seedHash)
 	}
-	return sh
+	return uint64(epoch), nil
+}
+
+func makeSeedHash(epoch uint64) common.Hash {
+	return h256ToHash(C.ethash_get_seedhash(C.uint64_t(epoch * epochLength)))
 }
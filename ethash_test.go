@@ -218,4 +218,10 @@ func TestGetSeedHash(t *testing.T) {
 		log.Printf("seedHash for block 1 should be: %v,\nactual value: %v\n", expectedSeed1, seed1)
 	}
 
+	if epoch, err := GetEpoch(seed1); err != nil || epoch != 1 {
+		t.Errorf("epoch of seedHash for block 30000 should be 1, got %d (%v)", epoch, err)
+	}
+	if _, err := GetEpoch(make([]byte, 31)); err == nil {
+		t.Error("GetEpoch accepted a short seed hash")
+	}
 }
@@ -29,18 +29,33 @@ package ethash
 
 /*
 #cgo CFLAGS: -std=gnu99 -Wall
+#cgo linux CFLAGS: -D_GNU_SOURCE
 #cgo windows CFLAGS: -mno-stack-arg-probe
 #cgo LDFLAGS: -lm
+#cgo !windows LDFLAGS: -lpthread
+#cgo linux LDFLAGS: -lrt
 
 #include "src/libethash/internal.c"
+#include "src/libethash/search.c"
+#include "src/libethash/async.c"
+#include "src/libethash/epochs.c"
+#include "src/libethash/pages.c"
+#include "src/libethash/shm.c"
+#include "src/libethash/numa.c"
 #include "src/libethash/sha3.c"
 #include "src/libethash/io.c"
+#include "src/libethash/dispatch.c"
+#include "src/libethash/simd_sse41.c"
+#include "src/libethash/simd_avx2.c"
+#include "src/libethash/simd_avx512.c"
 
 #ifdef _WIN32
 #	include "src/libethash/io_win32.c"
 #	include "src/libethash/mmap_win32.c"
+#	include "src/libethash/thread_win32.c"
 #else
 #	include "src/libethash/io_posix.c"
+#	include "src/libethash/thread_posix.c"
 #endif
 
 // 'gateway function' for calling back into go.
@@ -1,21 +1,36 @@
 #!/usr/bin/env python
 import os
+import sys
 from distutils.core import setup, Extension
 sources = [
     'src/python/core.c',
     'src/libethash/io.c',
     'src/libethash/internal.c',
+    'src/libethash/search.c',
+    'src/libethash/async.c',
+    'src/libethash/epochs.c',
+    'src/libethash/pages.c',
+    'src/libethash/shm.c',
+    'src/libethash/numa.c',
+    'src/libethash/dispatch.c',
+    'src/libethash/simd_sse41.c',
+    'src/libethash/simd_avx2.c',
+    'src/libethash/simd_avx512.c',
     'src/libethash/sha3.c']
 if os.name == 'nt':
     sources += [
         'src/libethash/util_win32.c',
         'src/libethash/io_win32.c',
         'src/libethash/mmap_win32.c',
+        'src/libethash/thread_win32.c',
     ]
 else:
     sources += [
-        'src/libethash/io_posix.c'
+        'src/libethash/io_posix.c',
+        'src/libethash/thread_posix.c',
     ]
+# shm_open() lives in librt before glibc 2.34
+libraries = ['rt'] if sys.platform.startswith('linux') else []
 depends = [
     'src/libethash/ethash.h',
     'src/libethash/compiler.h',
@@ -26,11 +41,19 @@ depends = [
     'src/libethash/fnv.h',
     'src/libethash/internal.h',
     'src/libethash/sha3.h',
+    'src/libethash/dispatch.h',
+    'src/libethash/simd.h',
+    'src/libethash/keccak_lanes.h',
+    'src/libethash/thread.h',
+    'src/libethash/pages.h',
+    'src/libethash/shm.h',
+    'src/libethash/numa.h',
     'src/libethash/util.h',
 ]
 pyethash = Extension('pyethash',
                      sources=sources,
                      depends=depends,
+                     libraries=libraries,
                      extra_compile_args=["-Isrc/", "-std=gnu99", "-Wall"])
 
 setup(
@@ -17,22 +17,36 @@
 /** @file benchmark.cpp
  * @author Tim Hughes <tim@twistedfury.com>
  * @date 2015
+ *
+ * Usage: Benchmark_FULL [DAG size in MB]
+ *        mpirun -np <ranks> Benchmark_MPI_FULL [DAG size in MB] [DAG file directory]
+ *
+ * The MPI build times the DAG generation with 1, 2, 4 ... ranks against the
+ * same number of threads in one process, and writes the DAG gathered from all
+ * the ranks to a DAG file.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <chrono>
 #include <libethash/ethash.h>
+#include <libethash/internal.h>
+#include <libethash/io.h>
+#include <libethash/pages.h>
 #include <libethash/util.h>
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
 #ifdef OPENCL
 #include <libethash-cl/ethash_cl_miner.h>
 #endif
 #include <vector>
+#include <string>
+#include <string.h>
 #include <algorithm>
 
 #ifdef WITH_CRYPTOPP
 #include <libethash/sha3_cryptopp.h>
-#include <string>
 
 #else
 #include "libethash/sha3.h"
@@ -101,55 +115,186 @@ static std::string bytesToHexString(ethash_h256_t const *hash, unsigned size)
 	return bytesToHexString((uint8_t*)hash, size);
 }
 
-extern "C" int main(void)
+#ifdef WITH_MPI
+// One DAG item, so the gather counts fit an int whatever the DAG size
+static MPI_Datatype g_item_type;
+
+/**
+ * Build the DAG with the first @a ranks processes of MPI_COMM_WORLD. Each one
+ * calculates a contiguous share of the items with a single thread, and the
+ * shares are gathered into @a dag on rank 0. Rank 0 gets the seconds spent by
+ * the slowest rank calculating and the seconds spent gathering.
+ */
+static void mpiBuildDag(
+	ethash_light_t light,
+	uint32_t items,
+	int ranks,
+	void* dag,
+	double* generate,
+	double* gather
+)
+{
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm comm;
+	MPI_Comm_split(MPI_COMM_WORLD, rank < ranks ? 0 : MPI_UNDEFINED, rank, &comm);
+	if (comm == MPI_COMM_NULL)
+	{
+		return;
+	}
+
+	std::vector<int> counts(ranks), displs(ranks);
+	for (int r = 0; r != ranks; ++r)
+	{
+		displs[r] = (int)((uint64_t)items * r / ranks);
+		counts[r] = (int)((uint64_t)items * (r + 1) / ranks) - displs[r];
+	}
+	std::vector<uint8_t> share((size_t)counts[rank] * 64);
+
+	MPI_Barrier(comm);
+	double const start = MPI_Wtime();
+	ethash_compute_dag_range(light, displs[rank], displs[rank] + counts[rank], share.data(), 1, NULL);
+	double const own = MPI_Wtime() - start;
+	MPI_Reduce(&own, generate, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+	MPI_Barrier(comm);
+	double const gatherStart = MPI_Wtime();
+	MPI_Gatherv(share.data(), counts[rank], g_item_type, dag, counts.data(), displs.data(), g_item_type, 0, comm);
+	*gather = MPI_Wtime() - gatherStart;
+	MPI_Comm_free(&comm);
+}
+#endif
+
+#ifdef FULL
+// Compare some items of a DAG against ones calculated on their own
+static bool spotCheckDag(void const* dag, uint32_t items, ethash_light_t light)
+{
+	for (uint32_t i = 0; i != 1024; ++i)
+	{
+		uint32_t const item = (uint32_t)((uint64_t)i * 2654435761U % items);
+		uint8_t expected[64];
+		ethash_compute_dag_range(light, item, item + 1, expected, 1, NULL);
+		if (memcmp((uint8_t const*)dag + (uint64_t)item * 64, expected, 64) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+#endif
+
+int main(int argc, char** argv)
 {
-	// params for ethash
-	ethash_params params;
-	ethash_params_init(&params, 0);
-	//params.full_size = 262147 * 4096;	// 1GBish;
-	//params.full_size = 32771 * 4096;	// 128MBish;
-	//params.full_size = 8209 * 4096;	// 8MBish;
-	//params.cache_size = 8209*4096;
-	//params.cache_size = 2053*4096;
+#ifdef WITH_MPI
+	MPI_Init(&argc, &argv);
+	int rank, size;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	MPI_Type_contiguous(64, MPI_BYTE, &g_item_type);
+	MPI_Type_commit(&g_item_type);
+#else
+	int const rank = 0, size = 1;
+#endif
+	// only rank 0 reports
+	#define reportf(...) do { if (rank == 0) debugf(__VA_ARGS__); } while (0)
+
+	// epoch 0 sizes unless a DAG size in MB is given, e.g. for quick runs
+	uint64_t full_size = ethash_get_datasize(0);
+	uint64_t cache_size = ethash_get_cachesize(0);
+	if (argc > 1)
+	{
+		full_size = (uint64_t)atoi(argv[1]) << 20;
+		cache_size = std::min(cache_size, full_size / 64);
+	}
+	// directory the MPI build writes the gathered DAG file to
+	char const* dag_dir = argc > 2 ? argv[2] : "./";
+	(void)dag_dir;
+	(void)size;
+
 	ethash_h256_t seed;
 	ethash_h256_t previous_hash;
 
 	memcpy(&seed, hexStringToBytes("9410b944535a83d9adf6bbdcc80e051f30676173c16ca0d32d6f1263fc246466").data(), 32);
 	memcpy(&previous_hash, hexStringToBytes("c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470").data(), 32);
 
-	// allocate page aligned buffer for dataset
+	// allocate page aligned buffer for dataset, on rank 0 only with MPI
 #ifdef FULL
-	void* full_mem_buf = malloc(params.full_size + 4095);
-	void* full_mem = (void*)((uintptr_t(full_mem_buf) + 4095) & ~4095);
+	void* full_mem = rank == 0 ? ethash_aligned_alloc(full_size, ETHASH_DAG_ALIGNMENT) : NULL;
 #endif
-	void* cache_mem_buf = malloc(params.cache_size + 63);
-	void* cache_mem = (void*)((uintptr_t(cache_mem_buf) + 63) & ~63);
 
-	ethash_cache cache;
-	cache.mem = cache_mem;
+	ethash_light_t light;
 
 	// compute cache or full data
 	{
 		auto startTime = high_resolution_clock::now();
-		ethash_mkcache(&cache, &params, &seed);
+		light = ethash_light_new_internal(cache_size, &seed);
 		auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
 
 		ethash_h256_t cache_hash;
-		SHA3_256(&cache_hash, (uint8_t const*)cache_mem, params.cache_size);
-		debugf("ethash_mkcache: %ums, sha3: %s\n", (unsigned)((time*1000)/CLOCKS_PER_SEC), bytesToHexString(&cache_hash, sizeof(cache_hash)).data());
+		SHA3_256(&cache_hash, (uint8_t const*)light->cache, cache_size);
+		reportf("ethash_light_new: %ums, sha3: %s\n", (unsigned)time, bytesToHexString(&cache_hash, sizeof(cache_hash)).data());
 
 		// print a couple of test hashes
 		{
 			auto startTime = high_resolution_clock::now();
-			ethash_return_value hash;
-			ethash_light(&hash, &cache, &params, &previous_hash, 0);
+			ethash_return_value_t hash = ethash_light_compute_internal(light, full_size, previous_hash, 0);
 			auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-			debugf("ethash_light test: %ums, %s\n", (unsigned)time, bytesToHexString(&hash.result, 32).data());
+			reportf("ethash_light test: %ums, %s\n", (unsigned)time, bytesToHexString(&hash.result, 32).data());
 		}
 
-		#ifdef FULL
+		#if defined(FULL) && defined(WITH_MPI)
+			// 1, 2, 4 ... ranks up to all of them, against as many threads in one process
+			uint32_t const items = (uint32_t)(full_size / 64);
+			reportf("ranks  generate    gather     total   threads  speedup\n");
+			for (int ranks = 1;; ranks = std::min(ranks * 2, size))
+			{
+				double generate = 0, gather = 0;
+				mpiBuildDag(light, items, ranks, full_mem, &generate, &gather);
+				if (rank == 0)
+				{
+					if (!spotCheckDag(full_mem, items, light))
+					{
+						debugf("gathered DAG is wrong\n");
+						MPI_Abort(MPI_COMM_WORLD, 1);
+					}
+					// the gathered DAG goes to a file while it is there
+					if (ranks == size)
+					{
+						auto startTime = high_resolution_clock::now();
+						FILE* f = NULL;
+						if (ethash_io_prepare(dag_dir, seed, &f, full_size, true) != ETHASH_IO_MEMO_MISMATCH ||
+							!ethash_io_write_dag(f, full_mem, full_size, 0, full_size, false, 0))
+						{
+							debugf("could not write the DAG file to %s\n", dag_dir);
+							MPI_Abort(MPI_COMM_WORLD, 1);
+						}
+						fclose(f);
+						ethash_dag_file_seal_internal(dag_dir, seed, full_size);
+						auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
+						debugf("DAG file written to %s: %ums\n", dag_dir, (unsigned)time);
+					}
+					auto startTime = high_resolution_clock::now();
+					ethash_compute_full_data(full_mem, full_size, light, NULL, ranks);
+					double const threaded = std::chrono::duration<double>(high_resolution_clock::now() - startTime).count();
+					debugf(
+						"%5d  %7.2fs  %7.2fs  %7.2fs  %7.2fs  %6.2fx\n",
+						ranks,
+						generate,
+						gather,
+						generate + gather,
+						threaded,
+						threaded / (generate + gather)
+					);
+				}
+				MPI_Barrier(MPI_COMM_WORLD);
+				if (ranks == size)
+				{
+					break;
+				}
+			}
+		#elif defined(FULL)
 			startTime = high_resolution_clock::now();
-			ethash_compute_full_data(full_mem, &params, &cache);
+			ethash_compute_full_data(full_mem, full_size, light, NULL, 0);
 			time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
 			debugf("ethash_compute_full_data: %ums\n", (unsigned)time);
 		#endif // FULL
@@ -168,12 +313,13 @@ extern "C" int main(void)
 
 
 #ifdef FULL
+	if (rank == 0)
 	{
 		auto startTime = high_resolution_clock::now();
-		ethash_return_value hash;
-		ethash_full(&hash, full_mem, &params, &previous_hash, 0);
-		auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-		debugf("ethash_full test: %uns\n", (unsigned)time);
+		ethash_return_value_t hash;
+		ethash_hash_full_lanes(&hash, (node const*)full_mem, full_size, previous_hash, 0, 1);
+		auto time = std::chrono::duration_cast<std::chrono::microseconds>(high_resolution_clock::now() - startTime).count();
+		debugf("ethash_full test: %uus, %s\n", (unsigned)time, bytesToHexString(&hash.result, 32).data());
 	}
 #endif
 
@@ -182,8 +328,7 @@ extern "C" int main(void)
 	miner.hash(g_hashes, (uint8_t*)&previous_hash, 0, 1024);
 	for (unsigned i = 0; i != 1024; ++i)
 	{
-		ethash_return_value hash;
-		ethash_light(&hash, &cache, &params, &previous_hash, i);
+		ethash_return_value_t hash = ethash_light_compute_internal(light, full_size, previous_hash, i);
 		if (memcmp(&hash.result, g_hashes + 32*i, 32) != 0)
 		{
 			debugf("nonce %u failed: %s %s\n", i, bytesToHexString(g_hashes + 32*i, 32).c_str(), bytesToHexString(&hash.result, 32).c_str());
@@ -199,8 +344,20 @@ extern "C" int main(void)
 	miner.finish();
 #endif
 
-	auto startTime = high_resolution_clock::now();
+#if defined(WITH_MPI) && !defined(FULL)
+	// light hashes split over the ranks
+	unsigned const first_nonce = (unsigned)((uint64_t)trials * rank / size);
+	unsigned hash_count = (unsigned)((uint64_t)trials * (rank + 1) / size) - first_nonce;
+	MPI_Barrier(MPI_COMM_WORLD);
+#elif defined(WITH_MPI)
+	// the DAG is on rank 0 only
+	unsigned const first_nonce = 0;
+	unsigned hash_count = rank == 0 ? trials : 0;
+#else
+	unsigned const first_nonce = 0;
 	unsigned hash_count = trials;
+#endif
+	auto startTime = high_resolution_clock::now();
 
 	#ifdef OPENCL
 	{
@@ -230,8 +387,7 @@ extern "C" int main(void)
 		for (unsigned i = 0; i != hook.nonce_vec.size(); ++i)
 		{
 			uint64_t nonce = hook.nonce_vec[i];
-			ethash_return_value hash;
-			ethash_light(&hash, &cache, &params, &previous_hash, nonce);
+			ethash_return_value_t hash = ethash_light_compute_internal(light, full_size, previous_hash, nonce);
 			debugf("found: %.8x%.8x -> %s\n", unsigned(nonce>>32), unsigned(nonce), bytesToHexString(&hash.result, 32).c_str());
 		}
 
@@ -239,39 +395,52 @@ extern "C" int main(void)
 	}
 	#else
 	{
-		//#pragma omp parallel for
-		for (int nonce = 0; nonce < trials; ++nonce)
-		{
-			ethash_return_value hash;
-			#ifdef FULL
-				ethash_full(&hash, full_mem, &params, &previous_hash, nonce);
-			#else
-				ethash_light(&hash, &cache, &params, &previous_hash, nonce);
-			#endif // FULL
-		}
+		#ifdef FULL
+			ethash_return_value_t hashes[ETHASH_HASH_LANES_DEFAULT];
+			for (unsigned nonce = first_nonce; nonce < first_nonce + hash_count; nonce += ETHASH_HASH_LANES_DEFAULT)
+			{
+				ethash_hash_full_lanes(hashes, (node const*)full_mem, full_size, previous_hash, nonce, ETHASH_HASH_LANES_DEFAULT);
+			}
+		#else
+			for (unsigned nonce = first_nonce; nonce < first_nonce + hash_count; ++nonce)
+			{
+				ethash_light_compute_internal(light, full_size, previous_hash, nonce);
+			}
+		#endif // FULL
 	}
 	#endif
 	auto time = std::chrono::duration_cast<std::chrono::microseconds>(high_resolution_clock::now() - startTime).count();
-	debugf("Search took: %ums\n", (unsigned)time/1000);
+#ifdef WITH_MPI
+	// the slowest rank decides, every rank's hashes count
+	long long own_time = (long long)time, own_count = hash_count, total_count;
+	MPI_Reduce(&own_time, &time, 1, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&own_count, &total_count, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	hash_count = (unsigned)total_count;
+#endif
+	reportf("Search took: %ums\n", (unsigned)time/1000);
 
 	unsigned read_size = ETHASH_ACCESSES * ETHASH_MIX_BYTES;
 #if defined(OPENCL) || defined(FULL)
-	debugf(
+	reportf(
 		"hashrate: %8.2f Mh/s, bw: %8.2f GB/s\n",
 		(double)hash_count * (1000*1000)/time / (1000*1000),
 		(double)hash_count*read_size * (1000*1000)/time / (1024*1024*1024)
 		);
 #else
-	debugf(
+	reportf(
 		"hashrate: %8.2f Kh/s, bw: %8.2f MB/s\n",
 		(double)hash_count * (1000*1000)/time / (1000),
 		(double)hash_count*read_size * (1000*1000)/time / (1024*1024)
 		);
 #endif
 
-	free(cache_mem_buf);
+	ethash_light_delete(light);
 #ifdef FULL
-	free(full_mem_buf);
+	ethash_aligned_free(full_mem);
+#endif
+#ifdef WITH_MPI
+	MPI_Type_free(&g_item_type);
+	MPI_Finalize();
 #endif
 
 	return 0;
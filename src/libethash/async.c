@@ -0,0 +1,176 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file async.c
+ * @date 2015
+ *
+ * Creation of an ethash_full handler on a background thread, so the DAG of
+ * the next epoch can be ready by the time the chain gets there.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+#include "io.h"
+#include "thread.h"
+
+struct ethash_full_async {
+	char* dirname;              // NULL for a DAG that only lives in memory
+	ethash_h256_t seed_hash;
+	uint64_t full_size;
+	ethash_light_t light;
+	ethash_full_params_t params;
+	ethash_thread_t thread;
+	uint32_t volatile progress;
+	uint32_t volatile cancelled;
+	uint32_t volatile finished;
+	bool joined;
+	ethash_full_t full;
+};
+
+// ethash_callback_t has no context, but the callback only ever runs on the
+// thread that creates the handler
+static ETHASH_THREAD_LOCAL struct ethash_full_async* ethash_full_async_current;
+
+static int ethash_full_async_callback(unsigned progress)
+{
+	struct ethash_full_async* async = ethash_full_async_current;
+	ethash_atomic_store_u32(&async->progress, progress);
+	return ethash_atomic_load_u32(&async->cancelled) ? 1 : 0;
+}
+
+static void* ethash_full_async_run(void* arg)
+{
+	struct ethash_full_async* async = (struct ethash_full_async*)arg;
+	// the DAG workers are started from this thread and inherit its priorities
+	ethash_thread_set_priority(async->params.cpu_priority, async->params.io_priority);
+	ethash_full_async_current = async;
+	if (async->dirname) {
+		async->full = ethash_full_new_internal_with_params(
+			async->dirname,
+			async->seed_hash,
+			async->full_size,
+			async->light,
+			ethash_full_async_callback,
+			&async->params
+		);
+	} else {
+		async->full = ethash_full_new_internal_in_memory(
+			async->full_size,
+			async->light,
+			ethash_full_async_callback,
+			&async->params
+		);
+	}
+	ethash_full_async_current = NULL;
+	if (async->full) {
+		// an existing DAG file is loaded without any progress report
+		ethash_atomic_store_u32(&async->progress, 100);
+	}
+	ethash_atomic_store_u32(&async->finished, 1);
+	return NULL;
+}
+
+ethash_full_async_t ethash_full_new_internal_async(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_full_params_t const* params
+)
+{
+	struct ethash_full_async* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (dirname) {
+		size_t const len = strlen(dirname) + 1;
+		ret->dirname = malloc(len);
+		if (!ret->dirname) {
+			goto fail_free_async;
+		}
+		memcpy(ret->dirname, dirname, len);
+	}
+	ret->seed_hash = seed_hash;
+	ret->full_size = full_size;
+	ret->light = light;
+	if (params) {
+		ret->params = *params;
+	}
+	if (!ethash_thread_create(&ret->thread, ethash_full_async_run, ret)) {
+		ETHASH_CRITICAL("Could not start the DAG generation thread");
+		goto fail_free_async;
+	}
+	return ret;
+
+fail_free_async:
+	free(ret->dirname);
+	free(ret);
+	return NULL;
+}
+
+ethash_full_async_t ethash_full_new_async(
+	ethash_light_t light,
+	bool in_memory,
+	ethash_full_params_t const* params
+)
+{
+	char strbuf[256];
+	if (!in_memory && !ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	uint64_t full_size = ethash_get_datasize(light->block_number);
+	ethash_h256_t seedhash = ethash_get_seedhash(light->block_number);
+	return ethash_full_new_internal_async(in_memory ? NULL : strbuf, seedhash, full_size, light, params);
+}
+
+bool ethash_full_async_finished(ethash_full_async_t async)
+{
+	return ethash_atomic_load_u32(&async->finished) != 0;
+}
+
+unsigned ethash_full_async_progress(ethash_full_async_t async)
+{
+	return ethash_atomic_load_u32(&async->progress);
+}
+
+void ethash_full_async_cancel(ethash_full_async_t async)
+{
+	ethash_atomic_store_u32(&async->cancelled, 1);
+}
+
+ethash_full_t ethash_full_async_wait(ethash_full_async_t async)
+{
+	if (!async->joined) {
+		ethash_thread_join(async->thread);
+		async->joined = true;
+	}
+	ethash_full_t ret = async->full;
+	async->full = NULL;
+	return ret;
+}
+
+void ethash_full_async_delete(ethash_full_async_t async)
+{
+	ethash_full_async_cancel(async);
+	ethash_full_t full = ethash_full_async_wait(async);
+	if (full) {
+		ethash_full_delete(full);
+	}
+	free(async->dirname);
+	free(async);
+}
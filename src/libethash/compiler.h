@@ -31,3 +31,30 @@
 #define restrict __restrict__
 #endif
 
+
+// for bodies that get instantiated under several target attributes
+#if defined(_MSC_VER)
+#define ETHASH_FORCE_INLINE __forceinline
+#else
+#define ETHASH_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+// storage class of variables that every thread has its own copy of
+#if defined(_MSC_VER)
+#define ETHASH_THREAD_LOCAL __declspec(thread)
+#else
+#define ETHASH_THREAD_LOCAL __thread
+#endif
+
+// hint that the cache line at p_ will be read soon
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define ETHASH_PREFETCH(p_) _mm_prefetch((char const*)(p_), _MM_HINT_T0)
+#elif defined(_MSC_VER)
+#define ETHASH_PREFETCH(p_) ((void)(p_))
+#else
+#define ETHASH_PREFETCH(p_) __builtin_prefetch(p_)
+#endif
+
+// fails to compile if the constant expression c_ is false, name_ says why
+#define ETHASH_STATIC_ASSERT(c_, name_) typedef char ethash_static_assert_##name_[(c_) ? 1 : -1]
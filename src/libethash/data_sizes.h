@@ -31,7 +31,10 @@ extern "C" {
 
 #include <stdint.h>
 
-// 2048 Epochs (~20 years) worth of tabulated DAG sizes
+// 2048 Epochs (~20 years) worth of tabulated DAG sizes. Later epochs are
+// computed, see ethash_get_datasize(), and the unit tests check the tables
+// against that computation.
+#define ETHASH_TABULATED_EPOCHS 2048
 
 // Generated with the following Mathematica Code:
 
@@ -48,7 +51,7 @@ extern "C" {
 //             Sow[i*HashBytes]; j++]]]][[2]][[1]]
 
 
-static const uint64_t dag_sizes[2048] = {
+static const uint64_t dag_sizes[] = {
 	1073739904U, 1082130304U, 1090514816U, 1098906752U, 1107293056U,
 	1115684224U, 1124070016U, 1132461952U, 1140849536U, 1149232768U,
 	1157627776U, 1166013824U, 1174404736U, 1182786944U, 1191180416U,
@@ -477,7 +480,7 @@ static const uint64_t dag_sizes[2048] = {
 //         While[! PrimeQ[i], i--];
 //         Sow[i*HashBytes]; j++]]]][[2]][[1]]
 
-const uint64_t cache_sizes[2048] = {
+const uint64_t cache_sizes[] = {
 	16776896U, 16907456U, 17039296U, 17170112U, 17301056U, 17432512U, 17563072U,
 	17693888U, 17824192U, 17955904U, 18087488U, 18218176U, 18349504U, 18481088U,
 	18611392U, 18742336U, 18874304U, 19004224U, 19135936U, 19267264U, 19398208U,
@@ -807,6 +810,9 @@ const uint64_t cache_sizes[2048] = {
 	284950208U, 285081536U
 };
 
+ETHASH_STATIC_ASSERT(sizeof(dag_sizes) == ETHASH_TABULATED_EPOCHS * sizeof(uint64_t), dag_sizes_cover_the_tabulated_epochs);
+ETHASH_STATIC_ASSERT(sizeof(cache_sizes) == ETHASH_TABULATED_EPOCHS * sizeof(uint64_t), cache_sizes_cover_the_tabulated_epochs);
+
 #ifdef __cplusplus
 }
 #endif
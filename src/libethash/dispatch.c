@@ -0,0 +1,195 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dispatch.c
+ * @date 2015
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dispatch.h"
+#include "simd.h"
+#include "thread.h"
+
+#if ETHASH_SIMD_X86
+#include <cpuid.h>
+#endif
+
+#ifdef WITH_CRYPTOPP
+// Crypto++ brings its own Keccak
+#define ETHASH_KECCAKF_SCALAR NULL
+#define ETHASH_KECCAKF_AVX512 NULL
+#else
+#define ETHASH_KECCAKF_SCALAR ethash_keccakf_scalar
+#define ETHASH_KECCAKF_AVX512 ethash_keccakf_avx512
+#endif
+
+static ethash_kernels_t const ethash_backend_kernels[ETHASH_BACKEND_COUNT] = {
+	[ETHASH_BACKEND_SCALAR] = {
+		ETHASH_BACKEND_SCALAR,
+		ETHASH_KECCAKF_SCALAR,
+		ethash_calculate_dag_item_scalar,
+		NULL,
+		NULL,
+		ethash_hashimoto_mix_scalar,
+		ethash_hashimoto_lanes_scalar
+	},
+#if ETHASH_SIMD_X86
+	// A single Keccak state does not fit in 16 vector registers, so only
+	// AVX-512 beats the scalar permutation
+	[ETHASH_BACKEND_SSE41] = {
+		ETHASH_BACKEND_SSE41,
+		ETHASH_KECCAKF_SCALAR,
+		ethash_calculate_dag_item_sse41,
+		NULL,
+		NULL,
+		ethash_hashimoto_mix_sse41,
+		ethash_hashimoto_lanes_sse41
+	},
+	[ETHASH_BACKEND_AVX2] = {
+		ETHASH_BACKEND_AVX2,
+		ETHASH_KECCAKF_SCALAR,
+		ethash_calculate_dag_item_avx2,
+		NULL,
+		ethash_calculate_dag_items_avx2,
+		ethash_hashimoto_mix_avx2,
+		ethash_hashimoto_lanes_avx2
+	},
+	[ETHASH_BACKEND_AVX512] = {
+		ETHASH_BACKEND_AVX512,
+		ETHASH_KECCAKF_AVX512,
+		ethash_calculate_dag_item_avx512,
+		ethash_calculate_dag_items_avx512,
+		ethash_calculate_dag_items_avx2,
+		ethash_hashimoto_mix_avx512,
+		ethash_hashimoto_lanes_avx2
+	},
+#endif
+};
+
+static char const* const ethash_backend_names[ETHASH_BACKEND_COUNT] = {
+	"scalar",
+	"sse41",
+	"avx2",
+	"avx512"
+};
+
+// 0 until the backend is selected, the active backend + 1 afterwards
+static uint32_t volatile ethash_active_backend;
+
+#if ETHASH_SIMD_X86
+
+// The XCR0 bits the OS sets once it saves the ymm and zmm registers
+#define ETHASH_XCR0_YMM 0x06
+#define ETHASH_XCR0_ZMM 0xe6
+
+static uint64_t ethash_xgetbv(void)
+{
+	uint32_t eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t) edx << 32) | eax;
+}
+
+bool ethash_cpu_supports(ethash_backend_t backend)
+{
+	unsigned eax, ebx, ecx, edx;
+	switch (backend) {
+	case ETHASH_BACKEND_SCALAR:
+		return true;
+	case ETHASH_BACKEND_SSE41:
+	case ETHASH_BACKEND_AVX2:
+	case ETHASH_BACKEND_AVX512:
+		break;
+	default:
+		return false;
+	}
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	if (backend == ETHASH_BACKEND_SSE41) {
+		return (ecx & bit_SSE4_1) != 0;
+	}
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+		return false;
+	}
+	uint64_t const xcr0 = ethash_xgetbv();
+	if ((xcr0 & ETHASH_XCR0_YMM) != ETHASH_XCR0_YMM || __get_cpuid_max(0, NULL) < 7) {
+		return false;
+	}
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (!(ebx & bit_AVX2)) {
+		return false;
+	}
+	if (backend == ETHASH_BACKEND_AVX2) {
+		return true;
+	}
+	return (ebx & bit_AVX512F) && (ebx & bit_AVX512VL) && (xcr0 & ETHASH_XCR0_ZMM) == ETHASH_XCR0_ZMM;
+}
+
+#else
+
+bool ethash_cpu_supports(ethash_backend_t backend)
+{
+	return backend == ETHASH_BACKEND_SCALAR;
+}
+
+#endif // ETHASH_SIMD_X86
+
+ethash_kernels_t const* ethash_kernels_for(ethash_backend_t backend)
+{
+	return ethash_cpu_supports(backend) ? &ethash_backend_kernels[backend] : NULL;
+}
+
+ethash_backend_t ethash_choose_backend(char const* requested)
+{
+	int cap = ETHASH_BACKEND_COUNT - 1;
+	if (requested) {
+		for (int b = 0; b != ETHASH_BACKEND_COUNT; ++b) {
+			if (strcmp(requested, ethash_backend_names[b]) == 0) {
+				cap = b;
+				break;
+			}
+		}
+	}
+	for (int b = cap; b > 0; --b) {
+		if (ethash_cpu_supports((ethash_backend_t) b)) {
+			return (ethash_backend_t) b;
+		}
+	}
+	return ETHASH_BACKEND_SCALAR;
+}
+
+ethash_kernels_t const* ethash_kernels(void)
+{
+	uint32_t active = ethash_atomic_load_u32(&ethash_active_backend);
+	if (!active) {
+		// Threads racing through here all make the same choice
+		active = (uint32_t) ethash_choose_backend(getenv("ETHASH_BACKEND")) + 1;
+		ethash_atomic_store_u32(&ethash_active_backend, active);
+	}
+	return &ethash_backend_kernels[active - 1];
+}
+
+ethash_backend_t ethash_get_backend(void)
+{
+	return ethash_kernels()->backend;
+}
+
+char const* ethash_backend_name(ethash_backend_t backend)
+{
+	return (unsigned) backend < ETHASH_BACKEND_COUNT ? ethash_backend_names[backend] : NULL;
+}
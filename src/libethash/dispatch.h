@@ -0,0 +1,83 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dispatch.h
+ * @date 2015
+ *
+ * Runtime selection of the kernel implementations. Every backend provides the
+ * same set of functions and they all produce bit-identical results.
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ethash_kernels {
+	ethash_backend_t backend;
+	/// Keccak-f[1600] over 25 lanes. NULL when Crypto++ provides SHA3
+	void (*keccakf)(uint64_t* state);
+	void (*dag_item)(node* const ret, uint32_t node_index, ethash_light_t const light);
+	/// Multi-buffer DAG item kernels of 8 and 4 items. NULL if not available
+	void (*dag_items_x8)(node* const ret, uint32_t const* node_index, ethash_light_t const light);
+	void (*dag_items_x4)(node* const ret, uint32_t const* node_index, ethash_light_t const light);
+	void (*hashimoto_mix)(
+		node* mix,
+		uint32_t seed,
+		node const* full_nodes,
+		ethash_light_t const light,
+		uint32_t num_full_pages
+	);
+	/// See @ref ethash_hashimoto_lanes()
+	void (*hashimoto_lanes)(
+		node (*s_mix)[MIX_NODES + 1],
+		node const* full_nodes,
+		uint32_t num_full_pages,
+		unsigned lanes
+	);
+} ethash_kernels_t;
+
+/**
+ * Get the kernels of the active backend. The backend is selected on the first
+ * call, from the CPU features and the ETHASH_BACKEND environment variable.
+ */
+ethash_kernels_t const* ethash_kernels(void);
+
+/**
+ * Get the kernels of a specific backend
+ *
+ * @return    The kernels or NULL if this build or the CPU can't run @a backend
+ */
+ethash_kernels_t const* ethash_kernels_for(ethash_backend_t backend);
+
+/// Check whether this build and the CPU (and OS) can run @a backend
+bool ethash_cpu_supports(ethash_backend_t backend);
+
+/**
+ * Pick a backend. The widest one the CPU supports, capped by @a requested.
+ *
+ * @param requested    A backend name as in ETHASH_BACKEND. NULL or an unknown
+ *                     name mean no cap.
+ */
+ethash_backend_t ethash_choose_backend(char const* requested);
+
+/// Portable Keccak-f[1600] from sha3.c
+void ethash_keccakf_scalar(uint64_t* state);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,502 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file epochs.c
+ * @date 2015
+ *
+ * Refcounted per-epoch light and full contexts. A context is built by the
+ * first thread to ask for it, under its build lock, while later askers wait
+ * on that lock. Contexts nobody holds stay around until the memory budget
+ * evicts them, least recently used first.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+#include "io.h"
+#include "thread.h"
+
+enum ethash_epoch_state {
+	ETHASH_EPOCH_BUILDING = 0,
+	ETHASH_EPOCH_READY,
+	ETHASH_EPOCH_FAILED
+};
+
+struct ethash_epoch {
+	struct ethash_epochs* epochs;
+	struct ethash_epoch* next;
+	struct ethash_epoch* light_context; // the light context a full one is built from
+	uint64_t epoch;
+	bool full_context;
+	// the fields below are guarded by the lock of the manager
+	bool linked;                        // in the list of the manager
+	enum ethash_epoch_state state;
+	uint32_t refs;
+	uint64_t used;                      // tick of the last use, for LRU eviction
+	uint64_t bytes;
+	ethash_mutex_t build_lock;          // held by the builder until the state is set
+	ethash_light_t light;
+	ethash_full_t full;
+};
+
+struct ethash_epochs {
+	ethash_epochs_params_t params;
+	char* dirname;
+	char* light_dirname;
+	uint64_t cache_size;                // sizes of every epoch if not 0, for tests
+	uint64_t full_size;
+	ethash_mutex_t lock;
+	struct ethash_epoch* contexts;
+	uint64_t bytes;
+	uint64_t tick;
+	uint64_t newest;                    // newest epoch asked for plus one, 0 for none
+	uint64_t prefetched;                // last epoch handed to the prefetch thread plus one
+	ethash_thread_t prefetch_thread;
+	bool prefetching;                   // prefetch_thread is not joined yet
+	uint32_t volatile prefetch_done;
+};
+
+static char* ethash_epochs_strdup(char const* str)
+{
+	if (!str) {
+		return NULL;
+	}
+	size_t const len = strlen(str) + 1;
+	char* ret = malloc(len);
+	if (ret) {
+		memcpy(ret, str, len);
+	}
+	return ret;
+}
+
+static uint64_t ethash_epochs_cache_size(struct ethash_epochs const* epochs, uint64_t epoch)
+{
+	return epochs->cache_size ? epochs->cache_size :
+		ethash_get_cachesize(epoch * ETHASH_EPOCH_LENGTH);
+}
+
+static uint64_t ethash_epochs_full_size(struct ethash_epochs const* epochs, uint64_t epoch)
+{
+	return epochs->full_size ? epochs->full_size :
+		ethash_get_datasize(epoch * ETHASH_EPOCH_LENGTH);
+}
+
+static void ethash_epoch_free(struct ethash_epoch* context)
+{
+	if (context->full) {
+		ethash_full_delete(context->full);
+	}
+	if (context->light) {
+		ethash_light_delete(context->light);
+	}
+	if (context->light_context) {
+		ethash_epoch_release(context->light_context);
+	}
+	ethash_mutex_delete(context->build_lock);
+	free(context);
+}
+
+static void ethash_epochs_unlink(struct ethash_epochs* epochs, struct ethash_epoch* context)
+{
+	for (struct ethash_epoch** p = &epochs->contexts; *p; p = &(*p)->next) {
+		if (*p == context) {
+			*p = context->next;
+			break;
+		}
+	}
+	context->next = NULL;
+	context->linked = false;
+	if (context->state == ETHASH_EPOCH_READY) {
+		epochs->bytes -= context->bytes;
+	}
+}
+
+/**
+ * The bytes the manager keeps. Without a budget of the user: the light caches
+ * of the newest epoch, the one before and the one after, plus the DAG in use
+ * once there is a full context, plus the next DAG if it is prefetched. Sizes
+ * are those of the epoch after the newest, the largest of them. Called with
+ * the lock held.
+ */
+static uint64_t ethash_epochs_budget(struct ethash_epochs const* epochs)
+{
+	if (epochs->params.budget) {
+		return epochs->params.budget;
+	}
+	uint64_t const next = epochs->newest;
+	uint64_t ret = 3 * ethash_epochs_cache_size(epochs, next);
+	unsigned dags = epochs->params.prefetch_full ? 2 : 0;
+	for (struct ethash_epoch const* c = epochs->contexts; c && dags == 0; c = c->next) {
+		if (c->full_context) {
+			dags = 1;
+		}
+	}
+	return ret + dags * ethash_epochs_full_size(epochs, next);
+}
+
+/**
+ * Unlink idle contexts, least recently used first, until the manager is within
+ * its budget. Called with the lock held, the victims are freed by the caller
+ * after releasing it.
+ */
+static struct ethash_epoch* ethash_epochs_evict(struct ethash_epochs* epochs)
+{
+	uint64_t const budget = ethash_epochs_budget(epochs);
+	struct ethash_epoch* victims = NULL;
+	while (epochs->bytes > budget) {
+		struct ethash_epoch* lru = NULL;
+		for (struct ethash_epoch* c = epochs->contexts; c; c = c->next) {
+			if (c->refs == 0 && c->state == ETHASH_EPOCH_READY && (!lru || c->used < lru->used)) {
+				lru = c;
+			}
+		}
+		if (!lru) {
+			break;
+		}
+		ethash_epochs_unlink(epochs, lru);
+		lru->next = victims;
+		victims = lru;
+	}
+	return victims;
+}
+
+static void ethash_epochs_free_list(struct ethash_epoch* list)
+{
+	while (list) {
+		struct ethash_epoch* next = list->next;
+		ethash_epoch_free(list);
+		list = next;
+	}
+}
+
+static ethash_epoch_t ethash_epochs_get(struct ethash_epochs* epochs, uint64_t epoch, bool full);
+
+static bool ethash_epoch_build(struct ethash_epochs* epochs, struct ethash_epoch* context)
+{
+	uint64_t const block_number = context->epoch * ETHASH_EPOCH_LENGTH;
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	if (!context->full_context) {
+		uint64_t const cache_size = ethash_epochs_cache_size(epochs, context->epoch);
+		context->light = ethash_light_new_internal_with_params(
+			cache_size,
+			&seedhash,
+			&epochs->params.light_params
+		);
+		if (!context->light) {
+			return false;
+		}
+		context->light->block_number = block_number;
+		context->bytes = cache_size;
+		return true;
+	}
+	context->light_context = ethash_epochs_get(epochs, context->epoch, false);
+	if (!context->light_context) {
+		return false;
+	}
+	ethash_light_t const light = context->light_context->light;
+	uint64_t const full_size = ethash_epochs_full_size(epochs, context->epoch);
+	if (epochs->params.in_memory) {
+		context->full = ethash_full_new_internal_in_memory(
+			full_size,
+			light,
+			NULL,
+			&epochs->params.full_params
+		);
+	} else {
+		char strbuf[256];
+		char const* dirname = epochs->dirname;
+		if (!dirname) {
+			if (!ethash_get_default_dirname(strbuf, 256)) {
+				return false;
+			}
+			dirname = strbuf;
+		}
+		context->full = ethash_full_new_internal_with_params(
+			dirname,
+			seedhash,
+			full_size,
+			light,
+			NULL,
+			&epochs->params.full_params
+		);
+	}
+	context->bytes = full_size;
+	return context->full != NULL;
+}
+
+static struct ethash_epoch* ethash_epochs_find(struct ethash_epochs* epochs, uint64_t epoch, bool full)
+{
+	for (struct ethash_epoch* c = epochs->contexts; c; c = c->next) {
+		if (c->epoch == epoch && c->full_context == full) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
+static ethash_epoch_t ethash_epochs_get(struct ethash_epochs* epochs, uint64_t epoch, bool full)
+{
+	// A build lock is only ever taken without the manager lock held, or
+	// before it, so the two can't deadlock. Hence a new context is set up
+	// before it is looked for again under the manager lock.
+	struct ethash_epoch* fresh = NULL;
+	struct ethash_epoch* context;
+	for (;;) {
+		ethash_mutex_lock(epochs->lock);
+		context = ethash_epochs_find(epochs, epoch, full);
+		if (context || fresh) {
+			break;
+		}
+		ethash_mutex_unlock(epochs->lock);
+		fresh = calloc(1, sizeof(*fresh));
+		if (!fresh || !(fresh->build_lock = ethash_mutex_new())) {
+			free(fresh);
+			return NULL;
+		}
+		ethash_mutex_lock(fresh->build_lock);
+	}
+	if (context) {
+		++context->refs;
+		context->used = ++epochs->tick;
+		ethash_mutex_unlock(epochs->lock);
+		if (fresh) {
+			// another thread got there first
+			ethash_mutex_unlock(fresh->build_lock);
+			ethash_mutex_delete(fresh->build_lock);
+			free(fresh);
+		}
+		// wait for the builder, if any
+		ethash_mutex_lock(context->build_lock);
+		ethash_mutex_unlock(context->build_lock);
+		ethash_mutex_lock(epochs->lock);
+		bool const failed = context->state == ETHASH_EPOCH_FAILED;
+		ethash_mutex_unlock(epochs->lock);
+		if (failed) {
+			ethash_epoch_release(context);
+			return NULL;
+		}
+		return context;
+	}
+
+	context = fresh;
+	context->epochs = epochs;
+	context->epoch = epoch;
+	context->full_context = full;
+	context->refs = 1;
+	context->used = ++epochs->tick;
+	context->linked = true;
+	context->next = epochs->contexts;
+	epochs->contexts = context;
+	ethash_mutex_unlock(epochs->lock);
+
+	bool const built = ethash_epoch_build(epochs, context);
+
+	ethash_mutex_lock(epochs->lock);
+	if (built) {
+		context->state = ETHASH_EPOCH_READY;
+		epochs->bytes += context->bytes;
+	} else {
+		// waiters see the failure, the next asker starts over
+		context->state = ETHASH_EPOCH_FAILED;
+		ethash_epochs_unlink(epochs, context);
+	}
+	struct ethash_epoch* victims = ethash_epochs_evict(epochs);
+	ethash_mutex_unlock(epochs->lock);
+	ethash_mutex_unlock(context->build_lock);
+	ethash_epochs_free_list(victims);
+	if (!built) {
+		ethash_epoch_release(context);
+		return NULL;
+	}
+	return context;
+}
+
+static void* ethash_epochs_prefetch_run(void* arg)
+{
+	struct ethash_epochs* epochs = (struct ethash_epochs*)arg;
+	ethash_mutex_lock(epochs->lock);
+	uint64_t const epoch = epochs->prefetched - 1;
+	ethash_mutex_unlock(epochs->lock);
+	ethash_epoch_t context = ethash_epochs_get(epochs, epoch, epochs->params.prefetch_full);
+	if (context) {
+		ethash_epoch_release(context);
+	}
+	ethash_atomic_store_u32(&epochs->prefetch_done, 1);
+	return NULL;
+}
+
+/// Record an epoch asked for by the user, the prefetch thread doesn't count
+static void ethash_epochs_asked(struct ethash_epochs* epochs, uint64_t epoch)
+{
+	ethash_mutex_lock(epochs->lock);
+	if (epoch + 1 > epochs->newest) {
+		epochs->newest = epoch + 1;
+	}
+	ethash_mutex_unlock(epochs->lock);
+}
+
+/**
+ * Start building the epoch after the newest one asked for, unless it was
+ * already handed to the prefetch thread. A thread that still runs is left
+ * alone, the next call catches up.
+ */
+static void ethash_epochs_prefetch(struct ethash_epochs* epochs)
+{
+	if (!epochs->params.prefetch && !epochs->params.prefetch_full) {
+		return;
+	}
+	ethash_mutex_lock(epochs->lock);
+	uint64_t const target = epochs->newest + 1;
+	if (epochs->prefetched == target ||
+		(epochs->prefetching && !ethash_atomic_load_u32(&epochs->prefetch_done))) {
+		ethash_mutex_unlock(epochs->lock);
+		return;
+	}
+	if (epochs->prefetching) {
+		// done, so this only waits for the thread to return
+		ethash_thread_join(epochs->prefetch_thread);
+		epochs->prefetching = false;
+	}
+	epochs->prefetched = target;
+	ethash_atomic_store_u32(&epochs->prefetch_done, 0);
+	epochs->prefetching = ethash_thread_create(&epochs->prefetch_thread, ethash_epochs_prefetch_run, epochs);
+	ethash_mutex_unlock(epochs->lock);
+}
+
+ethash_epochs_t ethash_epochs_new_internal(
+	ethash_epochs_params_t const* params,
+	uint64_t cache_size,
+	uint64_t full_size
+)
+{
+	struct ethash_epochs* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (params) {
+		ret->params = *params;
+	}
+	ret->dirname = ethash_epochs_strdup(ret->params.dirname);
+	ret->light_dirname = ethash_epochs_strdup(ret->params.light_params.dirname);
+	if ((ret->params.dirname && !ret->dirname) ||
+		(ret->params.light_params.dirname && !ret->light_dirname)) {
+		goto fail_free_epochs;
+	}
+	// the copies outlive the caller's strings
+	ret->params.dirname = ret->dirname;
+	ret->params.light_params.dirname = ret->light_dirname;
+	ret->cache_size = cache_size;
+	ret->full_size = full_size;
+	ret->lock = ethash_mutex_new();
+	if (!ret->lock) {
+		goto fail_free_epochs;
+	}
+	return ret;
+
+fail_free_epochs:
+	free(ret->dirname);
+	free(ret->light_dirname);
+	free(ret);
+	return NULL;
+}
+
+ethash_epochs_t ethash_epochs_new(ethash_epochs_params_t const* params)
+{
+	return ethash_epochs_new_internal(params, 0, 0);
+}
+
+ethash_epoch_t ethash_epochs_get_light(ethash_epochs_t epochs, uint64_t block_number)
+{
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	ethash_epochs_asked(epochs, epoch);
+	ethash_epoch_t ret = ethash_epochs_get(epochs, epoch, false);
+	ethash_epochs_prefetch(epochs);
+	return ret;
+}
+
+ethash_epoch_t ethash_epochs_get_full(ethash_epochs_t epochs, uint64_t block_number)
+{
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	ethash_epochs_asked(epochs, epoch);
+	ethash_epoch_t ret = ethash_epochs_get(epochs, epoch, true);
+	ethash_epochs_prefetch(epochs);
+	return ret;
+}
+
+bool ethash_epochs_cached_internal(ethash_epochs_t epochs, uint64_t block_number, bool full)
+{
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	bool ret = false;
+	ethash_mutex_lock(epochs->lock);
+	struct ethash_epoch const* context = ethash_epochs_find(epochs, epoch, full);
+	ret = context && context->state == ETHASH_EPOCH_READY;
+	ethash_mutex_unlock(epochs->lock);
+	return ret;
+}
+
+ethash_light_t ethash_epoch_light(ethash_epoch_t epoch)
+{
+	return epoch->full_context ? epoch->light_context->light : epoch->light;
+}
+
+ethash_full_t ethash_epoch_full(ethash_epoch_t epoch)
+{
+	return epoch->full;
+}
+
+void ethash_epoch_release(ethash_epoch_t epoch)
+{
+	struct ethash_epochs* epochs = epoch->epochs;
+	struct ethash_epoch* victims;
+	ethash_mutex_lock(epochs->lock);
+	if (--epoch->refs == 0 && !epoch->linked) {
+		// a failed build, nobody else can find it
+		ethash_mutex_unlock(epochs->lock);
+		ethash_epoch_free(epoch);
+		return;
+	}
+	victims = ethash_epochs_evict(epochs);
+	ethash_mutex_unlock(epochs->lock);
+	ethash_epochs_free_list(victims);
+}
+
+void ethash_epochs_delete(ethash_epochs_t epochs)
+{
+	if (epochs->prefetching) {
+		ethash_thread_join(epochs->prefetch_thread);
+	}
+	// Full contexts first, they hold references to light ones. The list is
+	// taken away, so their releases don't evict from it.
+	struct ethash_epoch* contexts = epochs->contexts;
+	epochs->contexts = NULL;
+	for (int pass = 0; pass != 2; ++pass) {
+		struct ethash_epoch** p = &contexts;
+		while (*p) {
+			struct ethash_epoch* c = *p;
+			if (c->full_context == (pass == 0)) {
+				*p = c->next;
+				ethash_epoch_free(c);
+			} else {
+				p = &c->next;
+			}
+		}
+	}
+	ethash_mutex_delete(epochs->lock);
+	free(epochs->dirname);
+	free(epochs->light_dirname);
+	free(epochs);
+}
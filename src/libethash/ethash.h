@@ -29,7 +29,7 @@
 #define ETHASH_REVISION 23
 #define ETHASH_DATASET_BYTES_INIT 1073741824U // 2**30
 #define ETHASH_DATASET_BYTES_GROWTH 8388608U  // 2**23
-#define ETHASH_CACHE_BYTES_INIT 1073741824U // 2**24
+#define ETHASH_CACHE_BYTES_INIT 16777216U // 2**24
 #define ETHASH_CACHE_BYTES_GROWTH 131072U  // 2**17
 #define ETHASH_EPOCH_LENGTH 30000U
 #define ETHASH_MIX_BYTES 128
@@ -39,6 +39,8 @@
 #define ETHASH_ACCESSES 64
 #define ETHASH_DAG_MAGIC_NUM_SIZE 8
 #define ETHASH_DAG_MAGIC_NUM 0xFEE1DEADBADDCAFE
+#define ETHASH_CACHE_ALIGNMENT 64     // a cache line, the size of a cache node
+#define ETHASH_DAG_ALIGNMENT 4096     // a page, as O_DIRECT DAG writes need
 
 #ifdef __cplusplus
 extern "C" {
@@ -59,14 +61,139 @@ struct ethash_light;
 typedef struct ethash_light* ethash_light_t;
 struct ethash_full;
 typedef struct ethash_full* ethash_full_t;
+struct ethash_full_async;
+typedef struct ethash_full_async* ethash_full_async_t;
+struct ethash_epochs;
+typedef struct ethash_epochs* ethash_epochs_t;
+struct ethash_epoch;
+typedef struct ethash_epoch* ethash_epoch_t;
 typedef int(*ethash_callback_t)(unsigned);
 
+/// Pages backing the DAG or the light cache. Hashimoto and the DAG item
+/// generation read them at random, so larger pages mean fewer TLB misses.
+typedef enum ethash_pages {
+	ETHASH_PAGES_NORMAL = 0,    ///< Normal pages. The DAG is mapped from its file
+	ETHASH_PAGES_TRANSPARENT,   ///< Normal pages advised to become transparent huge pages
+	ETHASH_PAGES_2MB,           ///< 2MB pages from the huge page pool
+	ETHASH_PAGES_1GB            ///< 1GB pages from the huge page pool
+} ethash_pages_t;
+
+/// Placement of the DAG on machines with several NUMA nodes
+typedef enum ethash_numa {
+	ETHASH_NUMA_NONE = 0,       ///< Pages land where they are first touched
+	ETHASH_NUMA_INTERLEAVE,     ///< Pages are spread round-robin over all nodes
+	ETHASH_NUMA_REPLICATE       ///< One copy of the DAG per node. Hashing reads the copy
+	                            ///< of the node the calling thread runs on
+} ethash_numa_t;
+
+/// How a newly generated DAG gets to its file
+typedef enum ethash_dag_io {
+	ETHASH_DAG_IO_MMAP = 0,     ///< Generate into a shared mapping of the file and leave
+	                            ///< the writeback of the dirty pages to the kernel
+	ETHASH_DAG_IO_STREAM,       ///< Generate in anonymous memory, then write the file chunk
+	                            ///< by chunk, waiting for the writeback of each chunk
+	ETHASH_DAG_IO_DIRECT        ///< Like stream but with O_DIRECT, bypassing the page cache.
+	                            ///< Falls back to stream where O_DIRECT is not supported
+} ethash_dag_io_t;
+
+/// Scheduling priority of background work, see @ref ethash_full_new_async()
+typedef enum ethash_priority {
+	ETHASH_PRIORITY_NORMAL = 0, ///< Same as any other thread
+	ETHASH_PRIORITY_LOW,        ///< Yields to normal threads but still makes steady progress
+	ETHASH_PRIORITY_IDLE        ///< Only runs when the CPU or the disk has nothing else to do
+} ethash_priority_t;
+
+/// Memory hooks for the light cache or the DAG, e.g. to place them in an arena
+/// of pinned, huge page or shared memory. The memory is filled in place.
+typedef struct ethash_allocator {
+	/// Get @a size bytes aligned to @a alignment, which is ETHASH_CACHE_ALIGNMENT for
+	/// the light cache and ETHASH_DAG_ALIGNMENT for the DAG. NULL means out of memory.
+	/// Misaligned memory is handed back to @a free and the creation fails.
+	void* (*alloc)(size_t size, size_t alignment, void* context);
+	/// Give back memory from @a alloc when the handler is deleted. May be NULL if the
+	/// caller reclaims the memory itself, e.g. a buffer that @a alloc just hands out.
+	void (*free)(void* p, size_t size, void* context);
+	void* context;           ///< Passed to both hooks
+} ethash_allocator_t;
+
+/// Tuning parameters for the creation of an ethash_full handler.
+/// A zero-initialized struct gives the default behaviour.
+typedef struct ethash_full_params {
+	unsigned threads;        ///< Number of threads generating the DAG. 0 means all online cores
+	unsigned search_lanes;   ///< Nonces @ref ethash_full_search() interleaves to overlap DAG reads.
+	                         ///< 0 means the default of 8, values above 16 are capped
+	ethash_pages_t pages;    ///< Preferred pages for the DAG. Anything but normal pages keeps
+	                         ///< the DAG in anonymous memory and reads or writes its file in one go.
+	                         ///< Falls back to smaller pages, see @ref ethash_full_pages()
+	ethash_numa_t numa;      ///< DAG placement over NUMA nodes. Anything but none also binds
+	                         ///< the threads of @ref ethash_search_start() to nodes round-robin
+	ethash_dag_io_t dag_io;  ///< How a generated DAG is written. Huge pages imply stream
+	uint64_t dag_io_rate;    ///< Cap of stream and direct writes in bytes per second. 0 means none
+	ethash_priority_t cpu_priority; ///< CPU priority of the threads of @ref ethash_full_new_async()
+	ethash_priority_t io_priority;  ///< I/O priority of the DAG file reads and writes of
+	                                ///< @ref ethash_full_new_async()
+	ethash_allocator_t const* allocator; ///< Memory for the DAG instead of the library's own.
+	                         ///< Overrides @a pages and @a numa, the DAG file is read into it
+	                         ///< or written from it. NULL means page aligned anonymous memory
+} ethash_full_params_t;
+
+/// Parameters for the creation of an ethash_light handler.
+/// A zero-initialized struct gives the default behaviour.
+typedef struct ethash_light_params {
+	ethash_pages_t pages;    ///< Preferred pages for the cache, see @ref ethash_light_pages()
+	bool persist;            ///< Keep the cache in a file of @a dirname. A valid file is mapped
+	                         ///< with normal pages and read with others, instead of computing
+	                         ///< the cache. Otherwise the computed cache is written to it.
+	char const* dirname;     ///< Directory of the cache file. NULL means the default DAG directory
+	bool shared;             ///< Map the cache read-only from named shared memory, where the
+	                         ///< first process of the host to ask builds it. Takes normal pages
+	                         ///< whatever @a pages says. Falls back to a private cache if the
+	                         ///< system has no shared memory with a creation lock.
+	ethash_allocator_t const* allocator; ///< Memory for the cache instead of the library's
+	                         ///< own. Overrides @a pages, a persisted cache is read into it.
+	                         ///< Ignored for a shared cache. NULL means 64 byte aligned memory
+} ethash_light_params_t;
+
+/// Parameters of an epoch context manager, see @ref ethash_epochs_new().
+/// A zero-initialized struct gives the default behaviour.
+typedef struct ethash_epochs_params {
+	uint64_t budget;         ///< Bytes of caches and DAGs to keep. Contexts nobody holds are
+	                         ///< evicted least recently used first to stay below it. 0 means
+	                         ///< room for three light caches around the newest epoch asked for,
+	                         ///< plus one DAG once there is a full context, or two DAGs with
+	                         ///< @a prefetch_full so the prefetched one is kept
+	bool prefetch;           ///< Build the light context of the epoch after the newest one
+	                         ///< asked for on a background thread
+	bool prefetch_full;      ///< Build its full context in the background too
+	bool in_memory;          ///< Keep the DAGs of full contexts in memory only
+	char const* dirname;     ///< DAG directory of full contexts. NULL means the default directory
+	ethash_light_params_t light_params; ///< How the light caches are created
+	ethash_full_params_t full_params;   ///< How the DAGs are created
+} ethash_epochs_params_t;
+
+/// Implementations of the hot kernels: Keccak, DAG item generation and the
+/// hashimoto mix. Ordered from the most portable to the widest.
+typedef enum ethash_backend {
+	ETHASH_BACKEND_SCALAR = 0,
+	ETHASH_BACKEND_SSE41,
+	ETHASH_BACKEND_AVX2,
+	ETHASH_BACKEND_AVX512,
+	ETHASH_BACKEND_COUNT
+} ethash_backend_t;
+
 typedef struct ethash_return_value {
 	ethash_h256_t result;
 	ethash_h256_t mix_hash;
 	bool success;
 } ethash_return_value_t;
 
+/// A nonce found by @ref ethash_full_search()
+typedef struct ethash_search_result {
+	uint64_t nonce;
+	ethash_h256_t result;
+	ethash_h256_t mix_hash;
+} ethash_search_result_t;
+
 /**
  * Allocate and initialize a new ethash_light handler
  *
@@ -75,6 +202,28 @@ typedef struct ethash_return_value {
  *                       ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
  */
 ethash_light_t ethash_light_new(uint64_t block_number);
+/**
+ * Allocate and initialize a new ethash_light handler with custom parameters
+ *
+ * @param block_number   The block number for which to create the handler
+ * @param params         Creation parameters. NULL is the same as all-default parameters.
+ * @return               Newly allocated ethash_light handler or NULL in case of
+ *                       ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
+ */
+ethash_light_t ethash_light_new_with_params(uint64_t block_number, ethash_light_params_t const* params);
+/**
+ * Remove the shared memory cache of the epoch of @a block_number, see
+ * ethash_light_params_t.shared. Handlers using it are not affected, its
+ * memory is freed with the last of them. The next handler that asks for it
+ * builds it again.
+ *
+ * @return              true if the epoch has no shared cache any more
+ */
+bool ethash_light_remove_shared(uint64_t block_number);
+/**
+ * Get the pages that actually back the cache of a light handler
+ */
+ethash_pages_t ethash_light_pages(ethash_light_t light);
 /**
  * Frees a previously allocated ethash_light handler
  * @param light        The light handler to free
@@ -110,6 +259,113 @@ ethash_return_value_t ethash_light_compute(
  */
 ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback);
 
+/**
+ * Allocate and initialize a new ethash_full handler with custom parameters
+ *
+ * @param light         The light handler containing the cache.
+ * @param callback      Same as in @ref ethash_full_new(). When the DAG is generated by
+ *                      several threads the callback is still only ever invoked from
+ *                      the calling thread, one call at a time.
+ * @param params        Tuning parameters. NULL is the same as all-default parameters.
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_with_params(
+	ethash_light_t light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Allocate and initialize a new ethash_full handler without a DAG file
+ *
+ * The DAG is generated into anonymous memory, huge page backed if requested
+ * in @a params, and is gone once the handler is deleted. No directory or file
+ * is created, for hosts where the disk is slow or the DAG would not be reused.
+ *
+ * @param light         The light handler containing the cache.
+ * @param callback      Same as in @ref ethash_full_new_with_params().
+ * @param params        Tuning parameters. NULL is the same as all-default parameters.
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_in_memory(
+	ethash_light_t light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Allocate a new ethash_full handler whose DAG is built in the background
+ *
+ * Returns as soon as the memory is allocated and the filler threads run, so
+ * hashing can start right after an epoch switch. DAG pages that aren't built
+ * yet are calculated from the cache on the spot: the first hashes cost about
+ * as much as light client ones and the rate ramps up as the DAG fills in. The
+ * DAG only lives in memory, like with @ref ethash_full_new_in_memory().
+ *
+ * @param light         The light handler containing the cache. It has to
+ *                      outlive the returned handler.
+ * @param params        Tuning parameters. NULL is the same as all-default parameters.
+ *                      threads is the number of filler threads. ETHASH_NUMA_REPLICATE
+ *                      falls back to ETHASH_NUMA_INTERLEAVE since copies need the
+ *                      finished DAG.
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or if no filler thread could be started
+ */
+ethash_full_t ethash_full_new_lazy(
+	ethash_light_t light,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Start creating an ethash_full handler on a background thread, e.g. the one
+ * of the next epoch while the current one is still being mined
+ *
+ * The DAG is generated with the threads and priorities of @a params, so it
+ * can be built next to the hashing threads without starving them. Poll it
+ * with @ref ethash_full_async_finished() and collect the handler with
+ * @ref ethash_full_async_wait().
+ *
+ * @param light         The light handler containing the cache. It has to
+ *                      outlive the generation.
+ * @param in_memory     Keep the DAG in memory like @ref ethash_full_new_in_memory()
+ *                      instead of the file in the default directory
+ * @param params        Tuning parameters. NULL is the same as all-default parameters.
+ * @return              Newly allocated handle of the generation or NULL in case of
+ *                      ERRNOMEM or if its thread could not be started
+ */
+ethash_full_async_t ethash_full_new_async(
+	ethash_light_t light,
+	bool in_memory,
+	ethash_full_params_t const* params
+);
+/**
+ * Check whether the generation is over, successful or not, without blocking
+ */
+bool ethash_full_async_finished(ethash_full_async_t async);
+/**
+ * Get the percentage of the DAG generated so far
+ */
+unsigned ethash_full_async_progress(ethash_full_async_t async);
+/**
+ * Ask the generation to stop. It does so at its next progress step. A DAG file
+ * left behind is resumed by the next generation of the same epoch.
+ */
+void ethash_full_async_cancel(ethash_full_async_t async);
+/**
+ * Block until the generation is over and take its ethash_full handler
+ *
+ * @return              The handler, owned by the caller from now on, or NULL if
+ *                      the generation failed, was cancelled or was already taken
+ */
+ethash_full_t ethash_full_async_wait(ethash_full_async_t async);
+/**
+ * Cancel the generation if it still runs, wait for it and free the handle
+ * together with a handler that was never taken
+ */
+void ethash_full_async_delete(ethash_full_async_t async);
+
 /**
  * Frees a previously allocated ethash_full handler
  * @param full    The light handler to free
@@ -129,18 +385,264 @@ ethash_return_value_t ethash_full_compute(
 	uint64_t nonce
 );
 /**
- * Get a pointer to the full DAG data
+ * Search a range of nonces for the ones that satisfy a boundary
+ *
+ * Hashes start_nonce, start_nonce + 1, ... and keeps every nonce whose result
+ * is less than or equal to @a boundary. Stops after @a count nonces or once
+ * @a max_results winners were found, so a search cut short can be resumed
+ * right after the nonce of the last result.
+ *
+ * @param full           The full client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param start_nonce    The first nonce to try
+ * @param count          Number of nonces to try
+ * @param boundary       The boundary is defined as (2^256 / difficulty), big endian
+ * @param results        Array with room for @a max_results winners
+ * @param max_results    Maximum number of winners to return
+ * @return               The number of winners written to @a results
+ */
+unsigned ethash_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_result_t* results,
+	unsigned max_results
+);
+
+struct ethash_search;
+typedef struct ethash_search* ethash_search_t;
+/// Invoked for every winner of an @ref ethash_search_start() search.
+/// Return non-zero to stop the search.
+typedef int(*ethash_search_callback_t)(ethash_search_result_t const*, void*);
+
+/**
+ * Start searching a range of nonces on a pool of threads
+ *
+ * The range is split between the threads and a thread that runs out of work
+ * steals half of what is left to another one, so every nonce is tried exactly
+ * once. The search runs until the range is exhausted, the callback returns
+ * non-zero or @ref ethash_search_stop() is called.
+ *
+ * @param full           The full client handler. Must outlive the search
+ * @param header_hash    The header hash to pack into the mix
+ * @param boundary       The boundary is defined as (2^256 / difficulty), big endian
+ * @param start_nonce    The first nonce to try
+ * @param count          Number of nonces to try. 0 means search until stopped
+ * @param threads        Number of search threads. 0 means all online cores
+ * @param callback       Called with each winner and @a context. Calls come from
+ *                       the search threads but never run concurrently
+ * @param context        Passed through to @a callback
+ * @return               The running search or NULL in case of ERRNOMEM, if no
+ *                       thread could be started or on invalid parameters.
+ *                       Free it with @ref ethash_search_delete()
+ */
+ethash_search_t ethash_search_start(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	ethash_h256_t const* boundary,
+	uint64_t start_nonce,
+	uint64_t count,
+	unsigned threads,
+	ethash_search_callback_t callback,
+	void* context
+);
+/**
+ * Ask the search threads to stop. Returns without waiting for them, so it is
+ * safe to call from the callback
+ */
+void ethash_search_stop(ethash_search_t search);
+/**
+ * Check whether all search threads have stopped
+ */
+bool ethash_search_finished(ethash_search_t search);
+/**
+ * Wait for the search threads to stop. Does not stop them by itself
+ */
+void ethash_search_wait(ethash_search_t search);
+/**
+ * Get the number of threads of a search
+ */
+unsigned ethash_search_threads(ethash_search_t search);
+/**
+ * Get the number of nonces hashed so far by one thread of a search
+ */
+uint64_t ethash_search_thread_hashes(ethash_search_t search, unsigned thread);
+/**
+ * Get the number of nonces hashed so far by all threads of a search
+ */
+uint64_t ethash_search_hashes(ethash_search_t search);
+/**
+ * Stop a search, wait for its threads and free it
+ */
+void ethash_search_delete(ethash_search_t search);
+
+/**
+ * Get a pointer to the full DAG data. The DAG of a handler from
+ * @ref ethash_full_new_lazy() is only complete once @ref ethash_full_progress()
+ * reports 100.
  */
 void const* ethash_full_dag(ethash_full_t full);
 /**
  * Get the size of the DAG data
  */
 uint64_t ethash_full_dag_size(ethash_full_t full);
+/**
+ * Get the number of copies of the DAG. More than one only with
+ * ETHASH_NUMA_REPLICATE on a machine with several NUMA nodes
+ */
+unsigned ethash_full_replicas(ethash_full_t full);
+/**
+ * Get the pages that actually back the DAG. Can be smaller than requested in
+ * @ref ethash_full_params_t if the huge page pool is exhausted or not available
+ */
+ethash_pages_t ethash_full_pages(ethash_full_t full);
+/**
+ * Get the percentage of the DAG that is built. Always 100 but for handlers
+ * from @ref ethash_full_new_lazy().
+ */
+unsigned ethash_full_progress(ethash_full_t full);
+/**
+ * Block until the DAG of a handler from @ref ethash_full_new_lazy() is built.
+ * Returns right away for any other handler. Several threads may wait at once,
+ * but like any other use of the handler none may overlap
+ * @ref ethash_full_delete().
+ */
+void ethash_full_wait(ethash_full_t full);
+
+/**
+ * Calculate the DAG items [begin, end) of the epoch of @a light, e.g. one
+ * slice of a DAG built by several processes or machines
+ *
+ * @param light         The light handler containing the cache
+ * @param begin         Index of the first item. Items are 64 bytes.
+ * @param end           Index past the last item
+ * @param mem           Buffer for the end - begin items
+ * @param threads       Number of threads, including the calling one. 0 means all online cores
+ * @param callback      Progress over the range, see @ref ethash_full_new(). Can be NULL.
+ * @return              true for success and false for an invalid range or if
+ *                      the callback stopped the calculation
+ */
+bool ethash_compute_dag_range(
+	ethash_light_t light,
+	uint32_t begin,
+	uint32_t end,
+	void* mem,
+	unsigned threads,
+	ethash_callback_t callback
+);
+/**
+ * Calculate the DAG items [begin, end) of the epoch of @a light into their
+ * place in its DAG file. The file is created if needed and shared with other
+ * writers, so processes that see the same directory can build a slice each.
+ * Writing a range of a complete file regenerates just that part of it.
+ *
+ * A new file is only usable once all of it was written and it was sealed
+ * with @ref ethash_dag_file_seal(). Until then no full handler should be
+ * created for the epoch, or it starts the file over.
+ *
+ * @param dirname       Directory of the DAG file. NULL means the default directory.
+ * @return              true for success and false for an invalid range, an I/O
+ *                      error or if the callback stopped the calculation
+ */
+bool ethash_dag_file_write_range(
+	ethash_light_t light,
+	char const* dirname,
+	uint32_t begin,
+	uint32_t end,
+	unsigned threads,
+	ethash_callback_t callback
+);
+/**
+ * Mark the DAG file of the epoch of @a light as complete once all its slices
+ * were written with @ref ethash_dag_file_write_range()
+ *
+ * @param dirname       Directory of the DAG file. NULL means the default directory.
+ * @return              true for success and false if the file is missing,
+ *                      still too short or can't be written
+ */
+bool ethash_dag_file_seal(ethash_light_t light, char const* dirname);
+
+/**
+ * Create a manager of per-epoch contexts. It builds the light cache or the DAG
+ * of an epoch once, however many threads ask for it at the same time, and
+ * hands out the result to all of them.
+ *
+ * @param params        Parameters. NULL is the same as all-default parameters.
+ * @return              The manager or NULL in case of ERRNOMEM
+ */
+ethash_epochs_t ethash_epochs_new(ethash_epochs_params_t const* params);
+/**
+ * Get the light context of the epoch of @a block_number, building it if needed.
+ * Blocks while another thread builds it.
+ *
+ * @return              A reference to the context, to be given back with
+ *                      @ref ethash_epoch_release(), or NULL if it could not be built
+ */
+ethash_epoch_t ethash_epochs_get_light(ethash_epochs_t epochs, uint64_t block_number);
+/**
+ * Get the full context of the epoch of @a block_number, building its DAG if
+ * needed, see @ref ethash_epochs_get_light()
+ */
+ethash_epoch_t ethash_epochs_get_full(ethash_epochs_t epochs, uint64_t block_number);
+/**
+ * Get the light handler of a context. It stays valid until the context is
+ * released and must not be deleted.
+ */
+ethash_light_t ethash_epoch_light(ethash_epoch_t epoch);
+/**
+ * Get the full handler of a context, NULL for a light context. It stays valid
+ * until the context is released and must not be deleted.
+ */
+ethash_full_t ethash_epoch_full(ethash_epoch_t epoch);
+/**
+ * Give back a reference to a context. The context is kept for later use
+ * within the budget of its manager.
+ */
+void ethash_epoch_release(ethash_epoch_t epoch);
+/**
+ * Free a manager and the contexts it keeps. Waits for a background build.
+ * Every context must be released before.
+ */
+void ethash_epochs_delete(ethash_epochs_t epochs);
 
 /**
  * Calculate the seedhash for a given block number
  */
 ethash_h256_t ethash_get_seedhash(uint64_t block_number);
+/**
+ * Find the epoch of a seedhash, e.g. for a work package that only carries the
+ * seedhash. Covers the 2048 epochs with tabulated sizes.
+ *
+ * @param seedhash      The seedhash to look up
+ * @param[out] epoch    The epoch, block number divided by ETHASH_EPOCH_LENGTH
+ * @return              true if the seedhash is the one of a covered epoch
+ */
+bool ethash_get_epoch(ethash_h256_t const seedhash, uint64_t* epoch);
+
+/**
+ * Get the number of online NUMA nodes. 1 if NUMA is not supported
+ */
+unsigned ethash_numa_nodes(void);
+/**
+ * Restrict the calling thread to the CPUs of the n-th NUMA node, e.g. to keep
+ * a verification thread next to its DAG replica
+ *
+ * @return    true on success, false if the node does not exist or NUMA is not supported
+ */
+bool ethash_numa_bind_thread(unsigned node);
+
+/**
+ * Get the backend the library uses. It is picked once, on first use, as the
+ * widest one the CPU supports. Setting the ETHASH_BACKEND environment variable
+ * to "scalar", "sse41", "avx2" or "avx512" caps it, e.g. for A/B benchmarks.
+ */
+ethash_backend_t ethash_get_backend(void);
+/**
+ * Get the name of a backend as accepted by ETHASH_BACKEND, or NULL if invalid
+ */
+char const* ethash_backend_name(ethash_backend_t backend);
 
 #ifdef __cplusplus
 }
@@ -32,6 +32,12 @@
 #include "internal.h"
 #include "data_sizes.h"
 #include "io.h"
+#include "pages.h"
+#include "shm.h"
+#include "thread.h"
+#include "simd.h"
+#include "dispatch.h"
+#include "util.h"
 
 #ifdef WITH_CRYPTOPP
 
@@ -41,22 +47,146 @@
 #include "sha3.h"
 #endif // WITH_CRYPTOPP
 
+static uint64_t ethash_mulmod(uint64_t a, uint64_t b, uint64_t n)
+{
+	if (n <= UINT32_MAX) {
+		return a * b % n;
+	}
+	// double and add, so nothing overflows for any 64-bit modulus
+	uint64_t ret = 0;
+	a %= n;
+	for (; b; b >>= 1) {
+		if (b & 1) {
+			ret = ret >= n - a ? ret - (n - a) : ret + a;
+		}
+		a = a >= n - a ? a - (n - a) : a + a;
+	}
+	return ret;
+}
+
+static uint64_t ethash_powmod(uint64_t a, uint64_t e, uint64_t n)
+{
+	uint64_t ret = 1;
+	for (a %= n; e; e >>= 1) {
+		if (e & 1) {
+			ret = ethash_mulmod(ret, a, n);
+		}
+		a = ethash_mulmod(a, a, n);
+	}
+	return ret;
+}
+
+bool ethash_is_prime(uint64_t n)
+{
+	// Miller-Rabin with bases that make it deterministic for all 64-bit n.
+	// 2, 7 and 61 alone already are below 4759123141.
+	static uint64_t const bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+	if (n < 2) {
+		return false;
+	}
+	if (n % 2 == 0) {
+		return n == 2;
+	}
+	uint64_t d = n - 1;
+	unsigned s = 0;
+	for (; d % 2 == 0; d /= 2) {
+		++s;
+	}
+	for (unsigned i = 0; i != sizeof(bases) / sizeof(bases[0]); ++i) {
+		uint64_t const a = bases[i] % n;
+		if (a == 0) {
+			continue;
+		}
+		uint64_t x = ethash_powmod(a, d, n);
+		if (x == 1 || x == n - 1) {
+			continue;
+		}
+		unsigned r = 1;
+		for (; r < s; ++r) {
+			x = ethash_mulmod(x, x, n);
+			if (x == n - 1) {
+				break;
+			}
+		}
+		if (r == s) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// The largest prime multiple of @a item below @a bound, a multiple of 2 * @a item
+static uint64_t ethash_prime_size(uint64_t bound, uint64_t item)
+{
+	uint64_t i = bound / item - 1;
+	while (!ethash_is_prime(i)) {
+		i -= 2;
+	}
+	return i * item;
+}
+
+uint64_t ethash_generate_datasize(uint64_t epoch)
+{
+	return ethash_prime_size(
+		ETHASH_DATASET_BYTES_INIT + (uint64_t)ETHASH_DATASET_BYTES_GROWTH * epoch,
+		ETHASH_MIX_BYTES
+	);
+}
+
+uint64_t ethash_generate_cachesize(uint64_t epoch)
+{
+	return ethash_prime_size(
+		ETHASH_CACHE_BYTES_INIT + (uint64_t)ETHASH_CACHE_BYTES_GROWTH * epoch,
+		ETHASH_HASH_BYTES
+	);
+}
+
+// Sizes of the epochs after the tables, computed once. 0 until then.
+#define ETHASH_MEMO_EPOCHS 4096
+static uint64_t volatile ethash_memo_datasizes[ETHASH_MEMO_EPOCHS];
+static uint64_t volatile ethash_memo_cachesizes[ETHASH_MEMO_EPOCHS];
+
+static uint64_t ethash_memo_size(
+	uint64_t volatile* memo,
+	uint64_t epoch,
+	uint64_t (*generate)(uint64_t)
+)
+{
+	uint64_t const i = epoch - ETHASH_TABULATED_EPOCHS;
+	if (i >= ETHASH_MEMO_EPOCHS) {
+		return generate(epoch);
+	}
+	uint64_t ret = ethash_atomic_load_u64(&memo[i]);
+	if (ret == 0) {
+		// racing threads store the same value
+		ret = generate(epoch);
+		ethash_atomic_store_u64(&memo[i], ret);
+	}
+	return ret;
+}
+
 uint64_t ethash_get_datasize(uint64_t const block_number)
 {
-	assert(block_number / ETHASH_EPOCH_LENGTH < 2048);
-	return dag_sizes[block_number / ETHASH_EPOCH_LENGTH];
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (epoch < ETHASH_TABULATED_EPOCHS) {
+		return dag_sizes[epoch];
+	}
+	return ethash_memo_size(ethash_memo_datasizes, epoch, ethash_generate_datasize);
 }
 
 uint64_t ethash_get_cachesize(uint64_t const block_number)
 {
-	assert(block_number / ETHASH_EPOCH_LENGTH < 2048);
-	return cache_sizes[block_number / ETHASH_EPOCH_LENGTH];
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (epoch < ETHASH_TABULATED_EPOCHS) {
+		return cache_sizes[epoch];
+	}
+	return ethash_memo_size(ethash_memo_cachesizes, epoch, ethash_generate_cachesize);
 }
 
 // Follows Sergio's "STRICT MEMORY HARD HASHING FUNCTIONS" (2014)
 // https://bitslog.files.wordpress.com/2013/12/memohash-v0-3.pdf
 // SeqMemoHash(s, R, N)
-bool static ethash_compute_cache_nodes(
+bool ethash_compute_cache_nodes(
 	node* const nodes,
 	uint64_t cache_size,
 	ethash_h256_t const* seed
@@ -67,10 +197,10 @@ bool static ethash_compute_cache_nodes(
 	}
 	uint32_t const num_nodes = (uint32_t) (cache_size / sizeof(node));
 
-	SHA3_512(nodes[0].bytes, (uint8_t*)seed, 32);
+	SHA3_512_32(nodes[0].bytes, (uint8_t*)seed);
 
 	for (uint32_t i = 1; i != num_nodes; ++i) {
-		SHA3_512(nodes[i].bytes, nodes[i - 1].bytes, 64);
+		SHA3_512_64(nodes[i].bytes, nodes[i - 1].bytes);
 	}
 
 	for (uint32_t j = 0; j != ETHASH_CACHE_ROUNDS; j++) {
@@ -81,7 +211,7 @@ bool static ethash_compute_cache_nodes(
 			for (uint32_t w = 0; w != NODE_WORDS; ++w) {
 				data.words[w] ^= nodes[idx].words[w];
 			}
-			SHA3_512(nodes[i].bytes, data.bytes, sizeof(data));
+			SHA3_512_64(nodes[i].bytes, data.bytes);
 		}
 	}
 
@@ -90,7 +220,7 @@ bool static ethash_compute_cache_nodes(
 	return true;
 }
 
-void ethash_calculate_dag_item(
+void ethash_calculate_dag_item_scalar(
 	node* const ret,
 	uint32_t node_index,
 	ethash_light_t const light
@@ -101,52 +231,328 @@ void ethash_calculate_dag_item(
 	node const* init = &cache_nodes[node_index % num_parent_nodes];
 	memcpy(ret, init, sizeof(node));
 	ret->words[0] ^= node_index;
-	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
-	__m128i xmm0 = ret->xmm[0];
-	__m128i xmm1 = ret->xmm[1];
-	__m128i xmm2 = ret->xmm[2];
-	__m128i xmm3 = ret->xmm[3];
-#endif
+	SHA3_512_64(ret->bytes, ret->bytes);
 
 	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
 		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
 		node const *parent = &cache_nodes[parent_index];
 
-#if defined(_M_X64) && ENABLE_SSE
-		{
-			xmm0 = _mm_mullo_epi32(xmm0, fnv_prime);
-			xmm1 = _mm_mullo_epi32(xmm1, fnv_prime);
-			xmm2 = _mm_mullo_epi32(xmm2, fnv_prime);
-			xmm3 = _mm_mullo_epi32(xmm3, fnv_prime);
-			xmm0 = _mm_xor_si128(xmm0, parent->xmm[0]);
-			xmm1 = _mm_xor_si128(xmm1, parent->xmm[1]);
-			xmm2 = _mm_xor_si128(xmm2, parent->xmm[2]);
-			xmm3 = _mm_xor_si128(xmm3, parent->xmm[3]);
-
-			// have to write to ret as values are used to compute index
-			ret->xmm[0] = xmm0;
-			ret->xmm[1] = xmm1;
-			ret->xmm[2] = xmm2;
-			ret->xmm[3] = xmm3;
-		}
-		#else
-		{
-			for (unsigned w = 0; w != NODE_WORDS; ++w) {
-				ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
+		}
+	}
+	SHA3_512_64(ret->bytes, ret->bytes);
+}
+
+void ethash_calculate_dag_item(
+	node* const ret,
+	uint32_t node_index,
+	ethash_light_t const light
+)
+{
+	ethash_kernels()->dag_item(ret, node_index, light);
+}
+
+void ethash_calculate_dag_items(
+	node* const ret,
+	uint32_t begin,
+	uint32_t count,
+	ethash_light_t const light
+)
+{
+	ethash_kernels_t const* kernels = ethash_kernels();
+	uint32_t n = 0;
+	if (count > 1 && ethash_simd_cache_fits(light)) {
+		uint32_t indices[ETHASH_AVX512_LANES];
+		if (kernels->dag_items_x8) {
+			for (; n + ETHASH_AVX512_LANES <= count; n += ETHASH_AVX512_LANES) {
+				for (unsigned k = 0; k != ETHASH_AVX512_LANES; ++k) {
+					indices[k] = begin + n + k;
+				}
+				kernels->dag_items_x8(&ret[n], indices, light);
+			}
+		}
+		if (kernels->dag_items_x4) {
+			for (; n + ETHASH_AVX2_LANES <= count; n += ETHASH_AVX2_LANES) {
+				for (unsigned k = 0; k != ETHASH_AVX2_LANES; ++k) {
+					indices[k] = begin + n + k;
+				}
+				kernels->dag_items_x4(&ret[n], indices, light);
+			}
+			// a partially filled batch still beats computing the leftovers one by one
+			if (count - n > 1) {
+				node tmp[ETHASH_AVX2_LANES];
+				for (unsigned k = 0; k != ETHASH_AVX2_LANES; ++k) {
+					indices[k] = begin + min_u32(n + k, count - 1);
+				}
+				kernels->dag_items_x4(tmp, indices, light);
+				memcpy(&ret[n], tmp, (count - n) * sizeof(node));
+				n = count;
 			}
 		}
-#endif
 	}
-	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
+	for (; n != count; ++n) {
+		kernels->dag_item(&ret[n], begin + n, light);
+	}
+}
+
+// Number of DAG items a worker claims at once. Small enough that the progress
+// callback still sees every percent on tiny test DAGs.
+#define ETHASH_DAG_CHUNK_ITEMS 4096
+
+// Most DAG items between two checkpoints of a resumable generation: 64MB
+#define ETHASH_DAG_CHECKPOINT_ITEMS (1 << 20)
+
+struct ethash_dag_job {
+	node* nodes;                ///< Memory of the items from base on
+	ethash_light_t light;
+	uint32_t base;              ///< Index of the item at nodes[0]
+	uint32_t max_n;             ///< Index past the last item to compute
+	uint32_t chunk;
+	uint32_t first;             ///< Items before this one were there already
+	uint32_t volatile next;     ///< First item not yet claimed by any worker
+	uint32_t volatile done;     ///< Number of items fully computed
+	uint32_t volatile aborted;  ///< Set when the callback asked us to stop
+	uint32_t volatile* chunk_done;  ///< Completion flag of every chunk, when checkpointing
+};
+
+// Claims and computes a single chunk. Returns false if there was nothing left to do
+static bool ethash_dag_job_step(struct ethash_dag_job* job)
+{
+	if (ethash_atomic_load_u32(&job->aborted)) {
+		return false;
+	}
+	uint32_t const begin = ethash_atomic_add_u32(&job->next, job->chunk);
+	if (begin >= job->max_n) {
+		return false;
+	}
+	uint32_t const end = min_u32(begin + job->chunk, job->max_n);
+	ethash_calculate_dag_items(&job->nodes[begin - job->base], begin, end - begin, job->light);
+	if (job->chunk_done) {
+		ethash_atomic_store_u32(&job->chunk_done[(begin - job->first) / job->chunk], 1);
+	}
+	ethash_atomic_add_u32(&job->done, end - begin);
+	return true;
+}
+
+static void* ethash_dag_worker(void* arg)
+{
+	struct ethash_dag_job* job = (struct ethash_dag_job*)arg;
+	while (ethash_dag_job_step(job)) {}
+	return NULL;
+}
+
+/// A DAG job that keeps running in the background while the DAG is in use
+struct ethash_dag_lazy {
+	struct ethash_dag_job job;
+	ethash_mutex_t join_lock;   ///< Held while joining, guards num_fillers
+	ethash_thread_t* fillers;
+	unsigned num_fillers;       ///< Fillers not joined yet
+};
+
+static bool ethash_dag_lazy_complete(struct ethash_dag_lazy const* lazy)
+{
+	// done is only bumped after the chunk flag and the items are stored
+	return ethash_atomic_load_u32(&lazy->job.done) == lazy->job.max_n;
+}
+
+static void ethash_dag_lazy_wait(struct ethash_dag_lazy* lazy)
+{
+	// the first waiter joins the fillers, any other one waits for it here
+	ethash_mutex_lock(lazy->join_lock);
+	for (unsigned i = 0; i != lazy->num_fillers; ++i) {
+		ethash_thread_join(lazy->fillers[i]);
+	}
+	lazy->num_fillers = 0;
+	ethash_mutex_unlock(lazy->join_lock);
+}
+
+static void ethash_dag_lazy_delete(struct ethash_dag_lazy* lazy)
+{
+	ethash_atomic_store_u32(&lazy->job.aborted, 1);
+	if (lazy->join_lock) {
+		ethash_dag_lazy_wait(lazy);
+		ethash_mutex_delete(lazy->join_lock);
+	}
+	free(lazy->fillers);
+	free((void*)lazy->job.chunk_done);
+	free(lazy);
+}
+
+static struct ethash_dag_lazy* ethash_dag_lazy_start(
+	node* nodes,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads
+)
+{
+	struct ethash_dag_lazy* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	ret->job.nodes = nodes;
+	ret->job.light = light;
+	ret->job.max_n = (uint32_t)(full_size / sizeof(node));
+	// whole pages per chunk so a page is either built or not
+	ret->job.chunk = clamp_u32(ret->job.max_n / 100, MIX_NODES, ETHASH_DAG_CHUNK_ITEMS) / MIX_NODES * MIX_NODES;
+	uint32_t const num_chunks = (ret->job.max_n + ret->job.chunk - 1) / ret->job.chunk;
+	ret->job.chunk_done = calloc(num_chunks, sizeof(uint32_t));
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	num_threads = clamp_u32(num_threads, 1, num_chunks);
+	ret->fillers = malloc(sizeof(ethash_thread_t) * num_threads);
+	ret->join_lock = ethash_mutex_new();
+	if (!ret->job.chunk_done || !ret->fillers || !ret->join_lock) {
+		goto fail_free_lazy;
+	}
+	for (; ret->num_fillers != num_threads; ++ret->num_fillers) {
+		if (!ethash_thread_create(&ret->fillers[ret->num_fillers], ethash_dag_worker, &ret->job)) {
+			break;
+		}
+	}
+	if (ret->num_fillers == 0) {
+		ETHASH_CRITICAL("Could not start any DAG filler thread");
+		goto fail_free_lazy;
+	}
+	return ret;
+
+fail_free_lazy:
+	ethash_dag_lazy_delete(ret);
+	return NULL;
 }
 
 bool ethash_compute_full_data(
 	void* mem,
 	uint64_t full_size,
 	ethash_light_t const light,
-	ethash_callback_t callback
+	ethash_callback_t callback,
+	unsigned num_threads
+)
+{
+	return ethash_compute_full_data_resumable(mem, full_size, light, callback, num_threads, 0, NULL, NULL);
+}
+
+/**
+ * Compute the items [first, end) into @a nodes, which holds the items from
+ * @a base on. Progress is reported over [base, end), so a resumed generation
+ * starts from where it was.
+ */
+static bool ethash_compute_items(
+	node* nodes,
+	uint32_t base,
+	uint32_t first,
+	uint32_t end,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	unsigned num_threads,
+	ethash_dag_checkpoint_t checkpoint,
+	void* context
+)
+{
+	struct ethash_dag_job job;
+	uint32_t const total = end - base;
+	job.nodes = nodes;
+	job.light = light;
+	job.base = base;
+	job.max_n = end;
+	job.chunk = clamp_u32(total / 100, 1, ETHASH_DAG_CHUNK_ITEMS);
+	job.first = first;
+	job.next = job.first;
+	job.done = job.first;
+	job.aborted = 0;
+	job.chunk_done = NULL;
+	if (total == 0) {
+		return !callback || callback(100) == 0;
+	}
+
+	uint32_t const num_chunks = (job.max_n - job.first + job.chunk - 1) / job.chunk;
+	uint32_t const checkpoint_items = clamp_u32(total / 20, job.chunk, ETHASH_DAG_CHECKPOINT_ITEMS);
+	uint32_t watermark_chunk = 0;
+	uint32_t last_checkpoint = job.first;
+	if (checkpoint && num_chunks) {
+		job.chunk_done = calloc(num_chunks, sizeof(uint32_t));
+		if (!job.chunk_done) {
+			return false;
+		}
+	}
+
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	num_threads = clamp_u32(num_threads, 1, total / job.chunk + 1);
+
+	unsigned last_progress = (unsigned)((uint64_t)(job.first - base) * 100 / total);
+	if (callback && callback(last_progress) != 0) {
+		free((void*)job.chunk_done);
+		return false;
+	}
+	// The calling thread is worker 0. It is also the only one that invokes the
+	// callback, so callbacks never run concurrently and progress is monotonic.
+	ethash_thread_t* workers = NULL;
+	unsigned num_workers = 0;
+	if (num_threads > 1) {
+		workers = malloc(sizeof(ethash_thread_t) * (num_threads - 1));
+		if (!workers) {
+			free((void*)job.chunk_done);
+			return false;
+		}
+		for (; num_workers != num_threads - 1; ++num_workers) {
+			if (!ethash_thread_create(&workers[num_workers], ethash_dag_worker, &job)) {
+				// carry on with the threads we managed to get
+				break;
+			}
+		}
+	}
+
+	while (ethash_dag_job_step(&job)) {
+		if (job.chunk_done) {
+			// items are only known to be there up to the first unfinished chunk
+			while (watermark_chunk != num_chunks &&
+				ethash_atomic_load_u32(&job.chunk_done[watermark_chunk])) {
+				++watermark_chunk;
+			}
+			uint32_t const watermark = min_u32(job.first + watermark_chunk * job.chunk, job.max_n);
+			if (watermark - last_checkpoint >= checkpoint_items && watermark != job.max_n) {
+				last_checkpoint = watermark;
+				if (!checkpoint(context, watermark)) {
+					ethash_atomic_store_u32(&job.aborted, 1);
+				}
+			}
+		}
+		if (!callback) {
+			continue;
+		}
+		unsigned const progress =
+			(unsigned)((uint64_t)(ethash_atomic_load_u32(&job.done) - base) * 100 / total);
+		if (progress != last_progress && progress != 100) {
+			last_progress = progress;
+			if (callback(progress) != 0) {
+				ethash_atomic_store_u32(&job.aborted, 1);
+			}
+		}
+	}
+	for (unsigned i = 0; i != num_workers; ++i) {
+		ethash_thread_join(workers[i]);
+	}
+	free(workers);
+	free((void*)job.chunk_done);
+
+	if (job.aborted) {
+		return false;
+	}
+	return !callback || callback(100) == 0;
+}
+
+bool ethash_compute_full_data_resumable(
+	void* mem,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	unsigned num_threads,
+	uint32_t first_item,
+	ethash_dag_checkpoint_t checkpoint,
+	void* context
 )
 {
 	if (full_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
@@ -154,104 +560,198 @@ bool ethash_compute_full_data(
 		return false;
 	}
 	uint32_t const max_n = (uint32_t)(full_size / sizeof(node));
-	node* full_nodes = mem;
-	double const progress_change = 1.0f / max_n;
-	double progress = 0.0f;
-	// now compute full nodes
-	for (uint32_t n = 0; n != max_n; ++n) {
-		if (callback &&
-			n % (max_n / 100) == 0 &&
-			callback((unsigned int)(ceil(progress * 100.0f))) != 0) {
+	return ethash_compute_items(
+		(node*)mem,
+		0,
+		min_u32(first_item, max_n),
+		max_n,
+		light,
+		callback,
+		num_threads,
+		checkpoint,
+		context
+	);
+}
 
-			return false;
-		}
-		progress += progress_change;
-		ethash_calculate_dag_item(&(full_nodes[n]), n, light);
+bool ethash_compute_dag_range(
+	ethash_light_t light,
+	uint32_t begin,
+	uint32_t end,
+	void* mem,
+	unsigned threads,
+	ethash_callback_t callback
+)
+{
+	if (begin > end) {
+		return false;
 	}
-	return true;
+	return ethash_compute_items((node*)mem, begin, begin, end, light, callback, threads, NULL, NULL);
 }
 
-static bool ethash_hash(
-	ethash_return_value_t* ret,
+void ethash_hashimoto_mix_scalar(
+	node* mix,
+	uint32_t seed,
 	node const* full_nodes,
 	ethash_light_t const light,
-	uint64_t full_size,
-	ethash_h256_t const header_hash,
-	uint64_t const nonce
+	uint32_t num_full_pages
 )
 {
-	if (full_size % MIX_WORDS != 0) {
-		return false;
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		uint32_t const index = fnv_hash(seed ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
+		node tmp_nodes[MIX_NODES];
+		node const* dag_nodes = ethash_hashimoto_page(tmp_nodes, index, full_nodes, light);
+
+		for (unsigned n = 0; n != MIX_NODES; ++n) {
+			for (unsigned w = 0; w != NODE_WORDS; ++w) {
+				mix[n].words[w] = fnv_hash(mix[n].words[w], dag_nodes[n].words[w]);
+			}
+		}
 	}
+}
 
+// Seed a hash: s_mix[0] becomes Keccak-512 of header hash and nonce, and the
+// MIX_NODES nodes after it the initial mix
+static void ethash_hash_begin(
+	node* s_mix,
+	ethash_h256_t const* header_hash,
+	uint64_t const nonce
+)
+{
 	// pack hash and nonce together into first 40 bytes of s_mix
 	assert(sizeof(node) * 8 == 512);
-	node s_mix[MIX_NODES + 1];
-	memcpy(s_mix[0].bytes, &header_hash, 32);
+	memcpy(s_mix[0].bytes, header_hash, 32);
 	fix_endian64(s_mix[0].double_words[4], nonce);
 
 	// compute sha3-512 hash and replicate across mix
-	SHA3_512(s_mix->bytes, s_mix->bytes, 40);
+	SHA3_512_40(s_mix->bytes, s_mix->bytes);
 	fix_endian_arr32(s_mix[0].words, 16);
 
 	node* const mix = s_mix + 1;
 	for (uint32_t w = 0; w != MIX_WORDS; ++w) {
-		mix->words[w] = s_mix[0].words[w % NODE_WORDS];
+		mix[w / NODE_WORDS].words[w % NODE_WORDS] = s_mix[0].words[w % NODE_WORDS];
+	}
+}
+
+// Compress the mix of s_mix and compute the final hash
+static void ethash_hash_end(ethash_return_value_t* ret, node* s_mix)
+{
+	node* const mix = s_mix + 1;
+	// compress mix. The MIX_NODES nodes are indexed one by one, as the words
+	// of a single node don't reach past it. The compressed words fit in mix[0].
+	for (uint32_t w = 0; w != MIX_WORDS; w += 4) {
+		uint32_t const* const words = &mix[w / NODE_WORDS].words[w % NODE_WORDS];
+		uint32_t reduction = words[0];
+		reduction = reduction * FNV_PRIME ^ words[1];
+		reduction = reduction * FNV_PRIME ^ words[2];
+		reduction = reduction * FNV_PRIME ^ words[3];
+		mix->words[w / 4] = reduction;
 	}
 
+	fix_endian_arr32(mix->words, MIX_WORDS / 4);
+	memcpy(&ret->mix_hash, mix->bytes, 32);
+	// final Keccak hash
+	SHA3_256_96(&ret->result, s_mix->bytes); // Keccak-256(s + compressed_mix)
+}
+
+static bool ethash_hash(
+	ethash_return_value_t* ret,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t const nonce
+)
+{
+	if (full_size % MIX_WORDS != 0) {
+		return false;
+	}
+
+	node s_mix[MIX_NODES + 1];
+	ethash_hash_begin(s_mix, &header_hash, nonce);
+
 	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
 	unsigned const num_full_pages = (unsigned) (full_size / page_size);
+	ethash_kernels()->hashimoto_mix(s_mix + 1, s_mix->words[0], full_nodes, light, num_full_pages);
 
+	ethash_hash_end(ret, s_mix);
+	return true;
+}
+
+// Hashimoto on a DAG that is still being built. Pages whose chunk isn't there
+// yet are calculated from the cache, like the light client does.
+static void ethash_hashimoto_mix_lazy(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	struct ethash_dag_lazy const* lazy,
+	uint32_t num_full_pages
+)
+{
 	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
-		uint32_t const index = fnv_hash(s_mix->words[0] ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
+		uint32_t const index = fnv_hash(seed ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
+		uint32_t const item = index * MIX_NODES;
+		node tmp_nodes[MIX_NODES];
+		node const* dag_nodes = &full_nodes[item];
+		if (!ethash_atomic_load_u32(&lazy->job.chunk_done[item / lazy->job.chunk])) {
+			ethash_calculate_dag_items(tmp_nodes, item, MIX_NODES, lazy->job.light);
+			dag_nodes = tmp_nodes;
+		}
 
 		for (unsigned n = 0; n != MIX_NODES; ++n) {
-			node const* dag_node;
-			if (full_nodes) {
-				dag_node = &full_nodes[MIX_NODES * index + n];
-			} else {
-				node tmp_node;
-				ethash_calculate_dag_item(&tmp_node, index * MIX_NODES + n, light);
-				dag_node = &tmp_node;
-			}
-
-#if defined(_M_X64) && ENABLE_SSE
-			{
-				__m128i fnv_prime = _mm_set1_epi32(FNV_PRIME);
-				__m128i xmm0 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[0]);
-				__m128i xmm1 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[1]);
-				__m128i xmm2 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[2]);
-				__m128i xmm3 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[3]);
-				mix[n].xmm[0] = _mm_xor_si128(xmm0, dag_node->xmm[0]);
-				mix[n].xmm[1] = _mm_xor_si128(xmm1, dag_node->xmm[1]);
-				mix[n].xmm[2] = _mm_xor_si128(xmm2, dag_node->xmm[2]);
-				mix[n].xmm[3] = _mm_xor_si128(xmm3, dag_node->xmm[3]);
-			}
-			#else
-			{
-				for (unsigned w = 0; w != NODE_WORDS; ++w) {
-					mix[n].words[w] = fnv_hash(mix[n].words[w], dag_node->words[w]);
-				}
+			for (unsigned w = 0; w != NODE_WORDS; ++w) {
+				mix[n].words[w] = fnv_hash(mix[n].words[w], dag_nodes[n].words[w]);
 			}
-#endif
 		}
-
 	}
+}
 
-	// compress mix
-	for (uint32_t w = 0; w != MIX_WORDS; w += 4) {
-		uint32_t reduction = mix->words[w + 0];
-		reduction = reduction * FNV_PRIME ^ mix->words[w + 1];
-		reduction = reduction * FNV_PRIME ^ mix->words[w + 2];
-		reduction = reduction * FNV_PRIME ^ mix->words[w + 3];
-		mix->words[w / 4] = reduction;
+static void ethash_hash_lazy(
+	ethash_return_value_t* ret,
+	struct ethash_full const* full,
+	ethash_h256_t const header_hash,
+	uint64_t const nonce
+)
+{
+	node s_mix[MIX_NODES + 1];
+	ethash_hash_begin(s_mix, &header_hash, nonce);
+	uint32_t const num_full_pages = (uint32_t) (full->file_size / ETHASH_MIX_BYTES);
+	ethash_hashimoto_mix_lazy(s_mix + 1, s_mix->words[0], full->data, full->lazy, num_full_pages);
+	ret->success = true;
+	ethash_hash_end(ret, s_mix);
+}
+
+void ethash_hashimoto_lanes_scalar(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+)
+{
+	ethash_hashimoto_lanes(s_mix, full_nodes, num_full_pages, lanes);
+}
+
+void ethash_hash_full_lanes(
+	ethash_return_value_t* ret,
+	node const* full_nodes,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	unsigned lanes
+)
+{
+	node s_mix[ETHASH_HASH_LANES_MAX][MIX_NODES + 1];
+	uint32_t const num_full_pages = (uint32_t) (full_size / ETHASH_MIX_BYTES);
+	assert(lanes > 0 && lanes <= ETHASH_HASH_LANES_MAX);
+
+	for (unsigned l = 0; l != lanes; ++l) {
+		ethash_hash_begin(s_mix[l], &header_hash, start_nonce + l);
 	}
+	ethash_kernels()->hashimoto_lanes(s_mix, full_nodes, num_full_pages, lanes);
 
-	fix_endian_arr32(mix->words, MIX_WORDS / 4);
-	memcpy(&ret->mix_hash, mix->bytes, 32);
-	// final Keccak hash
-	SHA3_256(&ret->result, s_mix->bytes, 64 + 32); // Keccak-256(s + compressed_mix)
-	return true;
+	for (unsigned l = 0; l != lanes; ++l) {
+		ret[l].success = true;
+		ethash_hash_end(&ret[l], s_mix[l]);
+	}
 }
 
 void ethash_quick_hash(
@@ -265,72 +765,223 @@ void ethash_quick_hash(
 	memcpy(buf, header_hash, 32);
 	fix_endian64_same(nonce);
 	memcpy(&(buf[32]), &nonce, 8);
-	SHA3_512(buf, buf, 40);
+	SHA3_512_40(buf, buf);
 	memcpy(&(buf[64]), mix_hash, 32);
-	SHA3_256(return_hash, buf, 64 + 32);
+	SHA3_256_96(return_hash, buf);
+}
+
+// Seedhashes of the epochs with tabulated sizes, chained once on first use
+#define ETHASH_SEEDHASH_EPOCHS ETHASH_TABULATED_EPOCHS
+// Open addressing from the first word of a seedhash to its epoch plus one
+#define ETHASH_SEEDHASH_SLOTS (2 * ETHASH_SEEDHASH_EPOCHS)
+static ethash_h256_t ethash_seedhashes[ETHASH_SEEDHASH_EPOCHS];
+static uint16_t ethash_seedhash_slots[ETHASH_SEEDHASH_SLOTS];
+static ethash_once_t ethash_seedhashes_once = ETHASH_ONCE_INIT;
+
+static uint32_t ethash_seedhash_slot(ethash_h256_t const* seedhash)
+{
+	uint64_t word;
+	memcpy(&word, seedhash, sizeof(word));
+	return (uint32_t)word & (ETHASH_SEEDHASH_SLOTS - 1);
+}
+
+static void ethash_seedhashes_init(void)
+{
+	ethash_h256_reset(&ethash_seedhashes[0]);
+	for (uint32_t i = 1; i < ETHASH_SEEDHASH_EPOCHS; ++i) {
+		ethash_seedhashes[i] = ethash_seedhashes[i - 1];
+		SHA3_256_32(&ethash_seedhashes[i], (uint8_t*)&ethash_seedhashes[i]);
+	}
+	for (uint32_t i = 0; i < ETHASH_SEEDHASH_EPOCHS; ++i) {
+		uint32_t slot = ethash_seedhash_slot(&ethash_seedhashes[i]);
+		while (ethash_seedhash_slots[slot]) {
+			slot = (slot + 1) & (ETHASH_SEEDHASH_SLOTS - 1);
+		}
+		ethash_seedhash_slots[slot] = (uint16_t)(i + 1);
+	}
 }
 
 ethash_h256_t ethash_get_seedhash(uint64_t block_number)
 {
-	ethash_h256_t ret;
-	ethash_h256_reset(&ret);
+	ethash_call_once(&ethash_seedhashes_once, ethash_seedhashes_init);
 	uint64_t const epochs = block_number / ETHASH_EPOCH_LENGTH;
-	for (uint32_t i = 0; i < epochs; ++i)
-		SHA3_256(&ret, (uint8_t*)&ret, 32);
+	if (epochs < ETHASH_SEEDHASH_EPOCHS) {
+		return ethash_seedhashes[epochs];
+	}
+	ethash_h256_t ret = ethash_seedhashes[ETHASH_SEEDHASH_EPOCHS - 1];
+	for (uint64_t i = ETHASH_SEEDHASH_EPOCHS - 1; i < epochs; ++i)
+		SHA3_256_32(&ret, (uint8_t*)&ret);
+	return ret;
+}
+
+bool ethash_get_epoch(ethash_h256_t const seedhash, uint64_t* epoch)
+{
+	ethash_call_once(&ethash_seedhashes_once, ethash_seedhashes_init);
+	uint32_t slot = ethash_seedhash_slot(&seedhash);
+	for (; ethash_seedhash_slots[slot]; slot = (slot + 1) & (ETHASH_SEEDHASH_SLOTS - 1)) {
+		uint32_t const i = ethash_seedhash_slots[slot] - 1;
+		if (memcmp(&ethash_seedhashes[i], &seedhash, sizeof(seedhash)) == 0) {
+			*epoch = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ethash_quick_check_difficulty(
+	ethash_h256_t const* header_hash,
+	uint64_t const nonce,
+	ethash_h256_t const* mix_hash,
+	ethash_h256_t const* boundary
+)
+{
+
+	ethash_h256_t return_hash;
+	ethash_quick_hash(&return_hash, header_hash, nonce, mix_hash);
+	return ethash_check_difficulty(&return_hash, boundary);
+}
+
+ethash_light_t ethash_light_new_internal(uint64_t cache_size, ethash_h256_t const* seed)
+{
+	return ethash_light_new_internal_with_params(cache_size, seed, NULL);
+}
+
+static void ethash_allocator_put(ethash_allocator_t const* allocator, void* p, uint64_t size)
+{
+	if (allocator->free) {
+		allocator->free(p, (size_t)size, allocator->context);
+	}
+}
+
+/**
+ * Get memory from a caller's allocator, making sure it is aligned as promised
+ */
+static void* ethash_allocator_get(ethash_allocator_t const* allocator, uint64_t size, size_t alignment)
+{
+	void* ret = allocator->alloc((size_t)size, alignment, allocator->context);
+	if (ret && ((uintptr_t)ret & (alignment - 1)) != 0) {
+		ETHASH_CRITICAL("Allocator returned memory that is not %u byte aligned", (unsigned)alignment);
+		ethash_allocator_put(allocator, ret, size);
+		return NULL;
+	}
 	return ret;
 }
 
-bool ethash_quick_check_difficulty(
-	ethash_h256_t const* header_hash,
-	uint64_t const nonce,
-	ethash_h256_t const* mix_hash,
-	ethash_h256_t const* boundary
-)
+static void ethash_light_free_cache(struct ethash_light* light)
 {
-
-	ethash_h256_t return_hash;
-	ethash_quick_hash(&return_hash, header_hash, nonce, mix_hash);
-	return ethash_check_difficulty(&return_hash, boundary);
+	if (light->shared) {
+		ethash_shm_unmap_cache(light->cache, light->cache_size);
+	} else if (light->mapped) {
+		ethash_io_unmap_cache(light->cache, light->cache_size);
+	} else if (light->allocator.alloc) {
+		ethash_allocator_put(&light->allocator, light->cache, light->cache_size);
+	} else if (light->pages == ETHASH_PAGES_NORMAL) {
+		ethash_aligned_free(light->cache);
+	} else {
+		ethash_pages_free(light->cache, (size_t)light->cache_size, light->pages);
+	}
 }
 
-ethash_light_t ethash_light_new_internal(uint64_t cache_size, ethash_h256_t const* seed)
+ethash_light_t ethash_light_new_internal_with_params(
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	ethash_light_params_t const* params
+)
 {
 	struct ethash_light *ret;
+	char strbuf[256];
+	char const* dirname = NULL;
 	ret = calloc(sizeof(*ret), 1);
 	if (!ret) {
 		return NULL;
 	}
-	ret->cache = malloc((size_t)cache_size);
+	ret->cache_size = cache_size;
+	if (params && params->persist) {
+		dirname = params->dirname;
+		if (!dirname && ethash_get_default_dirname(strbuf, 256)) {
+			dirname = strbuf;
+		}
+	}
+	if (params && params->shared) {
+		ret->cache = ethash_shm_map_cache(seed, cache_size, dirname);
+		if (ret->cache) {
+			ret->shared = true;
+			return ret;
+		}
+	}
+	bool const huge = params && params->pages != ETHASH_PAGES_NORMAL;
+	// memory of the caller's choice gets a copy of the file rather than its mapping
+	bool const own = huge || (params && params->allocator);
+	if (dirname && !own) {
+		ret->cache = ethash_io_map_cache(dirname, *seed, cache_size);
+		if (ret->cache) {
+			ret->mapped = true;
+			return ret;
+		}
+	}
+	if (params && params->allocator) {
+		ret->allocator = *params->allocator;
+		ret->cache = ethash_allocator_get(&ret->allocator, cache_size, ETHASH_CACHE_ALIGNMENT);
+	} else if (huge) {
+		ret->cache = ethash_pages_alloc((size_t)cache_size, params->pages, &ret->pages);
+	} else {
+		ret->cache = ethash_aligned_alloc((size_t)cache_size, ETHASH_CACHE_ALIGNMENT);
+	}
 	if (!ret->cache) {
 		goto fail_free_light;
 	}
+	if (dirname && own && ethash_io_read_cache(dirname, *seed, ret->cache, cache_size)) {
+		return ret;
+	}
 	node* nodes = (node*)ret->cache;
 	if (!ethash_compute_cache_nodes(nodes, cache_size, seed)) {
 		goto fail_free_cache_mem;
 	}
-	ret->cache_size = cache_size;
+	if (dirname) {
+		// the cache is valid either way, the next start just computes it again
+		ethash_io_write_cache(dirname, *seed, ret->cache, cache_size);
+	}
 	return ret;
 
 fail_free_cache_mem:
-	free(ret->cache);
+	ethash_light_free_cache(ret);
 fail_free_light:
 	free(ret);
 	return NULL;
 }
 
 ethash_light_t ethash_light_new(uint64_t block_number)
+{
+	return ethash_light_new_with_params(block_number, NULL);
+}
+
+ethash_light_t ethash_light_new_with_params(uint64_t block_number, ethash_light_params_t const* params)
 {
 	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
 	ethash_light_t ret;
-	ret = ethash_light_new_internal(ethash_get_cachesize(block_number), &seedhash);
+	ret = ethash_light_new_internal_with_params(ethash_get_cachesize(block_number), &seedhash, params);
+	if (!ret) {
+		return NULL;
+	}
 	ret->block_number = block_number;
 	return ret;
 }
 
+bool ethash_light_remove_shared(uint64_t block_number)
+{
+	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
+	return ethash_shm_remove_cache(&seedhash);
+}
+
+ethash_pages_t ethash_light_pages(ethash_light_t light)
+{
+	return light->pages;
+}
+
 void ethash_light_delete(ethash_light_t light)
 {
 	if (light->cache) {
-		free(light->cache);
+		ethash_light_free_cache(light);
 	}
 	free(light);
 }
@@ -371,7 +1022,7 @@ static bool ethash_mmap(struct ethash_full* ret, FILE* f)
 	}
 	mmapped_data= mmap(
 		NULL,
-		(size_t)ret->file_size + ETHASH_DAG_MAGIC_NUM_SIZE,
+		(size_t)ret->file_size + ETHASH_DAG_HEADER_SIZE,
 		PROT_READ | PROT_WRITE,
 		MAP_SHARED,
 		fd,
@@ -380,10 +1031,121 @@ static bool ethash_mmap(struct ethash_full* ret, FILE* f)
 	if (mmapped_data == MAP_FAILED) {
 		return false;
 	}
-	ret->data = (node*)(mmapped_data + ETHASH_DAG_MAGIC_NUM_SIZE);
+	ret->data = (node*)(mmapped_data + ETHASH_DAG_HEADER_SIZE);
+	return true;
+}
+
+/**
+ * Place the DAG pages on the NUMA nodes. Pages already in memory are migrated,
+ * but this is cheapest before the DAG is generated or read.
+ */
+static void ethash_full_place(struct ethash_full* ret)
+{
+	if (ret->numa == ETHASH_NUMA_NONE || ethash_numa_nodes() < 2) {
+		return;
+	}
+	char* base = (char*)ret->data;
+	size_t size = (size_t)ret->file_size;
+	if (ret->file_mapped) {
+		base -= ETHASH_DAG_HEADER_SIZE;
+		size += ETHASH_DAG_HEADER_SIZE;
+	}
+	// placement is best effort, the DAG works wherever it is
+	if (ret->numa == ETHASH_NUMA_INTERLEAVE) {
+		ethash_numa_interleave(base, size, ethash_numa_online());
+	} else {
+		// the original serves the first node, the other nodes get copies
+		ethash_numa_bind_memory(base, size, ethash_numa_node_id(0));
+	}
+}
+
+/**
+ * Get memory for the DAG that is not backed by its file, from the caller's
+ * allocator if there is one
+ */
+static bool ethash_full_alloc(struct ethash_full* ret, ethash_full_params_t const* params)
+{
+	if (params->allocator) {
+		ret->allocator = *params->allocator;
+		ret->data = ethash_allocator_get(&ret->allocator, ret->file_size, ETHASH_DAG_ALIGNMENT);
+	} else {
+		ret->data = ethash_pages_alloc((size_t)ret->file_size, params->pages, &ret->pages);
+	}
+	if (!ret->data) {
+		return false;
+	}
+	ethash_full_place(ret);
 	return true;
 }
 
+/**
+ * Get memory for the DAG: a shared mapping of its file or, with @a anonymous,
+ * memory whose contents are read from or written to the file in one go
+ */
+static bool ethash_full_map(struct ethash_full* ret, FILE* f, ethash_full_params_t const* params, bool anonymous)
+{
+	if (!anonymous) {
+		ret->pages = ETHASH_PAGES_NORMAL;
+		if (!ethash_mmap(ret, f)) {
+			return false;
+		}
+		ret->file_mapped = true;
+		ethash_full_place(ret);
+		return true;
+	}
+	ret->file = f;
+	return ethash_full_alloc(ret, params);
+}
+
+/**
+ * Copy the finished DAG to every NUMA node but the first. A node whose copy
+ * can't be allocated falls back to the original.
+ */
+static void ethash_full_replicate(struct ethash_full* ret, ethash_pages_t pages)
+{
+	unsigned const nodes = ethash_numa_nodes();
+	if (ret->numa != ETHASH_NUMA_REPLICATE || nodes < 2) {
+		return;
+	}
+	size_t const size = (size_t)ret->file_size;
+	ret->replicas[ethash_numa_node_id(0)] = ret->data;
+	ret->num_replicas = 1;
+	for (unsigned i = 1; i != nodes; ++i) {
+		unsigned const id = ethash_numa_node_id(i);
+		ethash_pages_t got;
+		node* copy = ethash_pages_alloc(size, pages, &got);
+		if (!copy) {
+			break;
+		}
+		// bound before the first touch so no page has to move
+		ethash_numa_bind_memory(copy, size, id);
+		memcpy(copy, ret->data, size);
+		ret->replicas[id] = copy;
+		ret->replica_pages[id] = got;
+		++ret->num_replicas;
+	}
+}
+
+static void ethash_full_unmap(struct ethash_full* full)
+{
+	for (unsigned id = 0; id != ETHASH_NUMA_MAX_NODES; ++id) {
+		if (full->replicas[id] && full->replicas[id] != full->data) {
+			ethash_pages_free(full->replicas[id], (size_t)full->file_size, full->replica_pages[id]);
+		}
+	}
+	if (full->file_mapped) {
+		// could check that munmap(..) == 0 but even if it did not can't really do anything here
+		munmap(
+			(char*)full->data - ETHASH_DAG_HEADER_SIZE,
+			(size_t)full->file_size + ETHASH_DAG_HEADER_SIZE
+		);
+	} else if (full->allocator.alloc) {
+		ethash_allocator_put(&full->allocator, full->data, full->file_size);
+	} else {
+		ethash_pages_free(full->data, (size_t)full->file_size, full->pages);
+	}
+}
+
 ethash_full_t ethash_full_new_internal(
 	char const* dirname,
 	ethash_h256_t const seed_hash,
@@ -392,23 +1154,108 @@ ethash_full_t ethash_full_new_internal(
 	ethash_callback_t callback
 )
 {
+	return ethash_full_new_internal_with_params(dirname, seed_hash, full_size, light, callback, NULL);
+}
+
+/// Progress of a DAG being generated for its file
+struct ethash_full_progress {
+	struct ethash_full* full;
+	uint32_t saved;       ///< Leading DAG items that are in the file
+	bool direct;
+	uint64_t rate;
+};
+
+static bool ethash_full_checkpoint(void* context, uint32_t items)
+{
+	struct ethash_full_progress* progress = (struct ethash_full_progress*)context;
+	struct ethash_full* full = progress->full;
+	// the items have to be on disk before the watermark that vouches for them
+	if (full->file_mapped) {
+		if (msync(full->data, (size_t)items * sizeof(node), MS_SYNC) != 0) {
+			return false;
+		}
+	} else if (!ethash_io_write_dag(
+		full->file,
+		full->data,
+		full->file_size,
+		(uint64_t)progress->saved * sizeof(node),
+		(uint64_t)items * sizeof(node),
+		progress->direct,
+		progress->rate
+	)) {
+		return false;
+	}
+	progress->saved = items;
+	return ethash_io_sync(full->file) && ethash_io_write_watermark(full->file, items);
+}
+
+static void ethash_full_init(struct ethash_full* ret, uint64_t full_size, ethash_full_params_t const* params)
+{
+	ret->file_size = (size_t)full_size;
+	ret->search_lanes = params->search_lanes ?
+		min_u32(params->search_lanes, ETHASH_HASH_LANES_MAX) :
+		ETHASH_HASH_LANES_DEFAULT;
+	// the caller's memory is where the caller put it
+	ret->numa = params->allocator ? ETHASH_NUMA_NONE : params->numa;
+}
+
+ethash_full_t ethash_full_new_internal_with_params(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+)
+{
+	ethash_full_params_t const default_params = { 0 };
+	if (!params) {
+		params = &default_params;
+	}
 	struct ethash_full* ret;
 	FILE *f = NULL;
+	uint32_t resume = 0;
+	// Huge pages and the caller's memory can't back a file on a regular filesystem
+	bool const anonymous = params->pages != ETHASH_PAGES_NORMAL || params->allocator;
+	bool const anonymous_new = anonymous || params->dag_io != ETHASH_DAG_IO_MMAP;
 	ret = calloc(sizeof(*ret), 1);
 	if (!ret) {
 		return NULL;
 	}
-	ret->file_size = (size_t)full_size;
+	ethash_full_init(ret, full_size, params);
 	switch (ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, false)) {
 	case ETHASH_IO_FAIL:
 		// ethash_io_prepare will do all ETHASH_CRITICAL() logging in fail case
 		goto fail_free_full;
 	case ETHASH_IO_MEMO_MATCH:
-		if (!ethash_mmap(ret, f)) {
+		if (!ethash_full_map(ret, f, params, anonymous)) {
 			ETHASH_CRITICAL("mmap failure()");
 			goto fail_close_file;
 		}
+		if (!ret->file_mapped) {
+			if (fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET) != 0 ||
+				fread(ret->data, 1, (size_t)full_size, f) != (size_t)full_size) {
+				ETHASH_CRITICAL("Could not read DAG data from file.");
+				goto fail_free_full_data;
+			}
+		}
+		ethash_full_replicate(ret, params->pages);
 		return ret;
+	case ETHASH_IO_MEMO_PARTIAL:
+		// an interrupted generation, carry on from its last checkpoint
+		if (!ethash_io_read_watermark(f, &resume) || resume > full_size / sizeof(node)) {
+			resume = 0;
+		}
+		if (!ethash_full_map(ret, f, params, anonymous_new)) {
+			ETHASH_CRITICAL("mmap failure()");
+			goto fail_close_file;
+		}
+		if (resume && !ret->file_mapped && (
+			fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET) != 0 ||
+			fread(ret->data, sizeof(node), resume, f) != resume)) {
+			resume = 0;
+		}
+		break;
 	case ETHASH_IO_MEMO_SIZE_MISMATCH:
 		// if a DAG of same filename but unexpected size is found, silently force new file creation
 		if (ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, true) != ETHASH_IO_MEMO_MISMATCH) {
@@ -417,37 +1264,56 @@ ethash_full_t ethash_full_new_internal(
 		}
 		// fallthrough to the mismatch case here, DO NOT go through match
 	case ETHASH_IO_MEMO_MISMATCH:
-		if (!ethash_mmap(ret, f)) {
+		if (!ethash_full_map(ret, f, params, anonymous_new)) {
 			ETHASH_CRITICAL("mmap failure()");
 			goto fail_close_file;
 		}
 		break;
 	}
 
-	if (!ethash_compute_full_data(ret->data, full_size, light, callback)) {
+	// Checkpoints let a generation that gets interrupted continue from where it was
+	struct ethash_full_progress progress;
+	progress.full = ret;
+	progress.saved = resume;
+	progress.direct = params->dag_io == ETHASH_DAG_IO_DIRECT;
+	progress.rate = params->dag_io_rate;
+	if (!ethash_compute_full_data_resumable(
+		ret->data,
+		full_size,
+		light,
+		callback,
+		params->threads,
+		resume,
+		ethash_full_checkpoint,
+		&progress
+	)) {
 		ETHASH_CRITICAL("Failure at computing DAG data.");
 		goto fail_free_full_data;
 	}
 
-	// after the DAG has been filled then we finalize it by writting the magic number at the beginning
-	if (fseek(f, 0, SEEK_SET) != 0) {
-		ETHASH_CRITICAL("Could not seek to DAG file start to write magic number.");
-		goto fail_free_full_data;
-	}
-	uint64_t const magic_num = ETHASH_DAG_MAGIC_NUM;
-	if (fwrite(&magic_num, ETHASH_DAG_MAGIC_NUM_SIZE, 1, f) != 1) {
-		ETHASH_CRITICAL("Could not write magic number to DAG's beginning.");
+	if (!ret->file_mapped && !ethash_io_write_dag(
+		f,
+		ret->data,
+		full_size,
+		(uint64_t)progress.saved * sizeof(node),
+		full_size,
+		progress.direct,
+		progress.rate
+	)) {
+		ETHASH_CRITICAL("Could not write DAG data to file. Insufficient space?");
 		goto fail_free_full_data;
 	}
-	if (fflush(f) != 0) {// make sure the magic number IS there
-		ETHASH_CRITICAL("Could not flush memory mapped data to DAG file. Insufficient space?");
+
+	// after the DAG has been filled then we finalize it by marking it complete in the header
+	if (!ethash_io_set_dag_state(f, ETHASH_DAG_COMPLETE, (uint32_t)(full_size / sizeof(node)))) {
+		ETHASH_CRITICAL("Could not mark the DAG file complete. Insufficient space?");
 		goto fail_free_full_data;
 	}
+	ethash_full_replicate(ret, params->pages);
 	return ret;
 
 fail_free_full_data:
-	// could check that munmap(..) == 0 but even if it did not can't really do anything here
-	munmap(ret->data, (size_t)full_size);
+	ethash_full_unmap(ret);
 fail_close_file:
 	fclose(ret->file);
 fail_free_full:
@@ -455,7 +1321,169 @@ fail_free_full:
 	return NULL;
 }
 
+ethash_full_t ethash_full_new_internal_in_memory(
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+)
+{
+	ethash_full_params_t const default_params = { 0 };
+	if (!params) {
+		params = &default_params;
+	}
+	struct ethash_full* ret;
+	ret = calloc(sizeof(*ret), 1);
+	if (!ret) {
+		return NULL;
+	}
+	ethash_full_init(ret, full_size, params);
+	if (!ethash_full_alloc(ret, params)) {
+		ETHASH_CRITICAL("Could not allocate memory for the DAG.");
+		goto fail_free_full;
+	}
+	if (!ethash_compute_full_data(ret->data, full_size, light, callback, params->threads)) {
+		ETHASH_CRITICAL("Failure at computing DAG data.");
+		goto fail_free_full_data;
+	}
+	ethash_full_replicate(ret, params->pages);
+	return ret;
+
+fail_free_full_data:
+	ethash_full_unmap(ret);
+fail_free_full:
+	free(ret);
+	return NULL;
+}
+
+ethash_full_t ethash_full_new_internal_lazy(
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_full_params_t const* params
+)
+{
+	ethash_full_params_t const default_params = { 0 };
+	if (!params) {
+		params = &default_params;
+	}
+	if (full_size % ETHASH_MIX_BYTES != 0) {
+		return NULL;
+	}
+	struct ethash_full* ret;
+	ret = calloc(sizeof(*ret), 1);
+	if (!ret) {
+		return NULL;
+	}
+	ethash_full_init(ret, full_size, params);
+	if (ret->numa == ETHASH_NUMA_REPLICATE) {
+		// copies need the finished DAG, spread the single one instead
+		ret->numa = ETHASH_NUMA_INTERLEAVE;
+	}
+	if (!ethash_full_alloc(ret, params)) {
+		ETHASH_CRITICAL("Could not allocate memory for the DAG.");
+		goto fail_free_full;
+	}
+	ret->lazy = ethash_dag_lazy_start(ret->data, full_size, light, params->threads);
+	if (!ret->lazy) {
+		goto fail_free_full_data;
+	}
+	return ret;
+
+fail_free_full_data:
+	ethash_full_unmap(ret);
+fail_free_full:
+	free(ret);
+	return NULL;
+}
+
+// Items of a DAG file slice that are computed and written at once: 8MB
+#define ETHASH_DAG_SLICE_ITEMS (1 << 17)
+
+bool ethash_dag_file_write_range_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	uint32_t begin,
+	uint32_t end,
+	unsigned threads,
+	ethash_callback_t callback
+)
+{
+	if (begin > end || end > full_size / sizeof(node)) {
+		return false;
+	}
+	bool ret = false;
+	FILE* f = ethash_io_open_dag(dirname, seed_hash);
+	if (!f) {
+		return false;
+	}
+	uint32_t const batch_items = clamp_u32(end - begin, 1, ETHASH_DAG_SLICE_ITEMS);
+	node* batch = malloc((size_t)batch_items * sizeof(node));
+	if (!batch) {
+		goto fail_close_file;
+	}
+	if (callback && callback(0) != 0) {
+		goto fail_free_batch;
+	}
+	for (uint32_t i = begin; i != end;) {
+		uint32_t const n = min_u32(end - i, batch_items);
+		if (!ethash_compute_dag_range(light, i, i + n, batch, threads, NULL) ||
+			!ethash_io_write_slice(f, batch, (uint64_t)i * sizeof(node), (uint64_t)n * sizeof(node))) {
+			ETHASH_CRITICAL("Could not write a slice of the DAG file. Insufficient space?");
+			goto fail_free_batch;
+		}
+		i += n;
+		if (callback && i != end && callback((unsigned)((uint64_t)(i - begin) * 100 / (end - begin))) != 0) {
+			goto fail_free_batch;
+		}
+	}
+	ret = ethash_io_sync(f) && (!callback || callback(100) == 0);
+
+fail_free_batch:
+	free(batch);
+fail_close_file:
+	fclose(f);
+	return ret;
+}
+
+bool ethash_dag_file_seal_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size
+)
+{
+	FILE* f = ethash_io_open_dag(dirname, seed_hash);
+	if (!f) {
+		return false;
+	}
+	size_t found_size;
+	// the items have to be on disk before the header vouches for them
+	bool const ret = ethash_file_size(f, &found_size) &&
+		found_size == full_size + ETHASH_DAG_HEADER_SIZE &&
+		ethash_io_sync(f) &&
+		ethash_io_write_dag_header(
+			f,
+			seed_hash,
+			full_size,
+			ETHASH_DAG_COMPLETE,
+			(uint32_t)(full_size / sizeof(node))
+		) &&
+		ethash_io_sync(f);
+	fclose(f);
+	return ret;
+}
+
 ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback)
+{
+	return ethash_full_new_with_params(light, callback, NULL);
+}
+
+ethash_full_t ethash_full_new_with_params(
+	ethash_light_t light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+)
 {
 	char strbuf[256];
 	if (!ethash_get_default_dirname(strbuf, 256)) {
@@ -463,13 +1491,70 @@ ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback)
 	}
 	uint64_t full_size = ethash_get_datasize(light->block_number);
 	ethash_h256_t seedhash = ethash_get_seedhash(light->block_number);
-	return ethash_full_new_internal(strbuf, seedhash, full_size, light, callback);
+	return ethash_full_new_internal_with_params(strbuf, seedhash, full_size, light, callback, params);
+}
+
+ethash_full_t ethash_full_new_in_memory(
+	ethash_light_t light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+)
+{
+	uint64_t full_size = ethash_get_datasize(light->block_number);
+	return ethash_full_new_internal_in_memory(full_size, light, callback, params);
+}
+
+ethash_full_t ethash_full_new_lazy(
+	ethash_light_t light,
+	ethash_full_params_t const* params
+)
+{
+	uint64_t full_size = ethash_get_datasize(light->block_number);
+	return ethash_full_new_internal_lazy(full_size, light, params);
+}
+
+bool ethash_dag_file_write_range(
+	ethash_light_t light,
+	char const* dirname,
+	uint32_t begin,
+	uint32_t end,
+	unsigned threads,
+	ethash_callback_t callback
+)
+{
+	char strbuf[256];
+	if (!dirname) {
+		if (!ethash_get_default_dirname(strbuf, 256)) {
+			return false;
+		}
+		dirname = strbuf;
+	}
+	uint64_t full_size = ethash_get_datasize(light->block_number);
+	ethash_h256_t seedhash = ethash_get_seedhash(light->block_number);
+	return ethash_dag_file_write_range_internal(dirname, seedhash, full_size, light, begin, end, threads, callback);
+}
+
+bool ethash_dag_file_seal(ethash_light_t light, char const* dirname)
+{
+	char strbuf[256];
+	if (!dirname) {
+		if (!ethash_get_default_dirname(strbuf, 256)) {
+			return false;
+		}
+		dirname = strbuf;
+	}
+	uint64_t full_size = ethash_get_datasize(light->block_number);
+	ethash_h256_t seedhash = ethash_get_seedhash(light->block_number);
+	return ethash_dag_file_seal_internal(dirname, seedhash, full_size);
 }
 
 void ethash_full_delete(ethash_full_t full)
 {
-	// could check that munmap(..) == 0 but even if it did not can't really do anything here
-	munmap(full->data, (size_t)full->file_size);
+	if (full->lazy) {
+		// the fillers write to the DAG until they are joined
+		ethash_dag_lazy_delete(full->lazy);
+	}
+	ethash_full_unmap(full);
 	if (full->file) {
 		fclose(full->file);
 	}
@@ -483,10 +1568,14 @@ ethash_return_value_t ethash_full_compute(
 )
 {
 	ethash_return_value_t ret;
+	if (full->lazy && !ethash_dag_lazy_complete(full->lazy)) {
+		ethash_hash_lazy(&ret, full, header_hash, nonce);
+		return ret;
+	}
 	ret.success = true;
 	if (!ethash_hash(
 		&ret,
-		(node const*)full->data,
+		ethash_full_local_dag(full),
 		NULL,
 		full->file_size,
 		header_hash,
@@ -496,6 +1585,44 @@ ethash_return_value_t ethash_full_compute(
 	return ret;
 }
 
+unsigned ethash_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_result_t* results,
+	unsigned max_results
+)
+{
+	unsigned found = 0;
+	ethash_return_value_t ret[ETHASH_HASH_LANES_MAX];
+	node const* dag = ethash_full_local_dag(full);
+	if (full->file_size % MIX_WORDS != 0) {
+		return 0;
+	}
+	for (uint64_t i = 0; i != count && found != max_results;) {
+		unsigned lanes = count - i < full->search_lanes ? (unsigned) (count - i) : full->search_lanes;
+		if (full->lazy && !ethash_dag_lazy_complete(full->lazy)) {
+			// the DAG is still being built, check every page
+			lanes = 1;
+			ethash_hash_lazy(ret, full, header_hash, start_nonce + i);
+		} else {
+			ethash_hash_full_lanes(ret, dag, full->file_size, header_hash, start_nonce + i, lanes);
+		}
+		for (unsigned l = 0; l != lanes && found != max_results; ++l) {
+			if (ethash_check_difficulty(&ret[l].result, boundary)) {
+				results[found].nonce = start_nonce + i + l;
+				results[found].result = ret[l].result;
+				results[found].mix_hash = ret[l].mix_hash;
+				++found;
+			}
+		}
+		i += lanes;
+	}
+	return found;
+}
+
 void const* ethash_full_dag(ethash_full_t full)
 {
 	return full->data;
@@ -505,3 +1632,29 @@ uint64_t ethash_full_dag_size(ethash_full_t full)
 {
 	return full->file_size;
 }
+
+unsigned ethash_full_replicas(ethash_full_t full)
+{
+	return full->num_replicas ? full->num_replicas : 1;
+}
+
+ethash_pages_t ethash_full_pages(ethash_full_t full)
+{
+	return full->pages;
+}
+
+unsigned ethash_full_progress(ethash_full_t full)
+{
+	if (!full->lazy) {
+		return 100;
+	}
+	uint32_t const done = ethash_atomic_load_u32(&full->lazy->job.done);
+	return (unsigned)((uint64_t)done * 100 / full->lazy->job.max_n);
+}
+
+void ethash_full_wait(ethash_full_t full)
+{
+	if (full->lazy) {
+		ethash_dag_lazy_wait(full->lazy);
+	}
+}
@@ -2,14 +2,10 @@
 #include "compiler.h"
 #include "endian.h"
 #include "ethash.h"
+#include "fnv.h"
+#include "numa.h"
 #include <stdio.h>
 
-#define ENABLE_SSE 0
-
-#if defined(_M_X64) && ENABLE_SSE
-#include <smmintrin.h>
-#endif
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,13 +20,15 @@ typedef union node {
 	uint8_t bytes[NODE_WORDS * 4];
 	uint32_t words[NODE_WORDS];
 	uint64_t double_words[NODE_WORDS / 2];
-
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i xmm[NODE_WORDS/4];
-#endif
-
 } node;
 
+/// Start loading the ETHASH_MIX_BYTES page at @a page into the cache
+static inline void ethash_prefetch_page(node const* page)
+{
+	ETHASH_PREFETCH(page[0].bytes);
+	ETHASH_PREFETCH(page[1].bytes);
+}
+
 static inline uint8_t ethash_h256_get(ethash_h256_t const* hash, unsigned int i)
 {
 	return hash->b[i];
@@ -82,8 +80,22 @@ struct ethash_light {
 	void* cache;
 	uint64_t cache_size;
 	uint64_t block_number;
+	ethash_pages_t pages;
+	bool mapped;             // cache is a mapping of its file, see ethash_io_map_cache()
+	bool shared;             // cache is in shared memory, see ethash_shm_map_cache()
+	ethash_allocator_t allocator; // where the cache came from if alloc is not NULL
 };
 
+/**
+ * Compute the light cache nodes of @a seed
+ *
+ * @param nodes         Where the nodes go, @a cache_size bytes
+ * @param cache_size    The size of the cache in bytes, a multiple of the node size
+ * @param seed          Block seedhash of the cache
+ * @return              false for an invalid @a cache_size and true otherwise
+ */
+bool ethash_compute_cache_nodes(node* const nodes, uint64_t cache_size, ethash_h256_t const* seed);
+
 /**
  * Allocate and initialize a new ethash_light handler. Internal version
  *
@@ -95,6 +107,22 @@ struct ethash_light {
  */
 ethash_light_t ethash_light_new_internal(uint64_t cache_size, ethash_h256_t const* seed);
 
+/**
+ * Allocate and initialize a new ethash_light handler with custom parameters. Internal version
+ *
+ * @param cache_size    The size of the cache in bytes
+ * @param seed          Block seedhash to be used during the computation of the
+ *                      cache nodes
+ * @param params        Creation parameters. NULL is the same as all-default parameters.
+ * @return              Newly allocated ethash_light handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
+ */
+ethash_light_t ethash_light_new_internal_with_params(
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	ethash_light_params_t const* params
+);
+
 /**
  * Calculate the light client data. Internal version.
  *
@@ -115,8 +143,34 @@ struct ethash_full {
 	FILE* file;
 	uint64_t file_size;
 	node* data;
+	unsigned search_lanes;
+	bool file_mapped;        ///< data is a mapping of file rather than anonymous memory
+	ethash_pages_t pages;
+	ethash_numa_t numa;
+	unsigned num_replicas;
+	/// The DAG copy of each node id or NULL to use data. data is one of them.
+	node* replicas[ETHASH_NUMA_MAX_NODES];
+	ethash_pages_t replica_pages[ETHASH_NUMA_MAX_NODES];
+	/// The background build of a lazy DAG or NULL if data was complete from the start
+	struct ethash_dag_lazy* lazy;
+	/// Where data came from if alloc is not NULL
+	ethash_allocator_t allocator;
 };
 
+/**
+ * Get the copy of the DAG that is local to the calling thread
+ */
+static inline node const* ethash_full_local_dag(struct ethash_full const* full)
+{
+	if (full->num_replicas > 1) {
+		node const* replica = full->replicas[ethash_numa_current()];
+		if (replica) {
+			return replica;
+		}
+	}
+	return full->data;
+}
+
 /**
  * Allocate and initialize a new ethash_full handler. Internal version.
  *
@@ -142,12 +196,257 @@ ethash_full_t ethash_full_new_internal(
 	ethash_callback_t callback
 );
 
+/**
+ * Same as @ref ethash_full_new_internal() but with custom parameters.
+ *
+ * @param params         Tuning parameters for the DAG creation. Can be NULL for defaults.
+ */
+ethash_full_t ethash_full_new_internal_with_params(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Allocate and initialize a new ethash_full handler whose DAG only lives in
+ * memory. Internal version of @ref ethash_full_new_in_memory()
+ *
+ * @param full_size      The size of the full data in bytes.
+ * @param light          The light handler to generate the DAG from
+ * @param callback       Same as in @ref ethash_full_new_internal()
+ * @param params         Tuning parameters for the DAG creation. Can be NULL for defaults.
+ */
+ethash_full_t ethash_full_new_internal_in_memory(
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Allocate a new ethash_full handler whose DAG is built in the background.
+ * Internal version of @ref ethash_full_new_lazy()
+ *
+ * @param full_size      The size of the full data in bytes.
+ * @param light          The light handler to generate the DAG from. Has to
+ *                       outlive the returned handler.
+ * @param params         Tuning parameters. Can be NULL for defaults.
+ */
+ethash_full_t ethash_full_new_internal_lazy(
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Create a manager of per-epoch contexts. Internal version of @ref ethash_epochs_new()
+ *
+ * @param params         Parameters. Can be NULL for defaults.
+ * @param cache_size     Light cache size of every epoch, 0 to go by the epoch
+ * @param full_size      DAG size of every epoch, 0 to go by the epoch
+ */
+ethash_epochs_t ethash_epochs_new_internal(
+	ethash_epochs_params_t const* params,
+	uint64_t cache_size,
+	uint64_t full_size
+);
+
+/**
+ * Check whether a manager keeps a built context of the epoch of @a block_number
+ */
+bool ethash_epochs_cached_internal(ethash_epochs_t epochs, uint64_t block_number, bool full);
+
+/**
+ * Start creating an ethash_full handler on a background thread. Internal
+ * version of @ref ethash_full_new_async()
+ *
+ * @param dirname        The directory of the DAG file or NULL to keep the DAG in memory
+ * @param seed_hash      The seed hash of the block. Used in the DAG file naming.
+ * @param full_size      The size of the full data in bytes.
+ * @param light          The light handler to generate the DAG from
+ * @param params         Tuning parameters. Can be NULL for defaults.
+ */
+ethash_full_async_t ethash_full_new_internal_async(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_full_params_t const* params
+);
+
+/**
+ * Internal version of @ref ethash_dag_file_write_range(), for any DAG size
+ *
+ * @param dirname        The directory of the DAG file
+ * @param seed_hash      The seed hash of the block. Used in the DAG file naming.
+ * @param full_size      The size of the full data in bytes.
+ */
+bool ethash_dag_file_write_range_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	uint32_t begin,
+	uint32_t end,
+	unsigned threads,
+	ethash_callback_t callback
+);
+
+/**
+ * Internal version of @ref ethash_dag_file_seal(), for any DAG size
+ */
+bool ethash_dag_file_seal_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size
+);
+
+/**
+ * Calculate a single DAG item with the kernel of the active backend
+ *
+ * @param ret           The node to write the item to
+ * @param node_index    The index of the item
+ * @param cache         The light handler containing the cache
+ */
 void ethash_calculate_dag_item(
 	node* const ret,
 	uint32_t node_index,
 	ethash_light_t const cache
 );
 
+/// Portable version of @ref ethash_calculate_dag_item(). Reference for the SIMD kernels.
+void ethash_calculate_dag_item_scalar(
+	node* const ret,
+	uint32_t node_index,
+	ethash_light_t const cache
+);
+
+/**
+ * Calculate a contiguous range of DAG items, using the widest multi-buffer
+ * kernel of the active backend. Bit-identical to @ref ethash_calculate_dag_item().
+ *
+ * @param ret      Output array of @a count nodes
+ * @param begin    Index of the first item to calculate
+ * @param count    Number of items to calculate
+ * @param light    The light handler containing the cache
+ */
+void ethash_calculate_dag_items(
+	node* const ret,
+	uint32_t begin,
+	uint32_t count,
+	ethash_light_t const light
+);
+
+/**
+ * The ETHASH_ACCESSES rounds of hashimoto that fold DAG pages into the mix.
+ * Portable version, the SIMD kernels in simd.h must match it bit for bit.
+ *
+ * @param mix             The MIX_NODES nodes of the mix, updated in place
+ * @param seed            Word 0 of the Keccak-512 seed of the hash
+ * @param full_nodes      The full DAG or NULL to compute the pages from @a light
+ * @param light           The light handler. Only used if @a full_nodes is NULL
+ * @param num_full_pages  Number of ETHASH_MIX_BYTES pages in the DAG
+ */
+void ethash_hashimoto_mix_scalar(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+);
+
+/// Get the DAG page @a index, from the full DAG or computed into @a tmp
+static inline node const* ethash_hashimoto_page(
+	node* tmp,
+	uint32_t index,
+	node const* full_nodes,
+	ethash_light_t const light
+)
+{
+	if (full_nodes) {
+		return &full_nodes[MIX_NODES * index];
+	}
+	ethash_calculate_dag_items(tmp, index * MIX_NODES, MIX_NODES, light);
+	return tmp;
+}
+
+/// Maximum number of nonces @ref ethash_hash_full_lanes() interleaves
+#define ETHASH_HASH_LANES_MAX 16
+/// Number of interleaved nonces when ethash_full_params_t does not say
+#define ETHASH_HASH_LANES_DEFAULT 8
+
+/**
+ * Full mode hashimoto of the nonces start_nonce ... start_nonce + lanes - 1.
+ * The nonces advance round-robin, one DAG access at a time, and the next page
+ * of every nonce is prefetched while the others are mixed, so up to @a lanes
+ * page loads are in flight instead of one.
+ *
+ * @param ret           Output array of @a lanes hashes
+ * @param full_nodes    The full DAG
+ * @param full_size     The size of the full DAG in bytes
+ * @param header_hash   The header hash to pack into the mix
+ * @param start_nonce   The nonce of the first lane
+ * @param lanes         Number of nonces, at most ETHASH_HASH_LANES_MAX
+ */
+void ethash_hash_full_lanes(
+	ethash_return_value_t* ret,
+	node const* full_nodes,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	unsigned lanes
+);
+
+/**
+ * The ETHASH_ACCESSES rounds of @ref ethash_hash_full_lanes(). Every lane only
+ * depends on its own previous page, so while one lane mixes, the pages the
+ * other lanes prefetched are on their way. Instantiated by every backend so
+ * the FNV loop is compiled for its instruction set.
+ *
+ * @param s_mix           Seed and mix of every lane, the mixes are updated in place
+ * @param full_nodes      The full DAG
+ * @param num_full_pages  Number of ETHASH_MIX_BYTES pages in the DAG
+ * @param lanes           Number of lanes, at most ETHASH_HASH_LANES_MAX
+ */
+static ETHASH_FORCE_INLINE void ethash_hashimoto_lanes(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+)
+{
+	uint32_t index[ETHASH_HASH_LANES_MAX];
+	for (unsigned l = 0; l != lanes; ++l) {
+		index[l] = fnv_hash(s_mix[l][0].words[0], s_mix[l][1].words[0]) % num_full_pages;
+		ethash_prefetch_page(&full_nodes[MIX_NODES * index[l]]);
+	}
+
+	for (uint32_t i = 0; i != ETHASH_ACCESSES; ++i) {
+		for (unsigned l = 0; l != lanes; ++l) {
+			uint32_t* restrict mix = s_mix[l][1].words;
+			uint32_t const* restrict page = full_nodes[MIX_NODES * index[l]].words;
+			for (unsigned w = 0; w != MIX_WORDS; ++w) {
+				mix[w] = fnv_hash(mix[w], page[w]);
+			}
+			if (i + 1 != ETHASH_ACCESSES) {
+				index[l] = fnv_hash(s_mix[l][0].words[0] ^ (i + 1), mix[(i + 1) % MIX_WORDS]) % num_full_pages;
+				ethash_prefetch_page(&full_nodes[MIX_NODES * index[l]]);
+			}
+		}
+	}
+}
+
+/// Portable instance of @ref ethash_hashimoto_lanes()
+void ethash_hashimoto_lanes_scalar(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+);
+
 void ethash_quick_hash(
 	ethash_h256_t* return_hash,
 	ethash_h256_t const* header_hash,
@@ -158,6 +457,22 @@ void ethash_quick_hash(
 uint64_t ethash_get_datasize(uint64_t const block_number);
 uint64_t ethash_get_cachesize(uint64_t const block_number);
 
+/**
+ * Deterministic primality test for any 64-bit number
+ */
+bool ethash_is_prime(uint64_t n);
+/**
+ * Compute the DAG size of an epoch the way the spec defines it: the largest
+ * prime multiple of ETHASH_MIX_BYTES below its bound. The table in
+ * data_sizes.h holds the results for the first epochs.
+ */
+uint64_t ethash_generate_datasize(uint64_t epoch);
+/**
+ * Compute the cache size of an epoch, the largest prime multiple of
+ * ETHASH_HASH_BYTES below its bound
+ */
+uint64_t ethash_generate_cachesize(uint64_t epoch);
+
 /**
  * Compute the memory data for a full node's memory
  *
@@ -165,13 +480,40 @@ uint64_t ethash_get_cachesize(uint64_t const block_number);
  * @param full_size   The size of the full data in bytes
  * @param cache       A cache object to use in the calculation
  * @param callback    The callback function. Check @ref ethash_full_new() for details.
+ *                    It is only invoked from the calling thread.
+ * @param num_threads Number of threads to compute the DAG with, including the
+ *                    calling thread. 0 means one per online core.
  * @return            true if all went fine and false for invalid parameters
  */
 bool ethash_compute_full_data(
 	void* mem,
 	uint64_t full_size,
 	ethash_light_t const light,
-	ethash_callback_t callback
+	ethash_callback_t callback,
+	unsigned num_threads
+);
+
+/// Called with the number of leading DAG items that are complete. Returns false to abort
+typedef bool (*ethash_dag_checkpoint_t)(void* context, uint32_t items);
+
+/**
+ * Same as @ref ethash_compute_full_data() but can continue an interrupted
+ * generation and report progress checkpoints
+ *
+ * @param first_item  Number of leading DAG items in @a mem that are already computed
+ * @param checkpoint  Called from the calling thread every few percent, with the
+ *                    number of leading items done so far. Can be NULL.
+ * @param context     Passed through to @a checkpoint
+ */
+bool ethash_compute_full_data_resumable(
+	void* mem,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	unsigned num_threads,
+	uint32_t first_item,
+	ethash_dag_checkpoint_t checkpoint,
+	void* context
 );
 
 #ifdef __cplusplus
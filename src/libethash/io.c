@@ -22,6 +22,100 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include "mmap.h"
+
+// Bytes of a version 1 DAG file copied at a time
+#define ETHASH_IO_MIGRATE_CHUNK ((size_t)8 << 20)
+
+/**
+ * Copy the version 1 DAG file of @a seedhash to the version 2 file @a filename,
+ * as far as it was generated, and remove it. The copy is made under a temporary
+ * name of its own and renamed into place, so an interrupted migration leaves the
+ * version 1 file to try again with and concurrent ones don't mix their copies.
+ */
+static void ethash_io_migrate_v1(
+	char const* dirname,
+	ethash_h256_t const* seedhash,
+	uint64_t file_size,
+	char const* filename
+)
+{
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_mutable_name(ETHASH_REVISION, seedhash, mutable_name);
+	char* old_name = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!old_name) {
+		return;
+	}
+	FILE* old = ethash_fopen(old_name, "rb");
+	if (!old) {
+		goto free_old_name;
+	}
+	size_t found_size;
+	uint64_t magic_num;
+	uint32_t state = ETHASH_DAG_COMPLETE;
+	uint32_t items = (uint32_t)(file_size / ETHASH_HASH_BYTES);
+	if (!ethash_file_size(old, &found_size) ||
+		found_size != file_size + ETHASH_DAG_MAGIC_NUM_SIZE ||
+		fread(&magic_num, ETHASH_DAG_MAGIC_NUM_SIZE, 1, old) != 1) {
+		goto close_old;
+	}
+	if ((magic_num >> 32) == ETHASH_DAG_PARTIAL_TAG) {
+		state = ETHASH_DAG_BUILDING;
+		if ((uint32_t)magic_num < items) {
+			items = (uint32_t)magic_num;
+		}
+	} else if (magic_num != ETHASH_DAG_MAGIC_NUM) {
+		goto close_old;
+	}
+
+	char* tmpname = NULL;
+	uint8_t* buf = malloc(ETHASH_IO_MIGRATE_CHUNK);
+	if (!buf) {
+		goto free_buffers;
+	}
+	FILE* f = ethash_io_create_tmpfile(filename, &tmpname);
+	if (!f) {
+		ETHASH_CRITICAL("Could not create a DAG file next to: \"%s\"", filename);
+		goto free_buffers;
+	}
+	uint64_t const copy_size = (uint64_t)items * ETHASH_HASH_BYTES;
+	bool copied = fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET) == 0;
+	for (uint64_t done = 0; copied && done < copy_size;) {
+		size_t const len = copy_size - done < ETHASH_IO_MIGRATE_CHUNK ?
+			(size_t)(copy_size - done) : ETHASH_IO_MIGRATE_CHUNK;
+		copied = fread(buf, 1, len, old) == len && fwrite(buf, 1, len, f) == len;
+		done += len;
+	}
+	if (copied && copy_size < file_size) {
+		// the rest of the DAG is yet to be generated, but the file has its full size
+		copied = fseek(f, (long int)(file_size + ETHASH_DAG_HEADER_SIZE - 1), SEEK_SET) == 0 &&
+			fputc('\n', f) != EOF;
+	}
+	// the data has to be on disk before the header vouches for it
+	copied = copied &&
+		ethash_io_sync(f) &&
+		ethash_io_write_dag_header(f, *seedhash, file_size, state, items) &&
+		ethash_io_sync(f);
+	fclose(f);
+	if (copied && rename(tmpname, filename) == 0) {
+		fclose(old);
+		old = NULL;
+		remove(old_name);
+	} else {
+		ETHASH_CRITICAL("Could not move DAG file \"%s\" to version 2", old_name);
+		remove(tmpname);
+	}
+
+free_buffers:
+	free(buf);
+	free(tmpname);
+close_old:
+	if (old) {
+		fclose(old);
+	}
+free_old_name:
+	free(old_name);
+}
 
 enum ethash_io_rc ethash_io_prepare(
 	char const* dirname,
@@ -42,7 +136,7 @@ enum ethash_io_rc ethash_io_prepare(
 		goto end;
 	}
 
-	ethash_io_mutable_name(ETHASH_REVISION, &seedhash, mutable_name);
+	ethash_io_mutable_name_v2(ETHASH_REVISION, &seedhash, mutable_name);
 	char* tmpfile = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
 	if (!tmpfile) {
 		ETHASH_CRITICAL("Could not create the full DAG pathname");
@@ -53,6 +147,11 @@ enum ethash_io_rc ethash_io_prepare(
 	if (!force_create) {
 		// try to open the file
 		f = ethash_fopen(tmpfile, "rb+");
+		if (!f) {
+			// a DAG of an older version is much cheaper to copy than to generate
+			ethash_io_migrate_v1(dirname, &seedhash, file_size, tmpfile);
+			f = ethash_fopen(tmpfile, "rb+");
+		}
 		if (f) {
 			size_t found_size;
 			if (!ethash_file_size(f, &found_size)) {
@@ -60,21 +159,22 @@ enum ethash_io_rc ethash_io_prepare(
 				ETHASH_CRITICAL("Could not query size of DAG file: \"%s\"", tmpfile);
 				goto free_memo;
 			}
-			if (file_size != found_size - ETHASH_DAG_MAGIC_NUM_SIZE) {
+			if (file_size != found_size - ETHASH_DAG_HEADER_SIZE) {
 				fclose(f);
 				ret = ETHASH_IO_MEMO_SIZE_MISMATCH;
 				goto free_memo;
 			}
-			// compare the magic number, no need to care about endianess since it's local
-			uint64_t magic_num;
-			if (fread(&magic_num, ETHASH_DAG_MAGIC_NUM_SIZE, 1, f) != 1) {
-				// I/O error
+			struct ethash_dag_header header;
+			if (!ethash_io_read_dag_header(f, seedhash, file_size, &header)) {
 				fclose(f);
-				ETHASH_CRITICAL("Could not read from DAG file: \"%s\"", tmpfile);
 				ret = ETHASH_IO_MEMO_SIZE_MISMATCH;
 				goto free_memo;
 			}
-			if (magic_num != ETHASH_DAG_MAGIC_NUM) {
+			if (header.state == ETHASH_DAG_BUILDING) {
+				ret = ETHASH_IO_MEMO_PARTIAL;
+				goto set_file;
+			}
+			if (header.state != ETHASH_DAG_COMPLETE) {
 				fclose(f);
 				ret = ETHASH_IO_MEMO_SIZE_MISMATCH;
 				goto free_memo;
@@ -91,7 +191,7 @@ enum ethash_io_rc ethash_io_prepare(
 		goto free_memo;
 	}
 	// make sure it's of the proper size
-	if (fseek(f, (long int)(file_size + ETHASH_DAG_MAGIC_NUM_SIZE - 1), SEEK_SET) != 0) {
+	if (fseek(f, (long int)(file_size + ETHASH_DAG_HEADER_SIZE - 1), SEEK_SET) != 0) {
 		fclose(f);
 		ETHASH_CRITICAL("Could not seek to the end of DAG file: \"%s\". Insufficient space?", tmpfile);
 		goto free_memo;
@@ -106,6 +206,11 @@ enum ethash_io_rc ethash_io_prepare(
 		ETHASH_CRITICAL("Could not flush at end of DAG file: \"%s\". Insufficient space?", tmpfile);
 		goto free_memo;
 	}
+	if (!ethash_io_write_dag_header(f, seedhash, file_size, ETHASH_DAG_BUILDING, 0)) {
+		fclose(f);
+		ETHASH_CRITICAL("Could not write the header of DAG file: \"%s\"", tmpfile);
+		goto free_memo;
+	}
 	ret = ETHASH_IO_MEMO_MISMATCH;
 	goto set_file;
 
@@ -117,3 +222,282 @@ free_memo:
 end:
 	return ret;
 }
+
+FILE* ethash_io_open_dag(char const* dirname, ethash_h256_t const seedhash)
+{
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	FILE* f = NULL;
+	if (!ethash_mkdir(dirname)) {
+		ETHASH_CRITICAL("Could not create the ethash directory");
+		return NULL;
+	}
+	ethash_io_mutable_name_v2(ETHASH_REVISION, &seedhash, mutable_name);
+	char* tmpfile = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!tmpfile) {
+		ETHASH_CRITICAL("Could not create the full DAG pathname");
+		return NULL;
+	}
+	// append mode creates the file without truncating what another writer put there
+	f = ethash_fopen(tmpfile, "ab");
+	if (f) {
+		fclose(f);
+		f = ethash_fopen(tmpfile, "rb+");
+	}
+	if (!f) {
+		ETHASH_CRITICAL("Could not open DAG file: \"%s\"", tmpfile);
+	}
+	free(tmpfile);
+	return f;
+}
+
+bool ethash_io_write_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t dag_size,
+	uint32_t state,
+	uint32_t items
+)
+{
+	struct ethash_dag_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ETHASH_DAG_MAGIC_NUM;
+	header.version = ETHASH_DAG_FILE_VERSION;
+	header.revision = ETHASH_REVISION;
+	if (!ethash_get_epoch(seedhash, &header.epoch)) {
+		header.epoch = ETHASH_DAG_EPOCH_UNKNOWN;
+	}
+	header.seedhash = seedhash;
+	header.dag_size = dag_size;
+	header.header_size = ETHASH_DAG_HEADER_SIZE;
+	header.state = state;
+	header.items = items;
+	// one write of less than a sector, so the header is never seen half updated
+	return fseek(f, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fflush(f) == 0;
+}
+
+bool ethash_io_read_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t dag_size,
+	struct ethash_dag_header* header
+)
+{
+	return fseek(f, 0, SEEK_SET) == 0 &&
+		fread(header, sizeof(*header), 1, f) == 1 &&
+		header->magic == ETHASH_DAG_MAGIC_NUM &&
+		header->version == ETHASH_DAG_FILE_VERSION &&
+		header->revision == ETHASH_REVISION &&
+		memcmp(&header->seedhash, &seedhash, sizeof(seedhash)) == 0 &&
+		header->dag_size == dag_size &&
+		header->header_size == ETHASH_DAG_HEADER_SIZE &&
+		fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET) == 0;
+}
+
+bool ethash_io_set_dag_state(FILE* f, uint32_t state, uint32_t items)
+{
+	struct ethash_dag_header header;
+	if (fseek(f, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, f) != 1) {
+		return false;
+	}
+	header.state = state;
+	header.items = items;
+	return fseek(f, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fflush(f) == 0;
+}
+
+bool ethash_io_write_watermark(FILE* f, uint32_t items)
+{
+	return ethash_io_set_dag_state(f, ETHASH_DAG_BUILDING, items) && ethash_io_sync(f);
+}
+
+bool ethash_io_read_watermark(FILE* f, uint32_t* items)
+{
+	struct ethash_dag_header header;
+	if (fseek(f, 0, SEEK_SET) != 0 ||
+		fread(&header, sizeof(header), 1, f) != 1 ||
+		header.magic != ETHASH_DAG_MAGIC_NUM ||
+		header.state != ETHASH_DAG_BUILDING) {
+		return false;
+	}
+	*items = header.items;
+	return true;
+}
+
+static uint64_t ethash_io_cache_checksum(void const* data, uint64_t size)
+{
+	// Four FNV-1a lanes over 64-bit words, so the multiplies overlap. Each
+	// step is a bijection of the lane, so any single changed word shows.
+	uint64_t const prime = 0x100000001b3ULL;
+	uint64_t const* words = (uint64_t const*)data;
+	uint64_t const num_words = size / sizeof(uint64_t);
+	uint64_t lanes[4] = {
+		0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL,
+		0x9ce484222325cbf2ULL, 0x2325cbf29ce48422ULL
+	};
+	uint64_t i = 0;
+	for (; i + 4 <= num_words; i += 4) {
+		lanes[0] = (lanes[0] ^ words[i + 0]) * prime;
+		lanes[1] = (lanes[1] ^ words[i + 1]) * prime;
+		lanes[2] = (lanes[2] ^ words[i + 2]) * prime;
+		lanes[3] = (lanes[3] ^ words[i + 3]) * prime;
+	}
+	for (; i < num_words; ++i) {
+		lanes[0] = (lanes[0] ^ words[i]) * prime;
+	}
+	uint64_t ret = size;
+	for (i = 0; i < 4; ++i) {
+		ret = (ret ^ lanes[i]) * prime;
+	}
+	return ret;
+}
+
+static char* ethash_io_cache_filename(char const* dirname, ethash_h256_t const* seedhash)
+{
+	char mutable_name[CACHE_MUTABLE_NAME_MAX_SIZE];
+	if (!ethash_io_cache_mutable_name(ETHASH_REVISION, seedhash, mutable_name)) {
+		return NULL;
+	}
+	return ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+}
+
+/**
+ * Open the light cache file of @a seedhash if its header and size match.
+ * The stream is left right after the header.
+ */
+static FILE* ethash_io_open_cache(
+	char const* dirname,
+	ethash_h256_t const* seedhash,
+	uint64_t cache_size,
+	uint64_t* checksum
+)
+{
+	char* filename = ethash_io_cache_filename(dirname, seedhash);
+	if (!filename) {
+		return NULL;
+	}
+	FILE* f = ethash_fopen(filename, "rb");
+	free(filename);
+	if (!f) {
+		return NULL;
+	}
+	struct ethash_cache_header header;
+	size_t found_size;
+	if (!ethash_file_size(f, &found_size) ||
+		found_size != cache_size + ETHASH_CACHE_HEADER_SIZE ||
+		fread(&header, sizeof(header), 1, f) != 1 ||
+		header.magic != ETHASH_CACHE_MAGIC_NUM ||
+		header.cache_size != cache_size ||
+		memcmp(&header.seedhash, seedhash, sizeof(header.seedhash)) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	*checksum = header.checksum;
+	return f;
+}
+
+void* ethash_io_map_cache(char const* dirname, ethash_h256_t const seedhash, uint64_t cache_size)
+{
+	uint64_t checksum;
+	FILE* f = ethash_io_open_cache(dirname, &seedhash, cache_size, &checksum);
+	if (!f) {
+		return NULL;
+	}
+	size_t const map_size = (size_t)(cache_size + ETHASH_CACHE_HEADER_SIZE);
+	// shared, so every process of the host reads the same page cache pages
+	uint8_t* mem = mmap(NULL, map_size, PROT_READ, MAP_SHARED, ethash_fileno(f), 0);
+	fclose(f);
+	if (mem == MAP_FAILED) {
+		ETHASH_CRITICAL("mmap failed for light cache file");
+		return NULL;
+	}
+	if (ethash_io_cache_checksum(mem + ETHASH_CACHE_HEADER_SIZE, cache_size) != checksum) {
+		munmap(mem, map_size);
+		return NULL;
+	}
+	return mem + ETHASH_CACHE_HEADER_SIZE;
+}
+
+void ethash_io_unmap_cache(void* cache, uint64_t cache_size)
+{
+	munmap(
+		(uint8_t*)cache - ETHASH_CACHE_HEADER_SIZE,
+		(size_t)(cache_size + ETHASH_CACHE_HEADER_SIZE)
+	);
+}
+
+bool ethash_io_read_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	void* cache,
+	uint64_t cache_size
+)
+{
+	uint64_t checksum;
+	FILE* f = ethash_io_open_cache(dirname, &seedhash, cache_size, &checksum);
+	if (!f) {
+		return false;
+	}
+	bool const ret = fread(cache, (size_t)cache_size, 1, f) == 1 &&
+		ethash_io_cache_checksum(cache, cache_size) == checksum;
+	fclose(f);
+	return ret;
+}
+
+bool ethash_io_write_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	void const* cache,
+	uint64_t cache_size
+)
+{
+	bool ret = false;
+	if (!ethash_mkdir(dirname)) {
+		ETHASH_CRITICAL("Could not create the ethash directory");
+		return false;
+	}
+	char* filename = ethash_io_cache_filename(dirname, &seedhash);
+	if (!filename) {
+		ETHASH_CRITICAL("Could not create the light cache pathname");
+		return false;
+	}
+
+	struct ethash_cache_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ETHASH_CACHE_MAGIC_NUM;
+	header.cache_size = cache_size;
+	header.seedhash = seedhash;
+	header.checksum = ethash_io_cache_checksum(cache, cache_size);
+
+	char* tmpname;
+	FILE* f = ethash_io_create_tmpfile(filename, &tmpname);
+	if (!f) {
+		ETHASH_CRITICAL("Could not create a light cache file next to: \"%s\"", filename);
+		goto free_filename;
+	}
+	bool const written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(cache, (size_t)cache_size, 1, f) == 1 &&
+		ethash_io_sync(f);
+	fclose(f);
+	if (!written) {
+		ETHASH_CRITICAL("Could not write light cache file: \"%s\"", tmpname);
+		goto remove_tmp;
+	}
+	if (rename(tmpname, filename) != 0) {
+		// on Windows another process may have put its copy in place first
+		ETHASH_CRITICAL("Could not rename light cache file to: \"%s\"", filename);
+		goto remove_tmp;
+	}
+	ret = true;
+	goto free_tmpname;
+
+remove_tmp:
+	remove(tmpname);
+free_tmpname:
+	free(tmpname);
+free_filename:
+	free(filename);
+	return ret;
+}
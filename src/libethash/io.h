@@ -34,18 +34,74 @@
 extern "C" {
 #endif
 // Maximum size for mutable part of DAG file name
-// 6 is for "full-R", the suffix of the filename
+// 9 is for "full-v2-R", the suffix of the filename
 // 10 is for maximum number of digits of a uint32_t (for REVISION)
 // 1 is for - and 16 is for the first 16 hex digits for first 8 bytes of
 // the seedhash and last 1 is for the null terminating character
 // Reference: https://github.com/ethereum/wiki/wiki/Ethash-DAG
-#define DAG_MUTABLE_NAME_MAX_SIZE (6 + 10 + 1 + 16 + 1)
+#define DAG_MUTABLE_NAME_MAX_SIZE (9 + 10 + 1 + 16 + 1)
+// Same for the light cache file, whose name starts with "cache-R"
+#define CACHE_MUTABLE_NAME_MAX_SIZE (7 + 10 + 1 + 16 + 1)
 /// Possible return values of @see ethash_io_prepare
 enum ethash_io_rc {
 	ETHASH_IO_FAIL = 0,           ///< There has been an IO failure
 	ETHASH_IO_MEMO_SIZE_MISMATCH, ///< DAG with revision/hash match, but file size was wrong.
 	ETHASH_IO_MEMO_MISMATCH,      ///< The DAG file did not exist or there was revision/hash mismatch
 	ETHASH_IO_MEMO_MATCH,         ///< DAG file existed and revision/hash matched. No need to do anything
+	ETHASH_IO_MEMO_PARTIAL,       ///< DAG file existed but its generation was interrupted.
+	                              ///< @see ethash_io_read_watermark() for how far it got
+};
+
+/// Until a version 1 DAG file is complete the magic number slot holds this tag
+/// in its upper half and the number of leading DAG items known to be on disk in
+/// its lower half. Older versions see a missing magic number and start over.
+#define ETHASH_DAG_PARTIAL_TAG 0x9A47D1A6U
+
+/// Layout of the DAG files written. Version 1 files, named full-R<revision>-<seed>,
+/// have the DAG right after the magic number, 8 bytes off every page and cache
+/// line. Version 2 files, named full-v2-R<revision>-<seed>, start with a
+/// struct ethash_dag_header padded to ETHASH_DAG_HEADER_SIZE, so the DAG is
+/// page aligned in a mapping of the file and O_DIRECT writes never touch the
+/// header. Version 1 files are moved over by @ref ethash_io_prepare().
+#define ETHASH_DAG_FILE_VERSION 2
+#define ETHASH_DAG_HEADER_SIZE 4096
+/// Epoch of the header of a DAG whose seedhash belongs to no epoch
+#define ETHASH_DAG_EPOCH_UNKNOWN UINT64_MAX
+
+/// Build state of a version 2 DAG file
+enum ethash_dag_state {
+	ETHASH_DAG_BUILDING = 1,      ///< Being generated, items says how far it got
+	ETHASH_DAG_COMPLETE = 2       ///< All of the DAG is on disk
+};
+
+/// Layout of the start of a version 2 DAG file, the rest of the header is
+/// zero. Like the light cache header it is in host byte order.
+struct ethash_dag_header {
+	uint64_t magic;               ///< ETHASH_DAG_MAGIC_NUM
+	uint32_t version;             ///< ETHASH_DAG_FILE_VERSION
+	uint32_t revision;            ///< ETHASH_REVISION
+	uint64_t epoch;
+	ethash_h256_t seedhash;
+	uint64_t dag_size;            ///< Bytes of DAG after the header
+	uint64_t header_size;         ///< ETHASH_DAG_HEADER_SIZE
+	uint32_t state;               ///< One of enum ethash_dag_state
+	uint32_t items;               ///< Leading DAG items on disk while building
+};
+
+/// First word of a complete light cache file
+#define ETHASH_CACHE_MAGIC_NUM 0xCAC4EDBADDCAFE01ULL
+/// Size of the light cache file header. A whole node, so that the cache
+/// nodes after it stay aligned in a mapping of the file.
+#define ETHASH_CACHE_HEADER_SIZE 64
+
+/// Layout of the first ETHASH_CACHE_HEADER_SIZE bytes of a light cache file.
+/// Like the DAG magic number it is in host byte order, the file is local.
+struct ethash_cache_header {
+	uint64_t magic;
+	uint64_t cache_size;
+	ethash_h256_t seedhash;
+	uint64_t checksum;
+	uint64_t reserved;
 };
 
 // small hack for windows. I don't feel I should use va_args and forward just
@@ -74,7 +130,9 @@ enum ethash_io_rc {
 /**
  * Prepares io for ethash
  *
- * Create the DAG directory and the DAG file if they don't exist.
+ * Create the DAG directory and the DAG file if they don't exist. A version 1
+ * DAG file of the same revision and seedhash is copied to a version 2 file and
+ * removed, as far as it was generated.
  *
  * @param[in] dirname        A null terminated c-string of the path of the ethash
  *                           data directory. If it does not exist it's created.
@@ -99,6 +157,190 @@ enum ethash_io_rc ethash_io_prepare(
 	bool force_create
 );
 
+/**
+ * Open the DAG file for writing slices of it, creating it if it does not
+ * exist. Unlike @ref ethash_io_prepare() an existing file is never truncated,
+ * whatever its state, so several writers can share it.
+ *
+ * @param dirname        The ethash data directory. If it does not exist it's created.
+ * @param seedhash       The seedhash the file is named after
+ * @return               The file opened for reading and writing or NULL on failure
+ */
+FILE* ethash_io_open_dag(char const* dirname, ethash_h256_t const seedhash);
+
+/**
+ * Write a slice of the DAG to its place in the DAG file. The file grows as
+ * needed, with nothing written to the parts of it before the slice.
+ *
+ * @param f            The DAG file
+ * @param data         The bytes of the slice
+ * @param offset       Offset of the slice in the DAG
+ * @param len          Size of the slice in bytes
+ * @return             true for success and false otherwise
+ */
+bool ethash_io_write_slice(FILE* f, void const* data, uint64_t offset, uint64_t len);
+
+/**
+ * Write part of a DAG from memory to its file, which has the DAG right after
+ * the header
+ *
+ * The data goes out in chunks with explicit writes. Writeback of each chunk
+ * starts as soon as it is written, and is waited for before the chunk after
+ * next, whose pages are then dropped from the page cache. So the DAG never
+ * piles up as dirty pages, whatever its size.
+ *
+ * @param f            The DAG file as returned by @ref ethash_io_prepare()
+ * @param data         The DAG. Everything before @a end must be computed.
+ * @param size         The size of the DAG in bytes
+ * @param begin        Offset in the DAG of the first byte to write
+ * @param end          Offset in the DAG past the last byte to write
+ * @param direct       Bypass the page cache with O_DIRECT where the platform and
+ *                     the filesystem support it. This may overwrite the file
+ *                     past @a end.
+ * @param rate         Maximum bytes written per second. 0 means no limit.
+ * @return             true for success and false otherwise
+ */
+bool ethash_io_write_dag(
+	FILE* f,
+	void const* data,
+	uint64_t size,
+	uint64_t begin,
+	uint64_t end,
+	bool direct,
+	uint64_t rate
+);
+
+/**
+ * Flush a file stream and wait until its data is on disk
+ *
+ * @param f            The file stream to sync
+ * @return             true for success and false otherwise
+ */
+bool ethash_io_sync(FILE* f);
+
+/**
+ * Write the header of a version 2 DAG file
+ *
+ * @param f            The DAG file
+ * @param seedhash     The seedhash of the DAG
+ * @param dag_size     The size of the DAG in bytes
+ * @param state        One of enum ethash_dag_state
+ * @param items        Number of leading DAG items that are on disk
+ * @return             true for success and false otherwise
+ */
+bool ethash_io_write_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t dag_size,
+	uint32_t state,
+	uint32_t items
+);
+
+/**
+ * Read the header of a version 2 DAG file and check that it describes a DAG
+ * of @a seedhash and @a dag_size of this revision. A valid header leaves the
+ * stream at the start of the DAG.
+ *
+ * @param f            The DAG file
+ * @param seedhash     The seedhash of the DAG
+ * @param dag_size     The size of the DAG in bytes
+ * @param[out] header  The header
+ * @return             true if the header is valid and false otherwise
+ */
+bool ethash_io_read_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t dag_size,
+	struct ethash_dag_header* header
+);
+
+/**
+ * Update the build state in the header of a version 2 DAG file
+ *
+ * @param f            The DAG file
+ * @param state        One of enum ethash_dag_state
+ * @param items        Number of leading DAG items that are on disk
+ * @return             true for success and false otherwise
+ */
+bool ethash_io_set_dag_state(FILE* f, uint32_t state, uint32_t items);
+
+/**
+ * Durably record that the first @a items DAG items of an incomplete DAG file
+ * are on disk. The items themselves must be synced before.
+ *
+ * @param f            The DAG file
+ * @param items        Number of leading DAG items that are complete
+ * @return             true for success and false otherwise
+ */
+bool ethash_io_write_watermark(FILE* f, uint32_t items);
+
+/**
+ * Read the progress recorded by @ref ethash_io_write_watermark()
+ *
+ * @param f            The DAG file
+ * @param[out] items   Number of leading DAG items that are complete
+ * @return             true if the file is an incomplete DAG and false otherwise
+ */
+bool ethash_io_read_watermark(FILE* f, uint32_t* items);
+
+/**
+ * Map the light cache file of @a seedhash read-only, if there is a valid one
+ *
+ * The file is only used if its magic number, cache size, seedhash and
+ * checksum all match, so a truncated or corrupted file is never trusted.
+ *
+ * @param dirname        The ethash data directory
+ * @param seedhash       The seedhash the cache was computed from
+ * @param cache_size     The size of the cache in bytes
+ * @return               The cache nodes, to be released with
+ *                       @ref ethash_io_unmap_cache(), or NULL if there is no
+ *                       valid file
+ */
+void* ethash_io_map_cache(char const* dirname, ethash_h256_t const seedhash, uint64_t cache_size);
+
+/**
+ * Release a cache mapped by @ref ethash_io_map_cache()
+ *
+ * @param cache          The cache nodes as returned by @ref ethash_io_map_cache()
+ * @param cache_size     The size of the cache in bytes
+ */
+void ethash_io_unmap_cache(void* cache, uint64_t cache_size);
+
+/**
+ * Read the light cache file of @a seedhash into memory, if there is a valid one.
+ * For caches that live in memory a mapping can't provide, like huge pages.
+ *
+ * @param dirname        The ethash data directory
+ * @param seedhash       The seedhash the cache was computed from
+ * @param cache          Where the cache nodes go. Undefined on failure.
+ * @param cache_size     The size of the cache in bytes
+ * @return               true if a valid cache was read and false otherwise
+ */
+bool ethash_io_read_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	void* cache,
+	uint64_t cache_size
+);
+
+/**
+ * Write a computed light cache to its file. The file is written under a
+ * temporary name of its own and renamed into place, so readers only ever see a
+ * complete file or none, even with several writers at once.
+ *
+ * @param dirname        The ethash data directory. If it does not exist it's created.
+ * @param seedhash       The seedhash the cache was computed from
+ * @param cache          The cache nodes
+ * @param cache_size     The size of the cache in bytes
+ * @return               true for success and false otherwise
+ */
+bool ethash_io_write_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	void const* cache,
+	uint64_t cache_size
+);
+
 /**
  * An fopen wrapper for no-warnings crossplatform fopen.
  *
@@ -157,6 +399,16 @@ bool ethash_file_size(FILE* f, size_t* ret_size);
  */
 int ethash_fileno(FILE* f);
 
+/**
+ * Create a file next to @a filename, under a name no other thread or process
+ * gets, to be written and then renamed over @a filename.
+ *
+ * @param filename     The name of the file the new one is to replace
+ * @param tmpname      Set to the name of the new file. User must deallocate.
+ * @return             The new file, open for reading and writing, or NULL
+ */
+FILE* ethash_io_create_tmpfile(char const* filename, char** tmpname);
+
 /**
  * Create the filename for the DAG.
  *
@@ -197,6 +449,33 @@ static inline bool ethash_io_mutable_name(
     return snprintf(output, DAG_MUTABLE_NAME_MAX_SIZE, "full-R%u-%016" PRIx64, revision, hash) >= 0;
 }
 
+/// Name of the version 2 DAG file, @ref ethash_io_mutable_name() is the version 1 one
+static inline bool ethash_io_mutable_name_v2(
+	uint32_t revision,
+	ethash_h256_t const* seed_hash,
+	char* output
+)
+{
+    uint64_t hash = *((uint64_t*)seed_hash);
+#if LITTLE_ENDIAN == BYTE_ORDER
+    hash = ethash_swap_u64(hash);
+#endif
+    return snprintf(output, DAG_MUTABLE_NAME_MAX_SIZE, "full-v2-R%u-%016" PRIx64, revision, hash) >= 0;
+}
+
+static inline bool ethash_io_cache_mutable_name(
+	uint32_t revision,
+	ethash_h256_t const* seed_hash,
+	char* output
+)
+{
+    uint64_t hash = *((uint64_t*)seed_hash);
+#if LITTLE_ENDIAN == BYTE_ORDER
+    hash = ethash_swap_u64(hash);
+#endif
+    return snprintf(output, CACHE_MUTABLE_NAME_MAX_SIZE, "cache-R%u-%016" PRIx64, revision, hash) >= 0;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,16 +19,30 @@
  * @date 2015
  */
 
+#ifndef _GNU_SOURCE
+// for sync_file_range() and O_DIRECT
+#define _GNU_SOURCE
+#endif
+
 #include "io.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <pwd.h>
 
+// Size of the writes of ethash_io_write_dag()
+#define ETHASH_IO_WRITE_CHUNK ((size_t)8 << 20)
+// Alignment of O_DIRECT buffers, offsets and sizes. Good for any block size up to 4K
+#define ETHASH_IO_DIRECT_ALIGN 4096
+ETHASH_STATIC_ASSERT(ETHASH_DAG_HEADER_SIZE % ETHASH_IO_DIRECT_ALIGN == 0, direct_writes_skip_the_dag_header);
+
 FILE* ethash_fopen(char const* file_name, char const* mode)
 {
 	return fopen(file_name, mode);
@@ -75,6 +89,31 @@ char* ethash_io_create_filename(
 	return name;
 }
 
+FILE* ethash_io_create_tmpfile(char const* filename, char** tmpname)
+{
+	size_t const tmp_size = strlen(filename) + 8;
+	char* name = malloc(tmp_size);
+	if (!name) {
+		return NULL;
+	}
+	snprintf(name, tmp_size, "%s.XXXXXX", filename);
+	int const fd = mkstemp(name);
+	if (fd == -1) {
+		free(name);
+		return NULL;
+	}
+	// mkstemp() makes the file private, the one it replaces is not
+	FILE* f = fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0 ? fdopen(fd, "wb+") : NULL;
+	if (!f) {
+		close(fd);
+		remove(name);
+		free(name);
+		return NULL;
+	}
+	*tmpname = name;
+	return f;
+}
+
 bool ethash_file_size(FILE* f, size_t* ret_size)
 {
 	struct stat st;
@@ -86,6 +125,183 @@ bool ethash_file_size(FILE* f, size_t* ret_size)
 	return true;
 }
 
+static bool ethash_io_pwrite(int fd, uint8_t const* buf, size_t len, uint64_t offset)
+{
+	while (len) {
+		ssize_t const n = pwrite(fd, buf, len, (off_t)offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		buf += n;
+		len -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+/**
+ * Start writing back a range of the file or, with @a wait, wait until it is
+ * on disk and drop it from the page cache
+ */
+static void ethash_io_writeback(int fd, uint64_t offset, uint64_t len, bool wait)
+{
+#if defined(__linux__)
+	if (!wait) {
+		sync_file_range(fd, (off_t)offset, (off_t)len, SYNC_FILE_RANGE_WRITE);
+		return;
+	}
+	sync_file_range(
+		fd,
+		(off_t)offset,
+		(off_t)len,
+		SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER
+	);
+	posix_fadvise(fd, (off_t)offset, (off_t)len, POSIX_FADV_DONTNEED);
+#else
+	(void)offset;
+	(void)len;
+	if (wait) {
+		fsync(fd);
+	}
+#endif
+}
+
+static void ethash_io_throttle(struct timespec const* start, uint64_t written, uint64_t rate)
+{
+	if (!rate) {
+		return;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double const elapsed = (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+	double const ahead = (double)written / (double)rate - elapsed;
+	if (ahead > 0) {
+		struct timespec t;
+		t.tv_sec = (time_t)ahead;
+		t.tv_nsec = (long)((ahead - (double)t.tv_sec) * 1e9);
+		nanosleep(&t, NULL);
+	}
+}
+
+/**
+ * Fill an O_DIRECT buffer with the file bytes at @a offset: the DAG, then zero
+ * padding past the end of the file. The header is a whole number of blocks, so
+ * the buffer never covers it.
+ */
+static void ethash_io_fill_direct(uint8_t* buf, size_t len, uint8_t const* src, uint64_t size, uint64_t offset)
+{
+	uint64_t const to = offset + len < size + ETHASH_DAG_HEADER_SIZE ?
+		offset + len : size + ETHASH_DAG_HEADER_SIZE;
+	memset(buf, 0, len);
+	if (offset < to) {
+		memcpy(buf, src + (offset - ETHASH_DAG_HEADER_SIZE), (size_t)(to - offset));
+	}
+}
+
+bool ethash_io_write_dag(
+	FILE* f,
+	void const* data,
+	uint64_t size,
+	uint64_t begin,
+	uint64_t end,
+	bool direct,
+	uint64_t rate
+)
+{
+	int const fd = fileno(f);
+	if (fd == -1 || fflush(f) != 0) {
+		return false;
+	}
+	uint8_t const* src = (uint8_t const*)data;
+	uint64_t const file_size = size + ETHASH_DAG_HEADER_SIZE;
+	uint8_t* bounce = NULL;
+	int flags = 0;
+	bool ret = false;
+#if defined(O_DIRECT)
+	if (direct) {
+		flags = fcntl(fd, F_GETFL);
+		if (flags == -1 ||
+			posix_memalign((void**)&bounce, ETHASH_IO_DIRECT_ALIGN, ETHASH_IO_WRITE_CHUNK) != 0) {
+			bounce = NULL;
+		} else if (fcntl(fd, F_SETFL, flags | O_DIRECT) != 0) {
+			// e.g. tmpfs. Carry on with buffered writes
+			free(bounce);
+			bounce = NULL;
+		}
+	}
+#else
+	(void)direct;
+#endif
+
+	// Direct writes need aligned offsets so they start at the block holding
+	// the first byte and are padded up to the next block
+	uint64_t const stop = end + ETHASH_DAG_HEADER_SIZE;
+	uint64_t offset = begin + ETHASH_DAG_HEADER_SIZE;
+	if (bounce) {
+		offset &= ~(uint64_t)(ETHASH_IO_DIRECT_ALIGN - 1);
+	}
+	uint64_t const first = offset;
+	uint64_t prev_offset = 0, prev_len = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (offset < stop) {
+		size_t len = stop - offset < ETHASH_IO_WRITE_CHUNK ? (size_t)(stop - offset) : ETHASH_IO_WRITE_CHUNK;
+		if (bounce) {
+			len = (len + ETHASH_IO_DIRECT_ALIGN - 1) & ~(size_t)(ETHASH_IO_DIRECT_ALIGN - 1);
+			ethash_io_fill_direct(bounce, len, src, size, offset);
+			if (!ethash_io_pwrite(fd, bounce, len, offset)) {
+				goto out;
+			}
+		} else {
+			if (!ethash_io_pwrite(fd, src + offset - ETHASH_DAG_HEADER_SIZE, len, offset)) {
+				goto out;
+			}
+			ethash_io_writeback(fd, offset, len, false);
+			if (prev_len) {
+				ethash_io_writeback(fd, prev_offset, prev_len, true);
+			}
+			prev_offset = offset;
+			prev_len = len;
+		}
+		offset += len;
+		ethash_io_throttle(&start, offset - first, rate);
+	}
+	if (prev_len) {
+		ethash_io_writeback(fd, prev_offset, prev_len, true);
+	}
+	ret = true;
+
+out:
+	if (bounce) {
+		fcntl(fd, F_SETFL, flags);
+		free(bounce);
+		// the last direct write may have been padded past the end of the file
+		if (ret && offset > file_size && ftruncate(fd, (off_t)file_size) != 0) {
+			ret = false;
+		}
+		if (!ret) {
+			// some filesystems accept O_DIRECT but reject the writes
+			return ethash_io_write_dag(f, data, size, begin, end, false, rate);
+		}
+	}
+	return ret;
+}
+
+bool ethash_io_write_slice(FILE* f, void const* data, uint64_t offset, uint64_t len)
+{
+	int const fd = fileno(f);
+	return fd != -1 && fflush(f) == 0 &&
+		ethash_io_pwrite(fd, (uint8_t const*)data, (size_t)len, offset + ETHASH_DAG_HEADER_SIZE);
+}
+
+bool ethash_io_sync(FILE* f)
+{
+	return fflush(f) == 0 && fsync(fileno(f)) == 0;
+}
+
 bool ethash_get_default_dirname(char* strbuf, size_t buffsize)
 {
 	static const char dir_suffix[] = ".ethash/";
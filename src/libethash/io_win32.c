@@ -21,12 +21,17 @@
 
 #include "io.h"
 #include <direct.h>
+#include <io.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <shlobj.h>
 
+// Size of the writes of ethash_io_write_dag()
+#define ETHASH_IO_WRITE_CHUNK ((size_t)8 << 20)
+
 FILE* ethash_fopen(char const* file_name, char const* mode)
 {
 	FILE* f;
@@ -74,6 +79,37 @@ char* ethash_io_create_filename(
 	return name;
 }
 
+FILE* ethash_io_create_tmpfile(char const* filename, char** tmpname)
+{
+	static volatile LONG counter = 0;
+	size_t const tmp_size = strlen(filename) + 2 * 10 + 7;
+	char* name = malloc(tmp_size);
+	if (!name) {
+		return NULL;
+	}
+	for (unsigned tries = 0; tries != 100; ++tries) {
+		_snprintf_s(name, tmp_size, _TRUNCATE, "%s.%lu.%lu.tmp",
+			filename, (unsigned long)GetCurrentProcessId(), (unsigned long)InterlockedIncrement(&counter));
+		int const fd = _open(name, _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY, _S_IREAD | _S_IWRITE);
+		if (fd == -1) {
+			if (errno == EEXIST) {
+				continue;
+			}
+			break;
+		}
+		FILE* f = _fdopen(fd, "wb+");
+		if (!f) {
+			_close(fd);
+			remove(name);
+			break;
+		}
+		*tmpname = name;
+		return f;
+	}
+	free(name);
+	return NULL;
+}
+
 bool ethash_file_size(FILE* f, size_t* ret_size)
 {
 	struct _stat st;
@@ -85,6 +121,53 @@ bool ethash_file_size(FILE* f, size_t* ret_size)
 	return true;
 }
 
+bool ethash_io_write_dag(
+	FILE* f,
+	void const* data,
+	uint64_t size,
+	uint64_t begin,
+	uint64_t end,
+	bool direct,
+	uint64_t rate
+)
+{
+	// Windows can't flush part of a file, so only the rate cap applies here
+	(void)size;
+	(void)direct;
+	uint8_t const* src = (uint8_t const*)data;
+	ULONGLONG const start = GetTickCount64();
+	if (_fseeki64(f, (__int64)(begin + ETHASH_DAG_HEADER_SIZE), SEEK_SET) != 0) {
+		return false;
+	}
+	for (uint64_t done = begin; done < end;) {
+		size_t const len = end - done < ETHASH_IO_WRITE_CHUNK ? (size_t)(end - done) : ETHASH_IO_WRITE_CHUNK;
+		if (fwrite(src + done, 1, len, f) != len || fflush(f) != 0) {
+			return false;
+		}
+		done += len;
+		if (rate) {
+			ULONGLONG const due = start + (done - begin) * 1000 / rate;
+			ULONGLONG const now = GetTickCount64();
+			if (due > now) {
+				Sleep((DWORD)(due - now));
+			}
+		}
+	}
+	return true;
+}
+
+bool ethash_io_write_slice(FILE* f, void const* data, uint64_t offset, uint64_t len)
+{
+	return _fseeki64(f, (__int64)(offset + ETHASH_DAG_HEADER_SIZE), SEEK_SET) == 0 &&
+		fwrite(data, 1, (size_t)len, f) == len &&
+		fflush(f) == 0;
+}
+
+bool ethash_io_sync(FILE* f)
+{
+	return fflush(f) == 0 && _commit(_fileno(f)) == 0;
+}
+
 bool ethash_get_default_dirname(char* strbuf, size_t buffsize)
 {
 	static const char dir_suffix[] = "Ethash\\";
@@ -0,0 +1,118 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file keccak_lanes.h
+ * @date 2015
+ *
+ * A Keccak-f[1600] round over a state of 25 SIMD registers, where every
+ * vector element is the same lane of an independent Keccak state. Used by
+ * the multi-buffer kernels to run several permutations in lockstep.
+ *
+ * Before expanding ETHASH_KECCAK_ROUND_LANES() define:
+ *   ETHASH_LANE_T               the vector type
+ *   ETHASH_LANE_XOR(a, b)       a ^ b
+ *   ETHASH_LANE_XOR5(a, ..., e) a ^ b ^ c ^ d ^ e
+ *   ETHASH_LANE_CHI(a, b, c)    a ^ (~b & c)
+ *   ETHASH_LANE_ROL(a, n)       rotate every 64-bit element left by n
+ *   ETHASH_LANE_SET1(x)         broadcast a 64-bit constant
+ */
+#pragma once
+#include <stdint.h>
+
+static const uint64_t ethash_keccakf_rc[24] = {
+	0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+	0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+	0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+	0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+	0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+	0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+// Lane 8 of a Keccak-512 block holding a single 64 byte message:
+// the 0x01 domain byte right after the message and the final 0x80 pad bit
+#define ETHASH_KECCAK512_PAD64 0x8000000000000001ULL
+
+// Theta, rho, pi, chi and iota over the 25 lanes of A, with round constant RC
+#define ETHASH_KECCAK_ROUND_LANES(A, RC) do { \
+	ETHASH_LANE_T C0_, C1_, C2_, C3_, C4_, D_; \
+	ETHASH_LANE_T B_[25]; \
+	C0_ = ETHASH_LANE_XOR5((A)[0], (A)[5], (A)[10], (A)[15], (A)[20]); \
+	C1_ = ETHASH_LANE_XOR5((A)[1], (A)[6], (A)[11], (A)[16], (A)[21]); \
+	C2_ = ETHASH_LANE_XOR5((A)[2], (A)[7], (A)[12], (A)[17], (A)[22]); \
+	C3_ = ETHASH_LANE_XOR5((A)[3], (A)[8], (A)[13], (A)[18], (A)[23]); \
+	C4_ = ETHASH_LANE_XOR5((A)[4], (A)[9], (A)[14], (A)[19], (A)[24]); \
+	D_ = ETHASH_LANE_XOR(C4_, ETHASH_LANE_ROL(C1_, 1)); \
+	(A)[0] = ETHASH_LANE_XOR((A)[0], D_); (A)[5] = ETHASH_LANE_XOR((A)[5], D_); (A)[10] = ETHASH_LANE_XOR((A)[10], D_); (A)[15] = ETHASH_LANE_XOR((A)[15], D_); (A)[20] = ETHASH_LANE_XOR((A)[20], D_); \
+	D_ = ETHASH_LANE_XOR(C0_, ETHASH_LANE_ROL(C2_, 1)); \
+	(A)[1] = ETHASH_LANE_XOR((A)[1], D_); (A)[6] = ETHASH_LANE_XOR((A)[6], D_); (A)[11] = ETHASH_LANE_XOR((A)[11], D_); (A)[16] = ETHASH_LANE_XOR((A)[16], D_); (A)[21] = ETHASH_LANE_XOR((A)[21], D_); \
+	D_ = ETHASH_LANE_XOR(C1_, ETHASH_LANE_ROL(C3_, 1)); \
+	(A)[2] = ETHASH_LANE_XOR((A)[2], D_); (A)[7] = ETHASH_LANE_XOR((A)[7], D_); (A)[12] = ETHASH_LANE_XOR((A)[12], D_); (A)[17] = ETHASH_LANE_XOR((A)[17], D_); (A)[22] = ETHASH_LANE_XOR((A)[22], D_); \
+	D_ = ETHASH_LANE_XOR(C2_, ETHASH_LANE_ROL(C4_, 1)); \
+	(A)[3] = ETHASH_LANE_XOR((A)[3], D_); (A)[8] = ETHASH_LANE_XOR((A)[8], D_); (A)[13] = ETHASH_LANE_XOR((A)[13], D_); (A)[18] = ETHASH_LANE_XOR((A)[18], D_); (A)[23] = ETHASH_LANE_XOR((A)[23], D_); \
+	D_ = ETHASH_LANE_XOR(C3_, ETHASH_LANE_ROL(C0_, 1)); \
+	(A)[4] = ETHASH_LANE_XOR((A)[4], D_); (A)[9] = ETHASH_LANE_XOR((A)[9], D_); (A)[14] = ETHASH_LANE_XOR((A)[14], D_); (A)[19] = ETHASH_LANE_XOR((A)[19], D_); (A)[24] = ETHASH_LANE_XOR((A)[24], D_); \
+	B_[0] = (A)[0]; \
+	B_[10] = ETHASH_LANE_ROL((A)[1], 1); \
+	B_[20] = ETHASH_LANE_ROL((A)[2], 62); \
+	B_[5] = ETHASH_LANE_ROL((A)[3], 28); \
+	B_[15] = ETHASH_LANE_ROL((A)[4], 27); \
+	B_[16] = ETHASH_LANE_ROL((A)[5], 36); \
+	B_[1] = ETHASH_LANE_ROL((A)[6], 44); \
+	B_[11] = ETHASH_LANE_ROL((A)[7], 6); \
+	B_[21] = ETHASH_LANE_ROL((A)[8], 55); \
+	B_[6] = ETHASH_LANE_ROL((A)[9], 20); \
+	B_[7] = ETHASH_LANE_ROL((A)[10], 3); \
+	B_[17] = ETHASH_LANE_ROL((A)[11], 10); \
+	B_[2] = ETHASH_LANE_ROL((A)[12], 43); \
+	B_[12] = ETHASH_LANE_ROL((A)[13], 25); \
+	B_[22] = ETHASH_LANE_ROL((A)[14], 39); \
+	B_[23] = ETHASH_LANE_ROL((A)[15], 41); \
+	B_[8] = ETHASH_LANE_ROL((A)[16], 45); \
+	B_[18] = ETHASH_LANE_ROL((A)[17], 15); \
+	B_[3] = ETHASH_LANE_ROL((A)[18], 21); \
+	B_[13] = ETHASH_LANE_ROL((A)[19], 8); \
+	B_[14] = ETHASH_LANE_ROL((A)[20], 18); \
+	B_[24] = ETHASH_LANE_ROL((A)[21], 2); \
+	B_[9] = ETHASH_LANE_ROL((A)[22], 61); \
+	B_[19] = ETHASH_LANE_ROL((A)[23], 56); \
+	B_[4] = ETHASH_LANE_ROL((A)[24], 14); \
+	(A)[0] = ETHASH_LANE_CHI(B_[0], B_[1], B_[2]); \
+	(A)[1] = ETHASH_LANE_CHI(B_[1], B_[2], B_[3]); \
+	(A)[2] = ETHASH_LANE_CHI(B_[2], B_[3], B_[4]); \
+	(A)[3] = ETHASH_LANE_CHI(B_[3], B_[4], B_[0]); \
+	(A)[4] = ETHASH_LANE_CHI(B_[4], B_[0], B_[1]); \
+	(A)[5] = ETHASH_LANE_CHI(B_[5], B_[6], B_[7]); \
+	(A)[6] = ETHASH_LANE_CHI(B_[6], B_[7], B_[8]); \
+	(A)[7] = ETHASH_LANE_CHI(B_[7], B_[8], B_[9]); \
+	(A)[8] = ETHASH_LANE_CHI(B_[8], B_[9], B_[5]); \
+	(A)[9] = ETHASH_LANE_CHI(B_[9], B_[5], B_[6]); \
+	(A)[10] = ETHASH_LANE_CHI(B_[10], B_[11], B_[12]); \
+	(A)[11] = ETHASH_LANE_CHI(B_[11], B_[12], B_[13]); \
+	(A)[12] = ETHASH_LANE_CHI(B_[12], B_[13], B_[14]); \
+	(A)[13] = ETHASH_LANE_CHI(B_[13], B_[14], B_[10]); \
+	(A)[14] = ETHASH_LANE_CHI(B_[14], B_[10], B_[11]); \
+	(A)[15] = ETHASH_LANE_CHI(B_[15], B_[16], B_[17]); \
+	(A)[16] = ETHASH_LANE_CHI(B_[16], B_[17], B_[18]); \
+	(A)[17] = ETHASH_LANE_CHI(B_[17], B_[18], B_[19]); \
+	(A)[18] = ETHASH_LANE_CHI(B_[18], B_[19], B_[15]); \
+	(A)[19] = ETHASH_LANE_CHI(B_[19], B_[15], B_[16]); \
+	(A)[20] = ETHASH_LANE_CHI(B_[20], B_[21], B_[22]); \
+	(A)[21] = ETHASH_LANE_CHI(B_[21], B_[22], B_[23]); \
+	(A)[22] = ETHASH_LANE_CHI(B_[22], B_[23], B_[24]); \
+	(A)[23] = ETHASH_LANE_CHI(B_[23], B_[24], B_[20]); \
+	(A)[24] = ETHASH_LANE_CHI(B_[24], B_[20], B_[21]); \
+	(A)[0] = ETHASH_LANE_XOR((A)[0], ETHASH_LANE_SET1(RC)); \
+} while (0)
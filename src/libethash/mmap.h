@@ -38,8 +38,11 @@
 #define MAP_ANON      MAP_ANONYMOUS
 #define MAP_FAILED    ((void *) -1)
 
+#define MS_SYNC       0x04
+
 void* mmap(void* start, size_t length, int prot, int flags, int fd, off_t offset);
 void munmap(void* addr, size_t length);
+int msync(void* addr, size_t length, int flags);
 #else // posix, yay! ^_^
 #include <sys/mman.h>
 #endif
@@ -80,5 +80,11 @@ void munmap(void* addr, size_t length)
 	UnmapViewOfFile(addr);
 }
 
+int msync(void* addr, size_t length, int flags)
+{
+	// FlushViewOfFile() only starts the writes. Callers sync the file after.
+	return FlushViewOfFile(addr, length) ? 0 : -1;
+}
+
 #undef DWORD_HI
 #undef DWORD_LO
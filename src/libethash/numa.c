@@ -0,0 +1,238 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file numa.c
+ * @date 2015
+ */
+
+#ifndef _GNU_SOURCE
+// for sched_getcpu()
+#define _GNU_SOURCE
+#endif
+
+#include "numa.h"
+#include "ethash.h"
+#include "thread.h"
+
+#if defined(__linux__)
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From <numaif.h>, which comes with libnuma rather than the C library
+#define ETHASH_MPOL_BIND 2
+#define ETHASH_MPOL_INTERLEAVE 3
+#define ETHASH_MPOL_MF_MOVE (1 << 1)
+
+#define ETHASH_NUMA_MAX_CPUS 4096
+#define ETHASH_LONG_BITS (8 * sizeof(unsigned long))
+
+/**
+ * Parse a sysfs list such as "0-3,8,10-11" into a bit mask of @a max_bits bits
+ */
+static bool ethash_numa_read_list(char const* path, unsigned long* mask, unsigned max_bits)
+{
+	char buf[4096];
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		return false;
+	}
+	size_t const n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+
+	memset(mask, 0, max_bits / 8);
+	char const* s = buf;
+	while (*s >= '0' && *s <= '9') {
+		unsigned long first = strtoul(s, (char**)&s, 10);
+		unsigned long last = first;
+		if (*s == '-') {
+			last = strtoul(s + 1, (char**)&s, 10);
+		}
+		for (unsigned long i = first; i <= last && i < max_bits; ++i) {
+			mask[i / ETHASH_LONG_BITS] |= 1UL << (i % ETHASH_LONG_BITS);
+		}
+		if (*s == ',') {
+			++s;
+		}
+	}
+	return true;
+}
+
+uint64_t ethash_numa_online(void)
+{
+	unsigned long mask[ETHASH_NUMA_MAX_NODES / ETHASH_LONG_BITS];
+	if (!ethash_numa_read_list("/sys/devices/system/node/online", mask, ETHASH_NUMA_MAX_NODES)) {
+		return 1;
+	}
+	uint64_t ret = 0;
+	for (unsigned i = 0; i != ETHASH_NUMA_MAX_NODES; ++i) {
+		if (mask[i / ETHASH_LONG_BITS] & (1UL << (i % ETHASH_LONG_BITS))) {
+			ret |= (uint64_t)1 << i;
+		}
+	}
+	return ret ? ret : 1;
+}
+
+static bool ethash_numa_node_cpus(unsigned id, unsigned long* mask)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+	return ethash_numa_read_list(path, mask, ETHASH_NUMA_MAX_CPUS);
+}
+
+// Node of every CPU, read once so that finding the node of the calling thread
+// takes no system call. Full hashes do it to pick their DAG replica.
+static uint8_t ethash_numa_cpu_nodes[ETHASH_NUMA_MAX_CPUS];
+static ethash_once_t ethash_numa_cpu_nodes_once = ETHASH_ONCE_INIT;
+
+static void ethash_numa_cpu_nodes_init(void)
+{
+	unsigned long mask[ETHASH_NUMA_MAX_CPUS / ETHASH_LONG_BITS];
+	uint64_t const online = ethash_numa_online();
+	for (unsigned id = 0; id != ETHASH_NUMA_MAX_NODES; ++id) {
+		if (!((online >> id) & 1) || !ethash_numa_node_cpus(id, mask)) {
+			continue;
+		}
+		for (unsigned cpu = 0; cpu != ETHASH_NUMA_MAX_CPUS; ++cpu) {
+			if (mask[cpu / ETHASH_LONG_BITS] & (1UL << (cpu % ETHASH_LONG_BITS))) {
+				ethash_numa_cpu_nodes[cpu] = (uint8_t)id;
+			}
+		}
+	}
+}
+
+unsigned ethash_numa_current(void)
+{
+	ethash_call_once(&ethash_numa_cpu_nodes_once, ethash_numa_cpu_nodes_init);
+	// served by the vDSO, unlike the getcpu system call
+	int const cpu = sched_getcpu();
+	if (cpu >= 0 && cpu < ETHASH_NUMA_MAX_CPUS) {
+		return ethash_numa_cpu_nodes[cpu];
+	}
+	unsigned node;
+	if (syscall(SYS_getcpu, NULL, &node, NULL) != 0 || node >= ETHASH_NUMA_MAX_NODES) {
+		return 0;
+	}
+	return node;
+}
+
+bool ethash_numa_bind_thread_to(unsigned id)
+{
+	unsigned long mask[ETHASH_NUMA_MAX_CPUS / ETHASH_LONG_BITS];
+	if (!ethash_numa_node_cpus(id, mask)) {
+		return false;
+	}
+	// pid 0 is the calling thread
+	return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0;
+}
+
+static bool ethash_numa_mbind(void* p, size_t size, int mode, uint64_t nodes)
+{
+	unsigned long mask[ETHASH_NUMA_MAX_NODES / ETHASH_LONG_BITS];
+	for (unsigned i = 0; i != ETHASH_NUMA_MAX_NODES / ETHASH_LONG_BITS; ++i) {
+		mask[i] = (unsigned long)(nodes >> (i * ETHASH_LONG_BITS));
+	}
+	return syscall(
+		SYS_mbind,
+		p,
+		size,
+		mode,
+		mask,
+		ETHASH_NUMA_MAX_NODES + 1,
+		ETHASH_MPOL_MF_MOVE
+	) == 0;
+}
+
+bool ethash_numa_interleave(void* p, size_t size, uint64_t nodes)
+{
+	return ethash_numa_mbind(p, size, ETHASH_MPOL_INTERLEAVE, nodes);
+}
+
+bool ethash_numa_bind_memory(void* p, size_t size, unsigned id)
+{
+	return ethash_numa_mbind(p, size, ETHASH_MPOL_BIND, (uint64_t)1 << id);
+}
+
+#else
+
+uint64_t ethash_numa_online(void)
+{
+	return 1;
+}
+
+unsigned ethash_numa_current(void)
+{
+	return 0;
+}
+
+bool ethash_numa_bind_thread_to(unsigned id)
+{
+	(void)id;
+	return false;
+}
+
+bool ethash_numa_interleave(void* p, size_t size, uint64_t nodes)
+{
+	(void)p;
+	(void)size;
+	(void)nodes;
+	return false;
+}
+
+bool ethash_numa_bind_memory(void* p, size_t size, unsigned id)
+{
+	(void)p;
+	(void)size;
+	(void)id;
+	return false;
+}
+
+#endif // __linux__
+
+unsigned ethash_numa_node_id(unsigned index)
+{
+	uint64_t const online = ethash_numa_online();
+	for (unsigned id = 0; id != ETHASH_NUMA_MAX_NODES; ++id) {
+		if ((online >> id) & 1) {
+			if (index == 0) {
+				return id;
+			}
+			--index;
+		}
+	}
+	return ETHASH_NUMA_MAX_NODES;
+}
+
+unsigned ethash_numa_nodes(void)
+{
+	uint64_t online = ethash_numa_online();
+	unsigned ret = 0;
+	for (; online; online &= online - 1) {
+		++ret;
+	}
+	return ret;
+}
+
+bool ethash_numa_bind_thread(unsigned node)
+{
+	unsigned const id = ethash_numa_node_id(node);
+	return id < ETHASH_NUMA_MAX_NODES && ethash_numa_bind_thread_to(id);
+}
@@ -0,0 +1,73 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file numa.h
+ * @date 2015
+ *
+ * NUMA topology, memory and thread placement. Implemented with raw Linux
+ * system calls so there is no dependency on libnuma. On other platforms the
+ * machine looks like a single node and placement requests are ignored.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Node ids at or above this are ignored
+#define ETHASH_NUMA_MAX_NODES 64
+
+/**
+ * Get the ids of the online NUMA nodes as a bit mask. Never returns 0.
+ */
+uint64_t ethash_numa_online(void);
+
+/**
+ * Get the id of the n-th online node, or ETHASH_NUMA_MAX_NODES if there are
+ * fewer nodes
+ */
+unsigned ethash_numa_node_id(unsigned index);
+
+/**
+ * Get the id of the node the calling thread currently runs on. Cheap enough
+ * to call for every hash: the CPU comes from the vDSO and its node from a
+ * table read once.
+ */
+unsigned ethash_numa_current(void);
+
+/**
+ * Restrict the calling thread to the CPUs of node @a id
+ */
+bool ethash_numa_bind_thread_to(unsigned id);
+
+/**
+ * Interleave the pages of a page aligned region over the nodes in @a nodes.
+ * Pages that were already touched are migrated.
+ */
+bool ethash_numa_interleave(void* p, size_t size, uint64_t nodes);
+
+/**
+ * Place the pages of a page aligned region on node @a id. Pages that were
+ * already touched are migrated.
+ */
+bool ethash_numa_bind_memory(void* p, size_t size, unsigned id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,120 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file pages.c
+ * @date 2015
+ */
+
+#include <stdlib.h>
+#include "pages.h"
+#include "mmap.h"
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if defined(__linux__)
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+// Kernels before 3.8 ignore the size bits and use the default huge page size
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+static size_t ethash_pages_round(size_t size, ethash_pages_t pages)
+{
+	size_t align;
+	switch (pages) {
+	case ETHASH_PAGES_1GB:
+		align = (size_t)1 << 30;
+		break;
+	case ETHASH_PAGES_2MB:
+		align = (size_t)1 << 21;
+		break;
+	default:
+		return size;
+	}
+	return (size + align - 1) & ~(align - 1);
+}
+
+void* ethash_pages_alloc(size_t size, ethash_pages_t requested, ethash_pages_t* got)
+{
+	void* ret;
+#if defined(__linux__)
+	for (int pages = (int)requested; pages >= ETHASH_PAGES_2MB; --pages) {
+		int const flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+			(pages == ETHASH_PAGES_1GB ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+		ret = mmap(
+			NULL,
+			ethash_pages_round(size, (ethash_pages_t)pages),
+			PROT_READ | PROT_WRITE,
+			flags,
+			-1,
+			0
+		);
+		if (ret != MAP_FAILED) {
+			*got = (ethash_pages_t)pages;
+			return ret;
+		}
+	}
+#endif
+	ret = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ret == MAP_FAILED) {
+		return NULL;
+	}
+	*got = ETHASH_PAGES_NORMAL;
+#if defined(MADV_HUGEPAGE)
+	if (requested != ETHASH_PAGES_NORMAL && madvise(ret, size, MADV_HUGEPAGE) == 0) {
+		*got = ETHASH_PAGES_TRANSPARENT;
+	}
+#endif
+	return ret;
+}
+
+void ethash_pages_free(void* p, size_t size, ethash_pages_t pages)
+{
+	munmap(p, ethash_pages_round(size, pages));
+}
+
+void* ethash_aligned_alloc(size_t size, size_t alignment)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(size, alignment);
+#else
+	void* ret;
+	return posix_memalign(&ret, alignment, size) == 0 ? ret : NULL;
+#endif
+}
+
+void ethash_aligned_free(void* p)
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file pages.h
+ * @date 2015
+ *
+ * Anonymous memory backed by huge pages and aligned heap memory, for the DAG
+ * and the light cache
+ */
+#pragma once
+#include <stddef.h>
+#include "ethash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocate zeroed anonymous memory, backed by pages of the requested size if possible
+ *
+ * Explicit huge pages (MAP_HUGETLB) are tried from @a requested down to 2MB.
+ * If the huge page pool can't satisfy the request the memory is mapped with
+ * normal pages and advised to be merged into transparent huge pages.
+ *
+ * @param size           Number of bytes to allocate
+ * @param requested      The preferred page size
+ * @param[out] got       The page size actually obtained. Pass it to @ref ethash_pages_free()
+ * @return               The memory or NULL if out of memory
+ */
+void* ethash_pages_alloc(size_t size, ethash_pages_t requested, ethash_pages_t* got);
+
+/**
+ * Free memory obtained from @ref ethash_pages_alloc()
+ */
+void ethash_pages_free(void* p, size_t size, ethash_pages_t pages);
+
+/**
+ * Allocate heap memory aligned to @a alignment, a power of two multiple of sizeof(void*)
+ *
+ * @return               The memory or NULL if out of memory
+ */
+void* ethash_aligned_alloc(size_t size, size_t alignment);
+
+/**
+ * Free memory obtained from @ref ethash_aligned_alloc()
+ */
+void ethash_aligned_free(void* p);
+
+#ifdef __cplusplus
+}
+#endif
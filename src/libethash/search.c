@@ -0,0 +1,321 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file search.c
+ * @date 2015
+ *
+ * Multithreaded nonce search. Every worker owns a contiguous range of the
+ * nonce space and hashes it front to back in chunks. A worker that runs dry
+ * steals the upper half of the largest range left, so the threads stay busy
+ * until the whole space is covered and every nonce is tried exactly once.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+#include "io.h"
+#include "thread.h"
+
+// Nonces a worker claims at a time. Small enough to react to a stop request
+// within a few milliseconds, large enough to keep the range lock cold.
+#define ETHASH_SEARCH_CHUNK 256
+// Winners fetched from ethash_full_search() per call
+#define ETHASH_SEARCH_RESULTS 16
+
+struct ethash_search_worker {
+	struct ethash_search* search;
+	ethash_thread_t thread;
+	ethash_mutex_t lock;       // guards begin and end
+	uint64_t begin;            // remaining range, as offsets from start_nonce
+	uint64_t end;
+	uint64_t volatile hashes;
+	bool started;
+};
+
+struct ethash_search {
+	ethash_full_t full;
+	ethash_h256_t header_hash;
+	ethash_h256_t boundary;
+	uint64_t start_nonce;
+	ethash_search_callback_t callback;
+	void* context;
+	ethash_mutex_t callback_lock;
+	uint32_t volatile stop;
+	uint32_t volatile running;
+	bool joined;
+	unsigned num_workers;
+	struct ethash_search_worker* workers;
+};
+
+static bool ethash_search_claim(
+	struct ethash_search_worker* worker,
+	uint64_t* begin,
+	uint64_t* end
+)
+{
+	ethash_mutex_lock(worker->lock);
+	if (worker->begin != worker->end) {
+		*begin = worker->begin;
+		*end = worker->end - worker->begin < ETHASH_SEARCH_CHUNK ?
+			worker->end : worker->begin + ETHASH_SEARCH_CHUNK;
+		worker->begin = *end;
+		ethash_mutex_unlock(worker->lock);
+		return true;
+	}
+	ethash_mutex_unlock(worker->lock);
+	return false;
+}
+
+/**
+ * Move the upper half of the largest range left to @a thief. Only one range
+ * lock is ever held at a time so thieves can't deadlock each other.
+ */
+static bool ethash_search_steal(struct ethash_search_worker* thief)
+{
+	struct ethash_search* search = thief->search;
+	for (;;) {
+		struct ethash_search_worker* victim = NULL;
+		uint64_t victim_left = 0;
+		for (unsigned i = 0; i != search->num_workers; ++i) {
+			struct ethash_search_worker* w = &search->workers[i];
+			ethash_mutex_lock(w->lock);
+			uint64_t const left = w->end - w->begin;
+			ethash_mutex_unlock(w->lock);
+			if (left > victim_left) {
+				victim = w;
+				victim_left = left;
+			}
+		}
+		if (!victim) {
+			return false;
+		}
+		uint64_t begin, end;
+		ethash_mutex_lock(victim->lock);
+		uint64_t const left = victim->end - victim->begin;
+		if (left == 0) {
+			// drained since we looked, pick another one
+			ethash_mutex_unlock(victim->lock);
+			continue;
+		}
+		end = victim->end;
+		begin = left <= ETHASH_SEARCH_CHUNK ? victim->begin : victim->end - left / 2;
+		victim->end = begin;
+		ethash_mutex_unlock(victim->lock);
+
+		ethash_mutex_lock(thief->lock);
+		thief->begin = begin;
+		thief->end = end;
+		ethash_mutex_unlock(thief->lock);
+		return true;
+	}
+}
+
+static void* ethash_search_worker(void* arg)
+{
+	struct ethash_search_worker* worker = (struct ethash_search_worker*)arg;
+	struct ethash_search* search = worker->search;
+	ethash_search_result_t results[ETHASH_SEARCH_RESULTS];
+	uint64_t begin, end;
+
+	if (search->full->numa != ETHASH_NUMA_NONE) {
+		unsigned const nodes = ethash_numa_nodes();
+		if (nodes > 1) {
+			// ethash_full_search() then reads the DAG copy of this node
+			ethash_numa_bind_thread((unsigned)(worker - search->workers) % nodes);
+		}
+	}
+	while (!ethash_atomic_load_u32(&search->stop)) {
+		if (!ethash_search_claim(worker, &begin, &end)) {
+			if (!ethash_search_steal(worker)) {
+				break;
+			}
+			continue;
+		}
+		while (begin != end) {
+			uint64_t const nonce = search->start_nonce + begin;
+			unsigned const found = ethash_full_search(
+				search->full,
+				search->header_hash,
+				nonce,
+				end - begin,
+				&search->boundary,
+				results,
+				ETHASH_SEARCH_RESULTS
+			);
+			// a full results array means the call stopped at its last winner
+			uint64_t const done = found == ETHASH_SEARCH_RESULTS ?
+				results[found - 1].nonce - nonce + 1 : end - begin;
+			ethash_atomic_add_u64(&worker->hashes, done);
+			begin += done;
+			if (found == 0) {
+				continue;
+			}
+			ethash_mutex_lock(search->callback_lock);
+			for (unsigned i = 0; i != found && !ethash_atomic_load_u32(&search->stop); ++i) {
+				if (search->callback(&results[i], search->context) != 0) {
+					ethash_atomic_store_u32(&search->stop, 1);
+				}
+			}
+			ethash_mutex_unlock(search->callback_lock);
+		}
+	}
+	ethash_atomic_add_u32(&search->running, (uint32_t)-1);
+	return NULL;
+}
+
+static void ethash_search_free(struct ethash_search* search)
+{
+	for (unsigned i = 0; i != search->num_workers; ++i) {
+		if (search->workers[i].lock) {
+			ethash_mutex_delete(search->workers[i].lock);
+		}
+	}
+	if (search->callback_lock) {
+		ethash_mutex_delete(search->callback_lock);
+	}
+	free(search->workers);
+	free(search);
+}
+
+ethash_search_t ethash_search_start(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	ethash_h256_t const* boundary,
+	uint64_t start_nonce,
+	uint64_t count,
+	unsigned threads,
+	ethash_search_callback_t callback,
+	void* context
+)
+{
+	if (!full || !boundary || !callback) {
+		return NULL;
+	}
+	struct ethash_search* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (threads == 0) {
+		threads = ethash_hardware_concurrency();
+	}
+	if (count == 0) {
+		count = UINT64_MAX;
+	}
+	if (threads > count) {
+		threads = (unsigned)count;
+	}
+	ret->full = full;
+	ret->header_hash = header_hash;
+	ret->boundary = *boundary;
+	ret->start_nonce = start_nonce;
+	ret->callback = callback;
+	ret->context = context;
+	ret->workers = calloc(threads, sizeof(struct ethash_search_worker));
+	ret->callback_lock = ethash_mutex_new();
+	if (!ret->workers || !ret->callback_lock) {
+		goto fail_free_search;
+	}
+	ret->num_workers = threads;
+
+	uint64_t const share = count / threads;
+	uint64_t const rest = count % threads;
+	uint64_t begin = 0;
+	for (unsigned i = 0; i != threads; ++i) {
+		struct ethash_search_worker* w = &ret->workers[i];
+		w->search = ret;
+		w->lock = ethash_mutex_new();
+		if (!w->lock) {
+			goto fail_free_search;
+		}
+		w->begin = begin;
+		w->end = begin + share + (i < rest ? 1 : 0);
+		begin = w->end;
+	}
+
+	// A thread that fails to start just leaves its range to be stolen
+	unsigned started = 0;
+	for (unsigned i = 0; i != threads; ++i) {
+		ethash_atomic_add_u32(&ret->running, 1);
+		if (!ethash_thread_create(&ret->workers[i].thread, ethash_search_worker, &ret->workers[i])) {
+			ethash_atomic_add_u32(&ret->running, (uint32_t)-1);
+			continue;
+		}
+		ret->workers[i].started = true;
+		++started;
+	}
+	if (started == 0) {
+		ETHASH_CRITICAL("Could not start any search thread");
+		goto fail_free_search;
+	}
+	return ret;
+
+fail_free_search:
+	ethash_search_free(ret);
+	return NULL;
+}
+
+void ethash_search_stop(ethash_search_t search)
+{
+	ethash_atomic_store_u32(&search->stop, 1);
+}
+
+bool ethash_search_finished(ethash_search_t search)
+{
+	return ethash_atomic_load_u32(&search->running) == 0;
+}
+
+void ethash_search_wait(ethash_search_t search)
+{
+	if (search->joined) {
+		return;
+	}
+	for (unsigned i = 0; i != search->num_workers; ++i) {
+		if (search->workers[i].started) {
+			ethash_thread_join(search->workers[i].thread);
+		}
+	}
+	search->joined = true;
+}
+
+unsigned ethash_search_threads(ethash_search_t search)
+{
+	return search->num_workers;
+}
+
+uint64_t ethash_search_thread_hashes(ethash_search_t search, unsigned thread)
+{
+	if (thread >= search->num_workers) {
+		return 0;
+	}
+	return ethash_atomic_load_u64(&search->workers[thread].hashes);
+}
+
+uint64_t ethash_search_hashes(ethash_search_t search)
+{
+	uint64_t ret = 0;
+	for (unsigned i = 0; i != search->num_workers; ++i) {
+		ret += ethash_atomic_load_u64(&search->workers[i].hashes);
+	}
+	return ret;
+}
+
+void ethash_search_delete(ethash_search_t search)
+{
+	ethash_search_stop(search);
+	ethash_search_wait(search);
+	ethash_search_free(search);
+}
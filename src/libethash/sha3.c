@@ -7,6 +7,7 @@
 * but not liability.
 */
 #include "sha3.h"
+#include "dispatch.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -15,93 +16,184 @@
 
 /******** The Keccak-f[1600] permutation ********/
 
-/*** Constants. ***/
-static const uint8_t rho[24] = \
-	{ 1,  3,   6, 10, 15, 21,
-	  28, 36, 45, 55,  2, 14,
-	  27, 41, 56,  8, 25, 43,
-	  62, 18, 39, 61, 20, 44};
-static const uint8_t pi[24] = \
-	{10,  7, 11, 17, 18, 3,
-	 5, 16,  8, 21, 24, 4,
-	 15, 23, 19, 13, 12, 2,
-	 20, 14, 22,  9, 6,  1};
-static const uint64_t RC[24] = \
-	{1ULL, 0x8082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
-	 0x808bULL, 0x80000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
-	 0x8aULL, 0x88ULL, 0x80008009ULL, 0x8000000aULL,
-	 0x8000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
-	 0x8000000000008002ULL, 0x8000000000000080ULL, 0x800aULL, 0x800000008000000aULL,
-	 0x8000000080008081ULL, 0x8000000000008080ULL, 0x80000001ULL, 0x8000000080008008ULL};
-
-/*** Helper macros to unroll the permutation. ***/
-#define rol(x, s) (((x) << s) | ((x) >> (64 - s)))
-#define REPEAT6(e) e e e e e e
-#define REPEAT24(e) REPEAT6(e e e e)
-#define REPEAT5(e) e e e e e
-#define FOR5(v, s, e)							\
-	v = 0;										\
-	REPEAT5(e; v += s;)
-
-/*** Keccak-f[1600] ***/
-static inline void keccakf(void* state) {
-	uint64_t* a = (uint64_t*)state;
-	uint64_t b[5] = {0};
-	uint64_t t = 0;
-	uint8_t x, y;
-
-	for (int i = 0; i < 24; i++) {
-		// Theta
-		FOR5(x, 1,
-				b[x] = 0;
-				FOR5(y, 5,
-						b[x] ^= a[x + y]; ))
-		FOR5(x, 1,
-				FOR5(y, 5,
-						a[y + x] ^= b[(x + 4) % 5] ^ rol(b[(x + 1) % 5], 1); ))
-		// Rho and pi
-		t = a[1];
-		x = 0;
-		REPEAT24(b[0] = a[pi[x]];
-				a[pi[x]] = rol(t, rho[x]);
-				t = b[0];
-				x++; )
-		// Chi
-		FOR5(y,
-				5,
-				FOR5(x, 1,
-						b[x] = a[y + x];)
-				FOR5(x, 1,
-				a[y + x] = b[x] ^ ((~b[(x + 1) % 5]) & b[(x + 2) % 5]); ))
-		// Iota
-		a[0] ^= RC[i];
-	}
+/*
+ * Fully unrolled, with the 25 lanes in local variables so the compiler can
+ * keep as many of them in registers as the target allows. Rounds alternate
+ * between the A and E lane sets instead of copying the state back.
+ *
+ * Uses the lane complementing transform from the Keccak team's
+ * implementation overview: lanes be, bi, go, ki, mi and sa are kept
+ * complemented for the whole permutation, which turns all but one of the
+ * NOTs in every plane of chi into plain AND/OR.
+ */
+
+#define ROL64(x, s) (((x) << (s)) | ((x) >> (64 - (s))))
+
+// One round reading lane set A and writing lane set E
+#define KECCAK_ROUND(A, E, rc) \
+	Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa; \
+	Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se; \
+	Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si; \
+	Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so; \
+	Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su; \
+	Da = Cu ^ ROL64(Ce, 1); \
+	De = Ca ^ ROL64(Ci, 1); \
+	Di = Ce ^ ROL64(Co, 1); \
+	Do = Ci ^ ROL64(Cu, 1); \
+	Du = Co ^ ROL64(Ca, 1); \
+	Ba = A##ba ^ Da; Be = ROL64(A##ge ^ De, 44); Bi = ROL64(A##ki ^ Di, 43); \
+	Bo = ROL64(A##mo ^ Do, 21); Bu = ROL64(A##su ^ Du, 14); \
+	E##ba = Ba ^ (Be | Bi) ^ (rc); \
+	E##be = Be ^ (~Bi | Bo); \
+	E##bi = Bi ^ (Bo & Bu); \
+	E##bo = Bo ^ (Bu | Ba); \
+	E##bu = Bu ^ (Ba & Be); \
+	Ba = ROL64(A##bo ^ Do, 28); Be = ROL64(A##gu ^ Du, 20); Bi = ROL64(A##ka ^ Da, 3); \
+	Bo = ROL64(A##me ^ De, 45); Bu = ROL64(A##si ^ Di, 61); \
+	E##ga = Ba ^ (Be | Bi); \
+	E##ge = Be ^ (Bi & Bo); \
+	E##gi = Bi ^ (Bo | ~Bu); \
+	E##go = Bo ^ (Bu | Ba); \
+	E##gu = Bu ^ (Ba & Be); \
+	Ba = ROL64(A##be ^ De, 1); Be = ROL64(A##gi ^ Di, 6); Bi = ROL64(A##ko ^ Do, 25); \
+	Bo = ROL64(A##mu ^ Du, 8); Bu = ROL64(A##sa ^ Da, 18); \
+	E##ka = Ba ^ (Be | Bi); \
+	E##ke = Be ^ (Bi & Bo); \
+	E##ki = Bi ^ (~Bo & Bu); \
+	E##ko = ~Bo ^ (Bu | Ba); \
+	E##ku = Bu ^ (Ba & Be); \
+	Ba = ROL64(A##bu ^ Du, 27); Be = ROL64(A##ga ^ Da, 36); Bi = ROL64(A##ke ^ De, 10); \
+	Bo = ROL64(A##mi ^ Di, 15); Bu = ROL64(A##so ^ Do, 56); \
+	E##ma = Ba ^ (Be & Bi); \
+	E##me = Be ^ (Bi | Bo); \
+	E##mi = Bi ^ (~Bo | Bu); \
+	E##mo = ~Bo ^ (Bu & Ba); \
+	E##mu = Bu ^ (Ba | Be); \
+	Ba = ROL64(A##bi ^ Di, 62); Be = ROL64(A##go ^ Do, 55); Bi = ROL64(A##ku ^ Du, 39); \
+	Bo = ROL64(A##ma ^ Da, 41); Bu = ROL64(A##se ^ De, 2); \
+	E##sa = Ba ^ (~Be & Bi); \
+	E##se = ~Be ^ (Bi | Bo); \
+	E##si = Bi ^ (Bo & Bu); \
+	E##so = Bo ^ (Bu | Ba); \
+	E##su = Bu ^ (Ba & Be);
+
+
+void ethash_keccakf_scalar(uint64_t* a) {
+	uint64_t Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki, Ako, Aku, Ama, Ame,
+		Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu;
+	uint64_t Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku, Ema, Eme,
+		Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu;
+	uint64_t Ca, Ce, Ci, Co, Cu;
+	uint64_t Da, De, Di, Do, Du;
+	uint64_t Ba, Be, Bi, Bo, Bu;
+
+	Aba = a[0];
+	Abe = ~a[1];
+	Abi = ~a[2];
+	Abo = a[3];
+	Abu = a[4];
+	Aga = a[5];
+	Age = a[6];
+	Agi = a[7];
+	Ago = ~a[8];
+	Agu = a[9];
+	Aka = a[10];
+	Ake = a[11];
+	Aki = ~a[12];
+	Ako = a[13];
+	Aku = a[14];
+	Ama = a[15];
+	Ame = a[16];
+	Ami = ~a[17];
+	Amo = a[18];
+	Amu = a[19];
+	Asa = ~a[20];
+	Ase = a[21];
+	Asi = a[22];
+	Aso = a[23];
+	Asu = a[24];
+
+	KECCAK_ROUND(A, E, 0x0000000000000001ULL)
+	KECCAK_ROUND(E, A, 0x0000000000008082ULL)
+	KECCAK_ROUND(A, E, 0x800000000000808aULL)
+	KECCAK_ROUND(E, A, 0x8000000080008000ULL)
+	KECCAK_ROUND(A, E, 0x000000000000808bULL)
+	KECCAK_ROUND(E, A, 0x0000000080000001ULL)
+	KECCAK_ROUND(A, E, 0x8000000080008081ULL)
+	KECCAK_ROUND(E, A, 0x8000000000008009ULL)
+	KECCAK_ROUND(A, E, 0x000000000000008aULL)
+	KECCAK_ROUND(E, A, 0x0000000000000088ULL)
+	KECCAK_ROUND(A, E, 0x0000000080008009ULL)
+	KECCAK_ROUND(E, A, 0x000000008000000aULL)
+	KECCAK_ROUND(A, E, 0x000000008000808bULL)
+	KECCAK_ROUND(E, A, 0x800000000000008bULL)
+	KECCAK_ROUND(A, E, 0x8000000000008089ULL)
+	KECCAK_ROUND(E, A, 0x8000000000008003ULL)
+	KECCAK_ROUND(A, E, 0x8000000000008002ULL)
+	KECCAK_ROUND(E, A, 0x8000000000000080ULL)
+	KECCAK_ROUND(A, E, 0x000000000000800aULL)
+	KECCAK_ROUND(E, A, 0x800000008000000aULL)
+	KECCAK_ROUND(A, E, 0x8000000080008081ULL)
+	KECCAK_ROUND(E, A, 0x8000000000008080ULL)
+	KECCAK_ROUND(A, E, 0x0000000080000001ULL)
+	KECCAK_ROUND(E, A, 0x8000000080008008ULL)
+
+	a[0] = Aba;
+	a[1] = ~Abe;
+	a[2] = ~Abi;
+	a[3] = Abo;
+	a[4] = Abu;
+	a[5] = Aga;
+	a[6] = Age;
+	a[7] = Agi;
+	a[8] = ~Ago;
+	a[9] = Agu;
+	a[10] = Aka;
+	a[11] = Ake;
+	a[12] = ~Aki;
+	a[13] = Ako;
+	a[14] = Aku;
+	a[15] = Ama;
+	a[16] = Ame;
+	a[17] = ~Ami;
+	a[18] = Amo;
+	a[19] = Amu;
+	a[20] = ~Asa;
+	a[21] = Ase;
+	a[22] = Asi;
+	a[23] = Aso;
+	a[24] = Asu;
 }
 
+#undef KECCAK_ROUND
+#undef ROL64
+
 /******** The FIPS202-defined functions. ********/
 
-/*** Some helper macros. ***/
+/*** Some helper functions. ***/
 
-#define _(S) do { S } while (0)
-#define FOR(i, ST, L, S)							\
-	_(for (size_t i = 0; i < L; i += ST) { S; })
-#define mkapply_ds(NAME, S)						\
-	static inline void NAME(uint8_t* dst,			\
-		const uint8_t* src,						\
-		size_t len) {								\
-		FOR(i, 1, len, S);							\
+// Byte-wise xor/copy, but 8 bytes at a time while possible. Memory order is
+// preserved so this does not depend on the host endianness.
+static inline void xorin(uint8_t* dst, const uint8_t* src, size_t len) {
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t d, s;
+		memcpy(&d, dst + i, 8);
+		memcpy(&s, src + i, 8);
+		d ^= s;
+		memcpy(dst + i, &d, 8);
 	}
-#define mkapply_sd(NAME, S)						\
-	static inline void NAME(const uint8_t* src,	\
-		uint8_t* dst,								\
-		size_t len) {								\
-		FOR(i, 1, len, S);							\
+	for (; i < len; ++i) {
+		dst[i] ^= src[i];
 	}
+}
 
-mkapply_ds(xorin, dst[i] ^= src[i])  // xorin
-mkapply_sd(setout, dst[i] = src[i])  // setout
+static inline void setout(const uint8_t* src, uint8_t* dst, size_t len) {
+	memcpy(dst, src, len);
+}
 
-#define P keccakf
+// The permutation of the active backend, see dispatch.h
+#define P(a) ethash_kernels()->keccakf((uint64_t*)(a))
 #define Plen 200
 
 // Fold P*F over the full blocks of an input.
@@ -120,7 +212,9 @@ static inline int hash(uint8_t* out, size_t outlen,
 	if ((out == NULL) || ((in == NULL) && inlen != 0) || (rate >= Plen)) {
 		return -1;
 	}
-	uint8_t a[Plen] = {0};
+	// keccakf works on 64-bit lanes, so keep the state suitably aligned
+	uint64_t state[Plen / 8] = {0};
+	uint8_t* a = (uint8_t*)state;
 	// Absorb input.
 	foldP(in, inlen, xorin);
 	// Xor in the DS and pad frame.
@@ -137,6 +231,27 @@ static inline int hash(uint8_t* out, size_t outlen,
 	return 0;
 }
 
+/** Sponge for inputs that fit in a single block and whose length is known at
+ *  compile time. Lanes are loaded straight from the input and the digest is
+ *  copied straight out of the state. **/
+static inline void hash_single_block(uint8_t* out, size_t outlen,
+		const uint8_t* in, size_t inlen,
+		size_t rate, uint8_t delim) {
+	uint64_t state[Plen / 8] = {0};
+	uint8_t* a = (uint8_t*)state;
+	size_t i = 0;
+	for (; i + 8 <= inlen; i += 8) {
+		memcpy(&state[i / 8], in + i, 8);
+	}
+	for (; i < inlen; ++i) {
+		a[i] = in[i];
+	}
+	a[inlen] ^= delim;
+	a[rate - 1] ^= 0x80;
+	P(a);
+	memcpy(out, a, outlen);
+}
+
 #define defsha3(bits)													\
 	int sha3_##bits(uint8_t* out, size_t outlen,						\
 		const uint8_t* in, size_t inlen) {								\
@@ -149,3 +264,15 @@ static inline int hash(uint8_t* out, size_t outlen,
 /*** FIPS202 SHA3 FOFs ***/
 defsha3(256)
 defsha3(512)
+
+#define defsha3_fixed(bits, inlen)										\
+	void sha3_##bits##_##inlen(uint8_t* out, const uint8_t* in) {		\
+		hash_single_block(out, bits / 8, in, inlen, 200 - (bits / 4), 0x01);	\
+	}
+
+/*** Single block fast paths for the input sizes ethash uses ***/
+defsha3_fixed(256, 32)
+defsha3_fixed(256, 96)
+defsha3_fixed(512, 32)
+defsha3_fixed(512, 40)
+defsha3_fixed(512, 64)
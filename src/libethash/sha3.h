@@ -16,6 +16,15 @@ struct ethash_h256;
 decsha3(256)
 decsha3(512)
 
+#define decsha3_fixed(bits, inlen) \
+	void sha3_##bits##_##inlen(uint8_t*, uint8_t const*);
+
+decsha3_fixed(256, 32)
+decsha3_fixed(256, 96)
+decsha3_fixed(512, 32)
+decsha3_fixed(512, 40)
+decsha3_fixed(512, 64)
+
 static inline void SHA3_256(struct ethash_h256 const* ret, uint8_t const* data, size_t const size)
 {
 	sha3_256((uint8_t*)ret, 32, data, size);
@@ -26,6 +35,34 @@ static inline void SHA3_512(uint8_t* ret, uint8_t const* data, size_t const size
 	sha3_512(ret, 64, data, size);
 }
 
+// Fixed input length versions. SHA3_<digest bits>_<input bytes>. Input and
+// output may overlap.
+
+static inline void SHA3_256_32(struct ethash_h256 const* ret, uint8_t const* data)
+{
+	sha3_256_32((uint8_t*)ret, data);
+}
+
+static inline void SHA3_256_96(struct ethash_h256 const* ret, uint8_t const* data)
+{
+	sha3_256_96((uint8_t*)ret, data);
+}
+
+static inline void SHA3_512_32(uint8_t* ret, uint8_t const* data)
+{
+	sha3_512_32(ret, data);
+}
+
+static inline void SHA3_512_40(uint8_t* ret, uint8_t const* data)
+{
+	sha3_512_40(ret, data);
+}
+
+static inline void SHA3_512_64(uint8_t* ret, uint8_t const* data)
+{
+	sha3_512_64(ret, data);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,13 @@ struct ethash_h256;
 void SHA3_256(struct ethash_h256 const* ret, uint8_t const* data, size_t size);
 void SHA3_512(uint8_t* const ret, uint8_t const* data, size_t size);
 
+// CryptoPP has no fixed length versions, forward to the generic ones
+static inline void SHA3_256_32(struct ethash_h256 const* ret, uint8_t const* data) { SHA3_256(ret, data, 32); }
+static inline void SHA3_256_96(struct ethash_h256 const* ret, uint8_t const* data) { SHA3_256(ret, data, 96); }
+static inline void SHA3_512_32(uint8_t* ret, uint8_t const* data) { SHA3_512(ret, data, 32); }
+static inline void SHA3_512_40(uint8_t* ret, uint8_t const* data) { SHA3_512(ret, data, 40); }
+static inline void SHA3_512_64(uint8_t* ret, uint8_t const* data) { SHA3_512(ret, data, 64); }
+
 #ifdef __cplusplus
 }
 #endif
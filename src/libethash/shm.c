@@ -0,0 +1,258 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file shm.c
+ * @date 2015
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "shm.h"
+#include "internal.h"
+#include "io.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// "Local\" is the longest prefix, 10 digits of revision, 16 of seedhash
+#define ETHASH_SHM_NAME_MAX_SIZE (6 + 8 + 10 + 1 + 16 + 6)
+
+static void ethash_shm_name(ethash_h256_t const* seedhash, char const* suffix, char* output)
+{
+	uint64_t hash = *((uint64_t*)seedhash);
+#if LITTLE_ENDIAN == BYTE_ORDER
+	hash = ethash_swap_u64(hash);
+#endif
+	// short, some systems cap shared memory names at 31 characters
+#if defined(_WIN32)
+	snprintf(output, ETHASH_SHM_NAME_MAX_SIZE, "Local\\ethash-R%u-%016" PRIx64 "%s", ETHASH_REVISION, hash, suffix);
+#else
+	snprintf(output, ETHASH_SHM_NAME_MAX_SIZE, "/ethash-R%u-%016" PRIx64 "%s", ETHASH_REVISION, hash, suffix);
+#endif
+}
+
+static bool ethash_shm_valid(
+	struct ethash_cache_header const* header,
+	ethash_h256_t const* seedhash,
+	uint64_t cache_size
+)
+{
+	return header->magic == ETHASH_CACHE_MAGIC_NUM &&
+		header->cache_size == cache_size &&
+		memcmp(&header->seedhash, seedhash, sizeof(*seedhash)) == 0;
+}
+
+/**
+ * Fill zeroed shared memory with the header and the cache nodes, the magic
+ * number last. Called with the creation lock held.
+ */
+static bool ethash_shm_build(
+	uint8_t* mem,
+	ethash_h256_t const* seedhash,
+	uint64_t cache_size,
+	char const* dirname
+)
+{
+	void* cache = mem + ETHASH_CACHE_HEADER_SIZE;
+	if (!dirname || !ethash_io_read_cache(dirname, *seedhash, cache, cache_size)) {
+		if (!ethash_compute_cache_nodes((node*)cache, cache_size, seedhash)) {
+			return false;
+		}
+		if (dirname) {
+			ethash_io_write_cache(dirname, *seedhash, cache, cache_size);
+		}
+	}
+	struct ethash_cache_header* header = (struct ethash_cache_header*)mem;
+	header->cache_size = cache_size;
+	header->seedhash = *seedhash;
+	// not checked, the memory never leaves the host
+	header->checksum = 0;
+	header->magic = ETHASH_CACHE_MAGIC_NUM;
+	return true;
+}
+
+#if defined(_WIN32)
+
+void* ethash_shm_map_cache(ethash_h256_t const* seedhash, uint64_t cache_size, char const* dirname)
+{
+	char name[ETHASH_SHM_NAME_MAX_SIZE];
+	char lock_name[ETHASH_SHM_NAME_MAX_SIZE];
+	uint8_t* ret = NULL;
+	ethash_shm_name(seedhash, "", name);
+	ethash_shm_name(seedhash, "-lock", lock_name);
+	HANDLE lock = CreateMutexA(NULL, FALSE, lock_name);
+	if (!lock) {
+		return NULL;
+	}
+	// an abandoned mutex is ours too, its holder died before writing the header
+	DWORD const wait = WaitForSingleObject(lock, INFINITE);
+	if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+		CloseHandle(lock);
+		return NULL;
+	}
+	uint64_t const total = cache_size + ETHASH_CACHE_HEADER_SIZE;
+	HANDLE h = CreateFileMappingA(
+		INVALID_HANDLE_VALUE,
+		NULL,
+		PAGE_READWRITE,
+		(DWORD)(total >> 32),
+		(DWORD)total,
+		name
+	);
+	if (!h) {
+		goto unlock;
+	}
+	// fails if another process created the section smaller
+	uint8_t* mem = MapViewOfFile(h, FILE_MAP_WRITE, 0, 0, (SIZE_T)total);
+	// the views keep the section alive
+	CloseHandle(h);
+	if (!mem) {
+		goto unlock;
+	}
+	struct ethash_cache_header const* header = (struct ethash_cache_header const*)mem;
+	if (!ethash_shm_valid(header, seedhash, cache_size)) {
+		if (header->magic == ETHASH_CACHE_MAGIC_NUM ||
+			!ethash_shm_build(mem, seedhash, cache_size, dirname)) {
+			UnmapViewOfFile(mem);
+			goto unlock;
+		}
+	}
+	DWORD old;
+	VirtualProtect(mem, (SIZE_T)total, PAGE_READONLY, &old);
+	ret = mem + ETHASH_CACHE_HEADER_SIZE;
+unlock:
+	ReleaseMutex(lock);
+	CloseHandle(lock);
+	return ret;
+}
+
+void ethash_shm_unmap_cache(void* cache, uint64_t cache_size)
+{
+	(void)cache_size;
+	UnmapViewOfFile((uint8_t*)cache - ETHASH_CACHE_HEADER_SIZE);
+}
+
+bool ethash_shm_remove_cache(ethash_h256_t const* seedhash)
+{
+	// named sections go away with their last handle or view
+	(void)seedhash;
+	return true;
+}
+
+#else
+
+/**
+ * Give the empty shared memory object @a fd its @a total bytes. Only growing it
+ * with ftruncate() would leave it sparse, and a full /dev/shm would then kill
+ * the builder with SIGBUS on the first store to a page it can't have.
+ */
+static bool ethash_shm_reserve(int fd, size_t total)
+{
+#if defined(__APPLE__)
+	// no posix_fallocate(), and shm_open() objects are not sparse there
+	return ftruncate(fd, (off_t)total) == 0;
+#else
+	return posix_fallocate(fd, 0, (off_t)total) == 0;
+#endif
+}
+
+void* ethash_shm_map_cache(ethash_h256_t const* seedhash, uint64_t cache_size, char const* dirname)
+{
+	char name[ETHASH_SHM_NAME_MAX_SIZE];
+	uint8_t* ret = NULL;
+	ethash_shm_name(seedhash, "", name);
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		return NULL;
+	}
+	// the creation lock. Without flock() support the cache stays private.
+	if (flock(fd, LOCK_EX) != 0) {
+		goto close_fd;
+	}
+	size_t const total = (size_t)(cache_size + ETHASH_CACHE_HEADER_SIZE);
+	struct ethash_cache_header header;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		goto unlock;
+	}
+	memset(&header, 0, sizeof(header));
+	if (st.st_size >= ETHASH_CACHE_HEADER_SIZE &&
+		pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		goto unlock;
+	}
+	if ((size_t)st.st_size != total || !ethash_shm_valid(&header, seedhash, cache_size)) {
+		if (header.magic == ETHASH_CACHE_MAGIC_NUM) {
+			// a complete cache of another size, leave it to its users
+			goto unlock;
+		}
+		// zero whatever a dead builder left behind
+		if (ftruncate(fd, 0) != 0) {
+			goto unlock;
+		}
+		if (!ethash_shm_reserve(fd, total)) {
+			// the caller computes a private cache instead
+			ETHASH_CRITICAL("Not enough shared memory for the light cache");
+			shm_unlink(name);
+			goto unlock;
+		}
+		uint8_t* mem = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (mem == MAP_FAILED) {
+			ETHASH_CRITICAL("mmap failed for shared light cache");
+			goto unlock;
+		}
+		bool const built = ethash_shm_build(mem, seedhash, cache_size, dirname);
+		munmap(mem, total);
+		if (!built) {
+			if (ftruncate(fd, 0) != 0) {
+				ETHASH_CRITICAL("Could not reset shared light cache");
+			}
+			goto unlock;
+		}
+	}
+	uint8_t* mem = mmap(NULL, total, PROT_READ, MAP_SHARED, fd, 0);
+	if (mem != MAP_FAILED) {
+		ret = mem + ETHASH_CACHE_HEADER_SIZE;
+	}
+unlock:
+	flock(fd, LOCK_UN);
+close_fd:
+	close(fd);
+	return ret;
+}
+
+void ethash_shm_unmap_cache(void* cache, uint64_t cache_size)
+{
+	munmap(
+		(uint8_t*)cache - ETHASH_CACHE_HEADER_SIZE,
+		(size_t)(cache_size + ETHASH_CACHE_HEADER_SIZE)
+	);
+}
+
+bool ethash_shm_remove_cache(ethash_h256_t const* seedhash)
+{
+	char name[ETHASH_SHM_NAME_MAX_SIZE];
+	ethash_shm_name(seedhash, "", name);
+	return shm_unlink(name) == 0 || errno == ENOENT;
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file shm.h
+ * @date 2015
+ *
+ * Light caches in named shared memory, built by one process of the host and
+ * mapped read-only by the others
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "ethash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Map the shared light cache of @a seedhash, building it first if no process
+ * of the host has done so yet
+ *
+ * Builders are serialized by a creation lock that the operating system drops
+ * if its holder dies. The cache header is written last, so a build that was
+ * cut short is never used and the next process starts it over.
+ *
+ * @param seedhash       The seedhash of the cache
+ * @param cache_size     The size of the cache in bytes
+ * @param dirname        If not NULL, a builder first tries the cache file in
+ *                       this directory, see @ref ethash_io_read_cache(), and
+ *                       writes the file after computing the cache
+ * @return               The cache nodes, mapped read-only, or NULL if shared
+ *                       memory is not available. Release with @ref ethash_shm_unmap_cache()
+ */
+void* ethash_shm_map_cache(ethash_h256_t const* seedhash, uint64_t cache_size, char const* dirname);
+
+/**
+ * Release a cache mapped by @ref ethash_shm_map_cache()
+ */
+void ethash_shm_unmap_cache(void* cache, uint64_t cache_size);
+
+/**
+ * Remove the name of the shared light cache of @a seedhash. Existing mappings
+ * stay valid and the memory goes away with the last of them.
+ *
+ * @return               true if there is no such shared cache any more
+ */
+bool ethash_shm_remove_cache(ethash_h256_t const* seedhash);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,136 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file simd.h
+ * @date 2015
+ *
+ * x86-64 SIMD kernels. They are compiled with per-function target attributes
+ * so neither the rest of the library nor the single translation unit cgo
+ * build need any -m flags. They are selected at runtime through dispatch.h.
+ */
+#pragma once
+#include "internal.h"
+
+#if defined(__x86_64__) && (defined(__clang__) || __GNUC__ >= 5)
+#define ETHASH_SIMD_X86 1
+#define ETHASH_TARGET(isa_) __attribute__((target(isa_)))
+#else
+#define ETHASH_SIMD_X86 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Number of DAG items computed by a single call of the multi-buffer kernels
+#define ETHASH_AVX2_LANES 4
+#define ETHASH_AVX512_LANES 8
+
+/// The multi-buffer kernels gather cache words with signed 32-bit indices
+static inline bool ethash_simd_cache_fits(ethash_light_t const light)
+{
+	return light->cache_size / sizeof(uint32_t) <= INT32_MAX;
+}
+
+#if ETHASH_SIMD_X86
+
+/// Unroll helpers so the word a round reads is known at compile time and can
+/// be extracted straight from the registers holding the node or mix
+#define ETHASH_REPEAT16(m_) \
+	m_(0); m_(1); m_(2); m_(3); m_(4); m_(5); m_(6); m_(7); \
+	m_(8); m_(9); m_(10); m_(11); m_(12); m_(13); m_(14); m_(15)
+#define ETHASH_REPEAT32(m_) \
+	ETHASH_REPEAT16(m_); \
+	m_(16); m_(17); m_(18); m_(19); m_(20); m_(21); m_(22); m_(23); \
+	m_(24); m_(25); m_(26); m_(27); m_(28); m_(29); m_(30); m_(31)
+
+/// Keccak-f[1600] of a single state, with all 25 lanes held in the 32 xmm
+/// registers AVX-512VL provides
+void ethash_keccakf_avx512(uint64_t* state);
+
+/**
+ * Calculate ETHASH_AVX2_LANES DAG items at once. Bit-identical to calling
+ * @ref ethash_calculate_dag_item() for every index.
+ *
+ * @param ret           Output array of ETHASH_AVX2_LANES nodes
+ * @param node_index    The ETHASH_AVX2_LANES indices of the items to calculate
+ * @param light         The light handler containing the cache
+ */
+void ethash_calculate_dag_items_avx2(
+	node* const ret,
+	uint32_t const* node_index,
+	ethash_light_t const light
+);
+
+/// Same as @ref ethash_calculate_dag_items_avx2() but for ETHASH_AVX512_LANES items
+void ethash_calculate_dag_items_avx512(
+	node* const ret,
+	uint32_t const* node_index,
+	ethash_light_t const light
+);
+
+/**
+ * Single item versions of @ref ethash_calculate_dag_item_scalar(). The node
+ * stays in registers for all ETHASH_DATASET_PARENTS rounds and the parent
+ * indices are extracted from them directly.
+ */
+void ethash_calculate_dag_item_sse41(node* const ret, uint32_t node_index, ethash_light_t const light);
+void ethash_calculate_dag_item_avx2(node* const ret, uint32_t node_index, ethash_light_t const light);
+void ethash_calculate_dag_item_avx512(node* const ret, uint32_t node_index, ethash_light_t const light);
+
+/// Register resident versions of @ref ethash_hashimoto_mix_scalar()
+void ethash_hashimoto_mix_sse41(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+);
+void ethash_hashimoto_mix_avx2(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+);
+void ethash_hashimoto_mix_avx512(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+);
+
+/// @ref ethash_hashimoto_lanes() compiled for each instruction set. The AVX-512
+/// backend uses the AVX2 one: zmm vectors measured slower on a 128 byte mix.
+void ethash_hashimoto_lanes_sse41(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+);
+void ethash_hashimoto_lanes_avx2(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+);
+
+#endif // ETHASH_SIMD_X86
+
+#ifdef __cplusplus
+}
+#endif
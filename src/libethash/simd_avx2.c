@@ -0,0 +1,239 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file simd_avx2.c
+ * @date 2015
+ *
+ * AVX2 kernels. The multi-buffer DAG kernel keeps 4 Keccak states in 25 ymm
+ * registers (one 64-bit lane per item) and the 4 mixes word-major in 16 xmm
+ * registers, so the parent index math, FNV and the parent gathers of all 4
+ * items are issued together. The single item and hashimoto FNV kernels keep
+ * a node in 2 ymm registers and a mix in 4.
+ */
+
+#include "simd.h"
+#include "fnv.h"
+#include "keccak_lanes.h"
+
+#ifdef WITH_CRYPTOPP
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif // WITH_CRYPTOPP
+
+#if ETHASH_SIMD_X86
+#include <immintrin.h>
+
+#define ETHASH_LANE_T __m256i
+#define ETHASH_LANE_XOR(a_, b_) _mm256_xor_si256(a_, b_)
+#define ETHASH_LANE_XOR5(a_, b_, c_, d_, e_) \
+	_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a_, b_), _mm256_xor_si256(c_, d_)), e_)
+#define ETHASH_LANE_CHI(a_, b_, c_) _mm256_xor_si256(a_, _mm256_andnot_si256(b_, c_))
+#define ETHASH_LANE_ROL(a_, n_) _mm256_or_si256(_mm256_slli_epi64(a_, n_), _mm256_srli_epi64(a_, 64 - (n_)))
+#define ETHASH_LANE_SET1(x_) _mm256_set1_epi64x((long long)(x_))
+
+ETHASH_TARGET("avx2")
+static void ethash_keccakf_x4(__m256i* a)
+{
+	for (unsigned r = 0; r != 24; ++r) {
+		ETHASH_KECCAK_ROUND_LANES(a, ethash_keccakf_rc[r]);
+	}
+}
+
+#undef ETHASH_LANE_T
+#undef ETHASH_LANE_XOR
+#undef ETHASH_LANE_XOR5
+#undef ETHASH_LANE_CHI
+#undef ETHASH_LANE_ROL
+#undef ETHASH_LANE_SET1
+
+// Keccak-512 of the 64 byte messages already in lanes 0..7 of every state
+ETHASH_TARGET("avx2")
+static void ethash_keccak512_64_x4(__m256i* a)
+{
+	a[8] = _mm256_set1_epi64x((long long)ETHASH_KECCAK512_PAD64);
+	for (unsigned j = 9; j != 25; ++j) {
+		a[j] = _mm256_setzero_si256();
+	}
+	ethash_keccakf_x4(a);
+}
+
+ETHASH_TARGET("avx2")
+void ethash_calculate_dag_items_avx2(
+	node* const ret,
+	uint32_t const* node_index,
+	ethash_light_t const light
+)
+{
+	uint32_t const num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
+	uint32_t const* cache_words = (uint32_t const*) light->cache;
+	__m256i state[25];
+	__m128i mix[NODE_WORDS];
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	__m128i const index = _mm_loadu_si128((__m128i const*)node_index);
+	uint32_t offsets[ETHASH_AVX2_LANES];
+
+	for (unsigned k = 0; k != ETHASH_AVX2_LANES; ++k) {
+		offsets[k] = (node_index[k] % num_parent_nodes) * NODE_WORDS;
+	}
+	__m128i const init = _mm_loadu_si128((__m128i const*)offsets);
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		state[j] = _mm256_i32gather_epi64((long long const*)(cache_words + 2 * j), init, 4);
+	}
+	state[0] = _mm256_xor_si256(state[0], _mm256_cvtepu32_epi64(index));
+	ethash_keccak512_64_x4(state);
+
+	// split every 64-bit lane into its low and high word
+	__m256i const split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		__m256i const words = _mm256_permutevar8x32_epi32(state[j], split);
+		mix[2 * j] = _mm256_castsi256_si128(words);
+		mix[2 * j + 1] = _mm256_extracti128_si256(words, 1);
+	}
+
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		__m128i const seed = _mm_xor_si128(index, _mm_set1_epi32((int)i));
+		_mm_storeu_si128(
+			(__m128i*)offsets,
+			_mm_xor_si128(_mm_mullo_epi32(seed, fnv_prime), mix[i % NODE_WORDS])
+		);
+		for (unsigned k = 0; k != ETHASH_AVX2_LANES; ++k) {
+			offsets[k] = (offsets[k] % num_parent_nodes) * NODE_WORDS;
+		}
+		__m128i const parent = _mm_loadu_si128((__m128i const*)offsets);
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			__m128i const data = _mm_i32gather_epi32((int const*)(cache_words + w), parent, 4);
+			mix[w] = _mm_xor_si128(_mm_mullo_epi32(mix[w], fnv_prime), data);
+		}
+	}
+
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		state[j] = _mm256_or_si256(
+			_mm256_cvtepu32_epi64(mix[2 * j]),
+			_mm256_slli_epi64(_mm256_cvtepu32_epi64(mix[2 * j + 1]), 32)
+		);
+	}
+	ethash_keccak512_64_x4(state);
+
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		uint64_t lanes[ETHASH_AVX2_LANES];
+		_mm256_storeu_si256((__m256i*)lanes, state[j]);
+		for (unsigned k = 0; k != ETHASH_AVX2_LANES; ++k) {
+			ret[k].double_words[j] = lanes[k];
+		}
+	}
+}
+
+// Word k_ of the registers in y_. k_ must be a constant
+#define ETHASH_AVX2_WORD(y_, k_) ((uint32_t) _mm256_extract_epi32((y_)[(k_) / 8], (k_) % 8))
+
+// y = y * FNV_PRIME ^ data for the n 32 byte registers in y
+ETHASH_TARGET("avx2")
+static inline void ethash_fnv_avx2(__m256i* y, uint8_t const* data, unsigned n)
+{
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	for (unsigned j = 0; j != n; ++j) {
+		y[j] = _mm256_xor_si256(_mm256_mullo_epi32(y[j], fnv_prime), _mm256_loadu_si256((__m256i const*) data + j));
+	}
+}
+
+ETHASH_TARGET("avx2")
+void ethash_calculate_dag_item_avx2(
+	node* const ret,
+	uint32_t node_index,
+	ethash_light_t const light
+)
+{
+	uint32_t const num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
+	node const* cache_nodes = (node const*) light->cache;
+	__m256i y[NODE_WORDS / 8];
+
+	*ret = cache_nodes[node_index % num_parent_nodes];
+	ret->words[0] ^= node_index;
+	SHA3_512_64(ret->bytes, ret->bytes);
+	for (unsigned j = 0; j != NODE_WORDS / 8; ++j) {
+		y[j] = _mm256_loadu_si256((__m256i const*) ret->bytes + j);
+	}
+
+	// The word the next parent index is derived from is tracked in a scalar
+	// so the vector multiply stays off the dependency chain between parents
+	uint32_t word = ret->words[0];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; i += NODE_WORDS) {
+#define ETHASH_PARENT(k_) do { \
+		node const* parent = &cache_nodes[fnv_hash(node_index ^ (i + (k_)), word) % num_parent_nodes]; \
+		word = fnv_hash(ETHASH_AVX2_WORD(y, ((k_) + 1) % NODE_WORDS), parent->words[((k_) + 1) % NODE_WORDS]); \
+		ethash_fnv_avx2(y, parent->bytes, NODE_WORDS / 8); \
+	} while (0)
+		ETHASH_REPEAT16(ETHASH_PARENT);
+#undef ETHASH_PARENT
+	}
+
+	for (unsigned j = 0; j != NODE_WORDS / 8; ++j) {
+		_mm256_storeu_si256((__m256i*) ret->bytes + j, y[j]);
+	}
+	SHA3_512_64(ret->bytes, ret->bytes);
+}
+
+ETHASH_TARGET("avx2")
+void ethash_hashimoto_mix_avx2(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+)
+{
+	node tmp_nodes[MIX_NODES];
+	__m256i y[MIX_WORDS / 8];
+
+	for (unsigned j = 0; j != MIX_WORDS / 8; ++j) {
+		y[j] = _mm256_loadu_si256((__m256i const*) mix + j);
+	}
+
+	uint32_t word = mix->words[0];
+	for (uint32_t i = 0; i != ETHASH_ACCESSES; i += MIX_WORDS) {
+#define ETHASH_ACCESS(k_) do { \
+		uint32_t const index = fnv_hash(seed ^ (i + (k_)), word) % num_full_pages; \
+		node const* page = ethash_hashimoto_page(tmp_nodes, index, full_nodes, light); \
+		word = fnv_hash( \
+			ETHASH_AVX2_WORD(y, ((k_) + 1) % MIX_WORDS), \
+			page[((k_) + 1) % MIX_WORDS / NODE_WORDS].words[((k_) + 1) % NODE_WORDS] \
+		); \
+		ethash_fnv_avx2(y, page->bytes, MIX_WORDS / 8); \
+	} while (0)
+		ETHASH_REPEAT32(ETHASH_ACCESS);
+#undef ETHASH_ACCESS
+	}
+
+	for (unsigned j = 0; j != MIX_WORDS / 8; ++j) {
+		_mm256_storeu_si256((__m256i*) mix + j, y[j]);
+	}
+}
+
+ETHASH_TARGET("avx2")
+void ethash_hashimoto_lanes_avx2(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+)
+{
+	ethash_hashimoto_lanes(s_mix, full_nodes, num_full_pages, lanes);
+}
+
+#undef ETHASH_AVX2_WORD
+
+#endif // ETHASH_SIMD_X86
@@ -0,0 +1,253 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file simd_avx512.c
+ * @date 2015
+ *
+ * AVX-512 kernels. Same layout as the AVX2 multi-buffer kernel but 8 items
+ * wide: 25 zmm registers of Keccak state and 16 ymm registers of mix words.
+ * Theta and chi use vpternlogq and the rotations vprolq. The single item
+ * and hashimoto FNV kernels hold a whole node in one zmm register, and the
+ * single state Keccak uses the extra xmm16-31 registers of AVX-512VL.
+ */
+
+#include "simd.h"
+#include "fnv.h"
+#include "keccak_lanes.h"
+
+#ifdef WITH_CRYPTOPP
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif // WITH_CRYPTOPP
+
+#if ETHASH_SIMD_X86
+#include <immintrin.h>
+
+#define ETHASH_LANE_T __m512i
+#define ETHASH_LANE_XOR(a_, b_) _mm512_xor_si512(a_, b_)
+#define ETHASH_LANE_XOR5(a_, b_, c_, d_, e_) \
+	_mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(a_, b_, c_, 0x96), d_, e_, 0x96)
+#define ETHASH_LANE_CHI(a_, b_, c_) _mm512_ternarylogic_epi64(a_, b_, c_, 0xD2)
+#define ETHASH_LANE_ROL(a_, n_) _mm512_rol_epi64(a_, n_)
+#define ETHASH_LANE_SET1(x_) _mm512_set1_epi64((long long)(x_))
+
+ETHASH_TARGET("avx512f")
+static void ethash_keccakf_x8(__m512i* a)
+{
+	for (unsigned r = 0; r != 24; ++r) {
+		ETHASH_KECCAK_ROUND_LANES(a, ethash_keccakf_rc[r]);
+	}
+}
+
+#undef ETHASH_LANE_T
+#undef ETHASH_LANE_XOR
+#undef ETHASH_LANE_XOR5
+#undef ETHASH_LANE_CHI
+#undef ETHASH_LANE_ROL
+#undef ETHASH_LANE_SET1
+
+// The same round over a single state: one lane per xmm register, low half only
+#define ETHASH_LANE_T __m128i
+#define ETHASH_LANE_XOR(a_, b_) _mm_xor_si128(a_, b_)
+#define ETHASH_LANE_XOR5(a_, b_, c_, d_, e_) \
+	_mm_ternarylogic_epi64(_mm_ternarylogic_epi64(a_, b_, c_, 0x96), d_, e_, 0x96)
+#define ETHASH_LANE_CHI(a_, b_, c_) _mm_ternarylogic_epi64(a_, b_, c_, 0xD2)
+#define ETHASH_LANE_ROL(a_, n_) _mm_rol_epi64(a_, n_)
+#define ETHASH_LANE_SET1(x_) _mm_cvtsi64_si128((long long)(x_))
+
+ETHASH_TARGET("avx512f,avx512vl")
+void ethash_keccakf_avx512(uint64_t* state)
+{
+	__m128i a[25];
+	for (unsigned j = 0; j != 25; ++j) {
+		a[j] = _mm_cvtsi64_si128((long long) state[j]);
+	}
+	for (unsigned r = 0; r != 24; ++r) {
+		ETHASH_KECCAK_ROUND_LANES(a, ethash_keccakf_rc[r]);
+	}
+	for (unsigned j = 0; j != 25; ++j) {
+		state[j] = (uint64_t) _mm_cvtsi128_si64(a[j]);
+	}
+}
+
+#undef ETHASH_LANE_T
+#undef ETHASH_LANE_XOR
+#undef ETHASH_LANE_XOR5
+#undef ETHASH_LANE_CHI
+#undef ETHASH_LANE_ROL
+#undef ETHASH_LANE_SET1
+
+// Keccak-512 of the 64 byte messages already in lanes 0..7 of every state
+ETHASH_TARGET("avx512f")
+static void ethash_keccak512_64_x8(__m512i* a)
+{
+	a[8] = _mm512_set1_epi64((long long)ETHASH_KECCAK512_PAD64);
+	for (unsigned j = 9; j != 25; ++j) {
+		a[j] = _mm512_setzero_si512();
+	}
+	ethash_keccakf_x8(a);
+}
+
+ETHASH_TARGET("avx512f,avx2")
+void ethash_calculate_dag_items_avx512(
+	node* const ret,
+	uint32_t const* node_index,
+	ethash_light_t const light
+)
+{
+	uint32_t const num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
+	uint32_t const* cache_words = (uint32_t const*) light->cache;
+	__m512i state[25];
+	__m256i mix[NODE_WORDS];
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	__m256i const index = _mm256_loadu_si256((__m256i const*)node_index);
+	uint32_t offsets[ETHASH_AVX512_LANES];
+
+	for (unsigned k = 0; k != ETHASH_AVX512_LANES; ++k) {
+		offsets[k] = (node_index[k] % num_parent_nodes) * NODE_WORDS;
+	}
+	__m256i const init = _mm256_loadu_si256((__m256i const*)offsets);
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		state[j] = _mm512_i32gather_epi64(init, (void const*)(cache_words + 2 * j), 4);
+	}
+	state[0] = _mm512_xor_si512(state[0], _mm512_cvtepu32_epi64(index));
+	ethash_keccak512_64_x8(state);
+
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		mix[2 * j] = _mm512_cvtepi64_epi32(state[j]);
+		mix[2 * j + 1] = _mm512_cvtepi64_epi32(_mm512_srli_epi64(state[j], 32));
+	}
+
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		__m256i const seed = _mm256_xor_si256(index, _mm256_set1_epi32((int)i));
+		_mm256_storeu_si256(
+			(__m256i*)offsets,
+			_mm256_xor_si256(_mm256_mullo_epi32(seed, fnv_prime), mix[i % NODE_WORDS])
+		);
+		for (unsigned k = 0; k != ETHASH_AVX512_LANES; ++k) {
+			offsets[k] = (offsets[k] % num_parent_nodes) * NODE_WORDS;
+		}
+		__m256i const parent = _mm256_loadu_si256((__m256i const*)offsets);
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			__m256i const data = _mm256_i32gather_epi32((int const*)(cache_words + w), parent, 4);
+			mix[w] = _mm256_xor_si256(_mm256_mullo_epi32(mix[w], fnv_prime), data);
+		}
+	}
+
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		state[j] = _mm512_or_si512(
+			_mm512_cvtepu32_epi64(mix[2 * j]),
+			_mm512_slli_epi64(_mm512_cvtepu32_epi64(mix[2 * j + 1]), 32)
+		);
+	}
+	ethash_keccak512_64_x8(state);
+
+	for (unsigned j = 0; j != NODE_WORDS / 2; ++j) {
+		uint64_t lanes[ETHASH_AVX512_LANES];
+		_mm512_storeu_si512((void*)lanes, state[j]);
+		for (unsigned k = 0; k != ETHASH_AVX512_LANES; ++k) {
+			ret[k].double_words[j] = lanes[k];
+		}
+	}
+}
+
+// Word k_ of the registers in z_. k_ must be a constant
+#define ETHASH_AVX512_WORD(z_, k_) \
+	((uint32_t) _mm_extract_epi32(_mm512_extracti32x4_epi32((z_)[(k_) / 16], ((k_) % 16) / 4), (k_) % 4))
+
+// z = z * FNV_PRIME ^ data for the n 64 byte registers in z
+ETHASH_TARGET("avx512f")
+static inline void ethash_fnv_avx512(__m512i* z, uint8_t const* data, unsigned n)
+{
+	__m512i const fnv_prime = _mm512_set1_epi32(FNV_PRIME);
+	for (unsigned j = 0; j != n; ++j) {
+		z[j] = _mm512_xor_si512(_mm512_mullo_epi32(z[j], fnv_prime), _mm512_loadu_si512((__m512i const*) data + j));
+	}
+}
+
+ETHASH_TARGET("avx512f")
+void ethash_calculate_dag_item_avx512(
+	node* const ret,
+	uint32_t node_index,
+	ethash_light_t const light
+)
+{
+	uint32_t const num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
+	node const* cache_nodes = (node const*) light->cache;
+	__m512i z[1];
+
+	*ret = cache_nodes[node_index % num_parent_nodes];
+	ret->words[0] ^= node_index;
+	SHA3_512_64(ret->bytes, ret->bytes);
+	z[0] = _mm512_loadu_si512(ret->bytes);
+
+	// The word the next parent index is derived from is tracked in a scalar
+	// so the vector multiply stays off the dependency chain between parents
+	uint32_t word = ret->words[0];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; i += NODE_WORDS) {
+#define ETHASH_PARENT(k_) do { \
+		node const* parent = &cache_nodes[fnv_hash(node_index ^ (i + (k_)), word) % num_parent_nodes]; \
+		word = fnv_hash(ETHASH_AVX512_WORD(z, ((k_) + 1) % NODE_WORDS), parent->words[((k_) + 1) % NODE_WORDS]); \
+		ethash_fnv_avx512(z, parent->bytes, 1); \
+	} while (0)
+		ETHASH_REPEAT16(ETHASH_PARENT);
+#undef ETHASH_PARENT
+	}
+
+	_mm512_storeu_si512(ret->bytes, z[0]);
+	SHA3_512_64(ret->bytes, ret->bytes);
+}
+
+ETHASH_TARGET("avx512f")
+void ethash_hashimoto_mix_avx512(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+)
+{
+	node tmp_nodes[MIX_NODES];
+	__m512i z[MIX_NODES];
+
+	for (unsigned j = 0; j != MIX_NODES; ++j) {
+		z[j] = _mm512_loadu_si512(mix[j].bytes);
+	}
+
+	uint32_t word = mix->words[0];
+	for (uint32_t i = 0; i != ETHASH_ACCESSES; i += MIX_WORDS) {
+#define ETHASH_ACCESS(k_) do { \
+		uint32_t const index = fnv_hash(seed ^ (i + (k_)), word) % num_full_pages; \
+		node const* page = ethash_hashimoto_page(tmp_nodes, index, full_nodes, light); \
+		word = fnv_hash( \
+			ETHASH_AVX512_WORD(z, ((k_) + 1) % MIX_WORDS), \
+			page[((k_) + 1) % MIX_WORDS / NODE_WORDS].words[((k_) + 1) % NODE_WORDS] \
+		); \
+		ethash_fnv_avx512(z, page->bytes, MIX_NODES); \
+	} while (0)
+		ETHASH_REPEAT32(ETHASH_ACCESS);
+#undef ETHASH_ACCESS
+	}
+
+	for (unsigned j = 0; j != MIX_NODES; ++j) {
+		_mm512_storeu_si512(mix[j].bytes, z[j]);
+	}
+}
+
+#undef ETHASH_AVX512_WORD
+
+#endif // ETHASH_SIMD_X86
@@ -0,0 +1,136 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file simd_sse41.c
+ * @date 2015
+ *
+ * SSE4.1 FNV kernels. A node lives in 4 xmm registers and a mix in 8, so the
+ * parent and page index words are extracted from registers instead of being
+ * stored back to memory after every round.
+ */
+
+#include "simd.h"
+#include "fnv.h"
+
+#ifdef WITH_CRYPTOPP
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif // WITH_CRYPTOPP
+
+#if ETHASH_SIMD_X86
+#include <immintrin.h>
+
+// Word k_ of the registers in x_. k_ must be a constant
+#define ETHASH_SSE41_WORD(x_, k_) ((uint32_t) _mm_extract_epi32((x_)[(k_) / 4], (k_) % 4))
+
+// x = x * FNV_PRIME ^ data for the n 16 byte registers in x
+ETHASH_TARGET("sse4.1")
+static inline void ethash_fnv_sse41(__m128i* x, uint8_t const* data, unsigned n)
+{
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	for (unsigned j = 0; j != n; ++j) {
+		x[j] = _mm_xor_si128(_mm_mullo_epi32(x[j], fnv_prime), _mm_loadu_si128((__m128i const*) data + j));
+	}
+}
+
+ETHASH_TARGET("sse4.1")
+void ethash_calculate_dag_item_sse41(
+	node* const ret,
+	uint32_t node_index,
+	ethash_light_t const light
+)
+{
+	uint32_t const num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
+	node const* cache_nodes = (node const*) light->cache;
+	__m128i x[NODE_WORDS / 4];
+
+	*ret = cache_nodes[node_index % num_parent_nodes];
+	ret->words[0] ^= node_index;
+	SHA3_512_64(ret->bytes, ret->bytes);
+	for (unsigned j = 0; j != NODE_WORDS / 4; ++j) {
+		x[j] = _mm_loadu_si128((__m128i const*) ret->bytes + j);
+	}
+
+	// The word the next parent index is derived from is tracked in a scalar
+	// so the vector multiply stays off the dependency chain between parents
+	uint32_t word = ret->words[0];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; i += NODE_WORDS) {
+#define ETHASH_PARENT(k_) do { \
+		node const* parent = &cache_nodes[fnv_hash(node_index ^ (i + (k_)), word) % num_parent_nodes]; \
+		word = fnv_hash(ETHASH_SSE41_WORD(x, ((k_) + 1) % NODE_WORDS), parent->words[((k_) + 1) % NODE_WORDS]); \
+		ethash_fnv_sse41(x, parent->bytes, NODE_WORDS / 4); \
+	} while (0)
+		ETHASH_REPEAT16(ETHASH_PARENT);
+#undef ETHASH_PARENT
+	}
+
+	for (unsigned j = 0; j != NODE_WORDS / 4; ++j) {
+		_mm_storeu_si128((__m128i*) ret->bytes + j, x[j]);
+	}
+	SHA3_512_64(ret->bytes, ret->bytes);
+}
+
+ETHASH_TARGET("sse4.1")
+void ethash_hashimoto_mix_sse41(
+	node* mix,
+	uint32_t seed,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint32_t num_full_pages
+)
+{
+	node tmp_nodes[MIX_NODES];
+	__m128i x[MIX_WORDS / 4];
+
+	for (unsigned j = 0; j != MIX_WORDS / 4; ++j) {
+		x[j] = _mm_loadu_si128((__m128i const*) mix + j);
+	}
+
+	uint32_t word = mix->words[0];
+	for (uint32_t i = 0; i != ETHASH_ACCESSES; i += MIX_WORDS) {
+#define ETHASH_ACCESS(k_) do { \
+		uint32_t const index = fnv_hash(seed ^ (i + (k_)), word) % num_full_pages; \
+		node const* page = ethash_hashimoto_page(tmp_nodes, index, full_nodes, light); \
+		word = fnv_hash( \
+			ETHASH_SSE41_WORD(x, ((k_) + 1) % MIX_WORDS), \
+			page[((k_) + 1) % MIX_WORDS / NODE_WORDS].words[((k_) + 1) % NODE_WORDS] \
+		); \
+		ethash_fnv_sse41(x, page->bytes, MIX_WORDS / 4); \
+	} while (0)
+		ETHASH_REPEAT32(ETHASH_ACCESS);
+#undef ETHASH_ACCESS
+	}
+
+	for (unsigned j = 0; j != MIX_WORDS / 4; ++j) {
+		_mm_storeu_si128((__m128i*) mix + j, x[j]);
+	}
+}
+
+ETHASH_TARGET("sse4.1")
+void ethash_hashimoto_lanes_sse41(
+	node (*s_mix)[MIX_NODES + 1],
+	node const* full_nodes,
+	uint32_t num_full_pages,
+	unsigned lanes
+)
+{
+	ethash_hashimoto_lanes(s_mix, full_nodes, num_full_pages, lanes);
+}
+
+#undef ETHASH_SSE41_WORD
+
+#endif // ETHASH_SIMD_X86
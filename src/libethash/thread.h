@@ -0,0 +1,190 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file thread.h
+ * @date 2015
+ *
+ * Minimal cross-platform threading primitives used by libethash.
+ * Platform specific parts live in thread_posix.c and thread_win32.c
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "compiler.h"
+#include "ethash.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ethash_thread;
+typedef struct ethash_thread* ethash_thread_t;
+
+/**
+ * Start a new thread
+ *
+ * @param[out] thread    The handle of the new thread. Must be joined with
+ *                       @ref ethash_thread_join()
+ * @param[in] fn         The function to run in the new thread
+ * @param[in] arg        The argument to pass to @a fn
+ * @return               true if the thread was started and false otherwise
+ */
+bool ethash_thread_create(ethash_thread_t* thread, void* (*fn)(void*), void* arg);
+
+/**
+ * Wait for a thread to finish and free its handle
+ *
+ * @param thread         A thread handle obtained from @ref ethash_thread_create()
+ */
+void ethash_thread_join(ethash_thread_t thread);
+
+/**
+ * Lower the CPU and I/O priority of the calling thread. Threads it starts
+ * afterwards inherit both. Best effort, what the platform lacks is ignored.
+ *
+ * @param cpu            Priority of the thread on the CPU
+ * @param io             Priority of the reads and writes the thread issues
+ */
+void ethash_thread_set_priority(ethash_priority_t cpu, ethash_priority_t io);
+
+/**
+ * Get the number of logical processors that are online. Never returns 0.
+ */
+unsigned ethash_hardware_concurrency(void);
+
+/**
+ * Give up the rest of the time slice of the calling thread
+ */
+void ethash_thread_yield(void);
+
+struct ethash_mutex;
+typedef struct ethash_mutex* ethash_mutex_t;
+
+/**
+ * Create a new non-recursive mutex
+ *
+ * @return    The mutex or NULL if out of memory. Free it with @ref ethash_mutex_delete()
+ */
+ethash_mutex_t ethash_mutex_new(void);
+void ethash_mutex_delete(ethash_mutex_t mutex);
+void ethash_mutex_lock(ethash_mutex_t mutex);
+void ethash_mutex_unlock(ethash_mutex_t mutex);
+
+#if defined(_MSC_VER)
+
+static inline uint32_t ethash_atomic_load_u32(uint32_t volatile const* p)
+{
+	uint32_t v = *p;
+	_ReadWriteBarrier();
+	return v;
+}
+
+static inline void ethash_atomic_store_u32(uint32_t volatile* p, uint32_t v)
+{
+	_ReadWriteBarrier();
+	*p = v;
+}
+
+static inline uint32_t ethash_atomic_add_u32(uint32_t volatile* p, uint32_t v)
+{
+	return (uint32_t)_InterlockedExchangeAdd((long volatile*)p, (long)v);
+}
+
+static inline uint64_t ethash_atomic_load_u64(uint64_t volatile const* p)
+{
+	return (uint64_t)_InterlockedCompareExchange64((__int64 volatile*)p, 0, 0);
+}
+
+static inline void ethash_atomic_store_u64(uint64_t volatile* p, uint64_t v)
+{
+	_InterlockedExchange64((__int64 volatile*)p, (__int64)v);
+}
+
+static inline uint64_t ethash_atomic_add_u64(uint64_t volatile* p, uint64_t v)
+{
+	return (uint64_t)_InterlockedExchangeAdd64((__int64 volatile*)p, (__int64)v);
+}
+
+#else
+
+static inline uint32_t ethash_atomic_load_u32(uint32_t volatile const* p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void ethash_atomic_store_u32(uint32_t volatile* p, uint32_t v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/// Atomically add @a v to @a p and return the previous value
+static inline uint32_t ethash_atomic_add_u32(uint32_t volatile* p, uint32_t v)
+{
+	return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL);
+}
+
+static inline uint64_t ethash_atomic_load_u64(uint64_t volatile const* p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void ethash_atomic_store_u64(uint64_t volatile* p, uint64_t v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/// Atomically add @a v to @a p and return the previous value
+static inline uint64_t ethash_atomic_add_u64(uint64_t volatile* p, uint64_t v)
+{
+	return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL);
+}
+
+#endif
+
+/// State of @ref ethash_call_once(), zero-initialize with ETHASH_ONCE_INIT
+typedef struct ethash_once {
+	uint32_t volatile started;
+	uint32_t volatile done;
+} ethash_once_t;
+#define ETHASH_ONCE_INIT { 0, 0 }
+
+/**
+ * Run @a fn exactly once per @a once, however many threads get here at the
+ * same time. Returns after @a fn has finished. Meant for short initializations,
+ * the threads that lose the race spin until then.
+ */
+static inline void ethash_call_once(ethash_once_t* once, void (*fn)(void))
+{
+	if (ethash_atomic_load_u32(&once->done)) {
+		return;
+	}
+	if (ethash_atomic_add_u32(&once->started, 1) == 0) {
+		fn();
+		ethash_atomic_store_u32(&once->done, 1);
+		return;
+	}
+	while (!ethash_atomic_load_u32(&once->done)) {
+		ethash_thread_yield();
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,152 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file thread_posix.c
+ * @date 2015
+ */
+
+#include "thread.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <pthread/qos.h>
+#endif
+
+struct ethash_thread {
+	pthread_t handle;
+};
+
+bool ethash_thread_create(ethash_thread_t* thread, void* (*fn)(void*), void* arg)
+{
+	struct ethash_thread* ret = malloc(sizeof(*ret));
+	if (!ret) {
+		return false;
+	}
+	if (pthread_create(&ret->handle, NULL, fn, arg) != 0) {
+		free(ret);
+		return false;
+	}
+	*thread = ret;
+	return true;
+}
+
+void ethash_thread_join(ethash_thread_t thread)
+{
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+struct ethash_mutex {
+	pthread_mutex_t handle;
+};
+
+ethash_mutex_t ethash_mutex_new(void)
+{
+	struct ethash_mutex* ret = malloc(sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (pthread_mutex_init(&ret->handle, NULL) != 0) {
+		free(ret);
+		return NULL;
+	}
+	return ret;
+}
+
+void ethash_mutex_delete(ethash_mutex_t mutex)
+{
+	pthread_mutex_destroy(&mutex->handle);
+	free(mutex);
+}
+
+void ethash_mutex_lock(ethash_mutex_t mutex)
+{
+	pthread_mutex_lock(&mutex->handle);
+}
+
+void ethash_mutex_unlock(ethash_mutex_t mutex)
+{
+	pthread_mutex_unlock(&mutex->handle);
+}
+
+void ethash_thread_yield(void)
+{
+	sched_yield();
+}
+
+#if defined(__linux__)
+
+// From <linux/sched.h> and <linux/ioprio.h>, which need not be installed
+#define ETHASH_SCHED_IDLE 5
+#define ETHASH_IOPRIO_WHO_PROCESS 1
+#define ETHASH_IOPRIO_CLASS_SHIFT 13
+#define ETHASH_IOPRIO_CLASS_BE 2
+#define ETHASH_IOPRIO_CLASS_IDLE 3
+
+void ethash_thread_set_priority(ethash_priority_t cpu, ethash_priority_t io)
+{
+	// the nice value, the policy and the I/O priority are all per thread here
+	pid_t const tid = (pid_t)syscall(SYS_gettid);
+	if (cpu != ETHASH_PRIORITY_NORMAL) {
+		setpriority(PRIO_PROCESS, (id_t)tid, 19);
+		if (cpu == ETHASH_PRIORITY_IDLE) {
+			struct sched_param param = { 0 };
+			syscall(SYS_sched_setscheduler, tid, ETHASH_SCHED_IDLE, &param);
+		}
+	}
+	if (io != ETHASH_PRIORITY_NORMAL) {
+		int const prio = io == ETHASH_PRIORITY_IDLE ?
+			ETHASH_IOPRIO_CLASS_IDLE << ETHASH_IOPRIO_CLASS_SHIFT :
+			(ETHASH_IOPRIO_CLASS_BE << ETHASH_IOPRIO_CLASS_SHIFT) | 7;
+		syscall(SYS_ioprio_set, ETHASH_IOPRIO_WHO_PROCESS, tid, prio);
+	}
+}
+
+#elif defined(__APPLE__)
+
+void ethash_thread_set_priority(ethash_priority_t cpu, ethash_priority_t io)
+{
+	// a QoS class throttles the CPU and the I/O together
+	ethash_priority_t const prio = cpu > io ? cpu : io;
+	if (prio != ETHASH_PRIORITY_NORMAL) {
+		pthread_set_qos_class_self_np(
+			prio == ETHASH_PRIORITY_IDLE ? QOS_CLASS_BACKGROUND : QOS_CLASS_UTILITY,
+			0
+		);
+	}
+}
+
+#else
+
+void ethash_thread_set_priority(ethash_priority_t cpu, ethash_priority_t io)
+{
+	// the nice value is per process on other systems, leave it alone
+	(void)cpu;
+	(void)io;
+}
+
+#endif
+
+unsigned ethash_hardware_concurrency(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned)n : 1;
+}
@@ -0,0 +1,129 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file thread_win32.c
+ * @date 2015
+ */
+
+#include "thread.h"
+#include <stdlib.h>
+#include <windows.h>
+
+struct ethash_thread {
+	HANDLE handle;
+	void* (*fn)(void*);
+	void* arg;
+	ethash_priority_t cpu_priority;
+	ethash_priority_t io_priority;
+};
+
+// Priorities of the calling thread, handed down to the threads it starts
+static ETHASH_THREAD_LOCAL ethash_priority_t ethash_thread_cpu_priority;
+static ETHASH_THREAD_LOCAL ethash_priority_t ethash_thread_io_priority;
+
+static DWORD WINAPI ethash_thread_trampoline(LPVOID param)
+{
+	struct ethash_thread* thread = (struct ethash_thread*)param;
+	if (thread->cpu_priority != ETHASH_PRIORITY_NORMAL || thread->io_priority != ETHASH_PRIORITY_NORMAL) {
+		ethash_thread_set_priority(thread->cpu_priority, thread->io_priority);
+	}
+	thread->fn(thread->arg);
+	return 0;
+}
+
+bool ethash_thread_create(ethash_thread_t* thread, void* (*fn)(void*), void* arg)
+{
+	struct ethash_thread* ret = malloc(sizeof(*ret));
+	if (!ret) {
+		return false;
+	}
+	ret->fn = fn;
+	ret->arg = arg;
+	ret->cpu_priority = ethash_thread_cpu_priority;
+	ret->io_priority = ethash_thread_io_priority;
+	ret->handle = CreateThread(NULL, 0, ethash_thread_trampoline, ret, 0, NULL);
+	if (!ret->handle) {
+		free(ret);
+		return false;
+	}
+	*thread = ret;
+	return true;
+}
+
+void ethash_thread_join(ethash_thread_t thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+void ethash_thread_set_priority(ethash_priority_t cpu, ethash_priority_t io)
+{
+	if (io != ETHASH_PRIORITY_NORMAL) {
+		// lowers the I/O and memory priority, and the CPU priority to low
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+	}
+	if (cpu != ETHASH_PRIORITY_NORMAL) {
+		SetThreadPriority(
+			GetCurrentThread(),
+			cpu == ETHASH_PRIORITY_IDLE ? THREAD_PRIORITY_IDLE : THREAD_PRIORITY_LOWEST
+		);
+	}
+	ethash_thread_cpu_priority = cpu;
+	ethash_thread_io_priority = io;
+}
+
+struct ethash_mutex {
+	CRITICAL_SECTION handle;
+};
+
+ethash_mutex_t ethash_mutex_new(void)
+{
+	struct ethash_mutex* ret = malloc(sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	InitializeCriticalSection(&ret->handle);
+	return ret;
+}
+
+void ethash_mutex_delete(ethash_mutex_t mutex)
+{
+	DeleteCriticalSection(&mutex->handle);
+	free(mutex);
+}
+
+void ethash_mutex_lock(ethash_mutex_t mutex)
+{
+	EnterCriticalSection(&mutex->handle);
+}
+
+void ethash_mutex_unlock(ethash_mutex_t mutex)
+{
+	LeaveCriticalSection(&mutex->handle);
+}
+
+void ethash_thread_yield(void)
+{
+	SwitchToThread();
+}
+
+unsigned ethash_hardware_concurrency(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1;
+}
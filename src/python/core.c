@@ -28,7 +28,7 @@ mkcache_bytes(PyObject *self, PyObject *args) {
 
     ethash_light_t L = ethash_light_new(block_number);
     PyObject * val = Py_BuildValue(PY_STRING_FORMAT, L->cache, L->cache_size);
-    free(L->cache);
+    ethash_light_delete(L);
     return val;
 }
 
@@ -84,15 +84,14 @@ hashimoto_light(PyObject *self, PyObject *args) {
         PyErr_SetString(PyExc_ValueError, error_message);
         return 0;
     }
-    struct ethash_light *s;
-    s = calloc(sizeof(*s), 1);
-    s->cache = cache_bytes;
-    s->cache_size = cache_size;
-    s->block_number = block_number;
-    struct ethash_h256 *h;
-    h = calloc(sizeof(*h), 1);
-    for (int i = 0; i < 32; i++) h->b[i] = header[i];
-    struct ethash_return_value out = ethash_light_compute(s, *h, nonce);
+    struct ethash_light s;
+    memset(&s, 0, sizeof(s));
+    s.cache = cache_bytes;
+    s.cache_size = cache_size;
+    s.block_number = block_number;
+    struct ethash_h256 h;
+    for (int i = 0; i < 32; i++) h.b[i] = header[i];
+    struct ethash_return_value out = ethash_light_compute(&s, h, nonce);
     return Py_BuildValue("{" PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "," PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "}",
                          "mix digest", &out.mix_hash, 32,
                          "result", &out.result, 32);
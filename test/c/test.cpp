@@ -3,6 +3,11 @@
 #include <libethash/ethash.h>
 #include <libethash/internal.h>
 #include <libethash/io.h>
+#include <libethash/simd.h>
+#include <libethash/dispatch.h>
+#include <libethash/numa.h>
+#include <libethash/thread.h>
+#include <libethash/shm.h>
 
 #ifdef WITH_CRYPTOPP
 
@@ -17,12 +22,24 @@
 #include <Shlobj.h>
 #endif
 
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define BOOST_TEST_MODULE Daggerhashimoto
 #define BOOST_TEST_MAIN
 
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -140,6 +157,50 @@ BOOST_AUTO_TEST_CASE(SHA512_check) {
 					<< "actual: " << actual.c_str() << "\n");
 }
 
+BOOST_AUTO_TEST_CASE(SHA3_rate_boundaries_check) {
+	// inputs around the SHA3-256 rate of 136 bytes, and one spanning two SHA3-512 blocks
+	uint8_t input[200], out[64];
+	for (unsigned i = 0; i < sizeof(input); ++i) {
+		input[i] = (uint8_t)(i * 7 + 3);
+	}
+	SHA3_256((ethash_h256_t*)out, input, 0);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 32), "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+	SHA3_256((ethash_h256_t*)out, input, 135);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 32), "00ef96af9cf4b24c7f269d922294444a197d0a33638c2e56634c57e892103a8f");
+	SHA3_256((ethash_h256_t*)out, input, 136);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 32), "742061bcad767ed4c4f5883b1dcb1aad11afdcc140dc469d953759b127b9f9ed");
+	SHA3_256((ethash_h256_t*)out, input, 200);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 32), "66d2cdf3ab4c5bd3c75add9b60b14ac5b7789534fa2da3f348853b847359a3a0");
+	SHA3_512(out, input, 0);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 64), "0eab42de4c3ceb9235fc91acffe746b29c29a8c366b7c60e4e67c466f36a4304c00fa9caf9d87976ba469bcbe06713b435f091ef2769fb160cdab33d3670680e");
+	SHA3_512(out, input, 200);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 64), "3063032bb25fc0367e5a36197b8be97c8fa2efabaf9292b66e40be06b66bd45bd178cc3a78f91e5a275222c55c59c648e011b15b82439193f01c94b361404ae2");
+}
+
+BOOST_AUTO_TEST_CASE(SHA3_fixed_length_check) {
+	uint8_t input[96], expected[64], actual[64];
+	for (unsigned i = 0; i < sizeof(input); ++i) {
+		input[i] = (uint8_t)(i * 13 + 5);
+	}
+	SHA3_256((ethash_h256_t*)expected, input, 32);
+	SHA3_256_32((ethash_h256_t*)actual, input);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(expected, 32), bytesToHexString(actual, 32));
+	SHA3_256((ethash_h256_t*)expected, input, 96);
+	SHA3_256_96((ethash_h256_t*)actual, input);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(expected, 32), bytesToHexString(actual, 32));
+	SHA3_512(expected, input, 32);
+	SHA3_512_32(actual, input);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(expected, 64), bytesToHexString(actual, 64));
+	SHA3_512(expected, input, 40);
+	SHA3_512_40(actual, input);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(expected, 64), bytesToHexString(actual, 64));
+	SHA3_512(expected, input, 64);
+	// in place, as the cache and DAG item code uses it
+	memcpy(actual, input, 64);
+	SHA3_512_64(actual, actual);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(expected, 64), bytesToHexString(actual, 64));
+}
+
 BOOST_AUTO_TEST_CASE(test_swap_endian32) {
 	uint32_t v32 = (uint32_t)0xBAADF00D;
 	v32 = ethash_swap_u32(v32);
@@ -179,6 +240,33 @@ BOOST_AUTO_TEST_CASE(ethash_params_init_genesis_calcifide_check) {
 					<< "actual: " << cache_size << "\n");
 }
 
+BOOST_AUTO_TEST_CASE(ethash_sizes_beyond_the_tables) {
+	// the tables are what the generator gives
+	for (uint64_t epoch = 0; epoch != 2048; ++epoch) {
+		uint64_t const block_number = epoch * ETHASH_EPOCH_LENGTH;
+		BOOST_REQUIRE_EQUAL(ethash_get_datasize(block_number), ethash_generate_datasize(epoch));
+		BOOST_REQUIRE_EQUAL(ethash_get_cachesize(block_number), ethash_generate_cachesize(epoch));
+	}
+	// values from the Python spec
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(2048 * ETHASH_EPOCH_LENGTH), 18253610624ULL);
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(2048 * ETHASH_EPOCH_LENGTH), 285211712ULL);
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(5000 * ETHASH_EPOCH_LENGTH + 1), 43016779648ULL);
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(5000 * ETHASH_EPOCH_LENGTH + 1), 672137152ULL);
+	// memoized sizes stay the same, past the memo too
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(5000 * ETHASH_EPOCH_LENGTH), ethash_generate_datasize(5000));
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(100000 * ETHASH_EPOCH_LENGTH), ethash_generate_cachesize(100000));
+
+	uint64_t const primes[] = { 2, 3, 61, 4294967291ULL, 2305843009213693951ULL, 18446744073709551557ULL };
+	for (uint64_t n: primes) {
+		BOOST_REQUIRE(ethash_is_prime(n));
+	}
+	// Carmichael numbers and strong pseudoprimes to several small bases
+	uint64_t const composites[] = { 0, 1, 4, 561, 3215031751ULL, 4759123141ULL, 3825123056546413051ULL, 18446744073709551555ULL };
+	for (uint64_t n: composites) {
+		BOOST_REQUIRE(!ethash_is_prime(n));
+	}
+}
+
 BOOST_AUTO_TEST_CASE(ethash_check_difficulty_check) {
 	ethash_h256_t hash;
 	ethash_h256_t target;
@@ -200,6 +288,144 @@ BOOST_AUTO_TEST_CASE(ethash_check_difficulty_check) {
 			// "\nexpected \"" << hash << "\" to have more difficulty than \"" << target << "\"\n");
 }
 
+BOOST_AUTO_TEST_CASE(multi_buffer_dag_items_match_scalar) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024 * 3, &seed);
+	BOOST_REQUIRE(light);
+
+	// odd begin and count so every kernel and the padded leftover batch get used
+	uint32_t const begin = 1021, count = 37;
+	std::vector<node> expected(count), actual(count);
+	for (uint32_t n = 0; n != count; ++n) {
+		ethash_calculate_dag_item(&expected[n], begin + n, light);
+	}
+	ethash_calculate_dag_items(actual.data(), begin, count, light);
+	BOOST_REQUIRE(memcmp(expected.data(), actual.data(), count * sizeof(node)) == 0);
+
+#if ETHASH_SIMD_X86
+	uint32_t indices[ETHASH_AVX512_LANES] = { 0, 7, 48, 49, 1u << 31, 12345, 3, 0xffffffff };
+	node lanes[ETHASH_AVX512_LANES];
+	if (ethash_cpu_supports(ETHASH_BACKEND_AVX2)) {
+		ethash_calculate_dag_items_avx2(lanes, indices, light);
+		for (unsigned k = 0; k != ETHASH_AVX2_LANES; ++k) {
+			node scalar;
+			ethash_calculate_dag_item_scalar(&scalar, indices[k], light);
+			BOOST_REQUIRE_MESSAGE(memcmp(&scalar, &lanes[k], sizeof(node)) == 0, "avx2 lane " << k);
+		}
+	}
+	if (ethash_cpu_supports(ETHASH_BACKEND_AVX512)) {
+		ethash_calculate_dag_items_avx512(lanes, indices, light);
+		for (unsigned k = 0; k != ETHASH_AVX512_LANES; ++k) {
+			node scalar;
+			ethash_calculate_dag_item_scalar(&scalar, indices[k], light);
+			BOOST_REQUIRE_MESSAGE(memcmp(&scalar, &lanes[k], sizeof(node)) == 0, "avx512 lane " << k);
+		}
+	}
+#endif
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(backend_kernels_match_scalar) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024 * 3, &seed);
+	BOOST_REQUIRE(light);
+	uint32_t const num_full_pages = 64;
+	std::vector<node> full(num_full_pages * MIX_NODES);
+	ethash_calculate_dag_items(full.data(), 0, (uint32_t) full.size(), light);
+
+	node mix_init[MIX_NODES];
+	for (unsigned w = 0; w != MIX_WORDS; ++w) {
+		mix_init[w / NODE_WORDS].words[w % NODE_WORDS] = w * 0x9e3779b9u;
+	}
+	node expected_full[MIX_NODES], expected_light[MIX_NODES];
+	memcpy(expected_full, mix_init, sizeof(mix_init));
+	memcpy(expected_light, mix_init, sizeof(mix_init));
+	ethash_hashimoto_mix_scalar(expected_full, 0xdeadbeef, full.data(), light, num_full_pages);
+	ethash_hashimoto_mix_scalar(expected_light, 0xdeadbeef, NULL, light, num_full_pages);
+	BOOST_REQUIRE(memcmp(expected_full, expected_light, sizeof(mix_init)) == 0);
+
+	uint64_t keccak_init[25];
+	for (unsigned j = 0; j != 25; ++j) {
+		keccak_init[j] = j * 0x9e3779b97f4a7c15ULL;
+	}
+	uint64_t keccak_expected[25];
+	memcpy(keccak_expected, keccak_init, sizeof(keccak_init));
+	ethash_keccakf_scalar(keccak_expected);
+
+	// an odd number of interleaved lanes, each with its own seed and mix
+	unsigned const lanes = 13;
+	node lanes_init[ETHASH_HASH_LANES_MAX][MIX_NODES + 1];
+	node lanes_expected[ETHASH_HASH_LANES_MAX][MIX_NODES];
+	for (unsigned l = 0; l != lanes; ++l) {
+		lanes_init[l][0].words[0] = 0x01234567u * (l + 1);
+		memcpy(lanes_init[l] + 1, mix_init, sizeof(mix_init));
+		lanes_init[l][1].words[0] ^= l;
+		memcpy(lanes_expected[l], lanes_init[l] + 1, sizeof(mix_init));
+		ethash_hashimoto_mix_scalar(lanes_expected[l], lanes_init[l][0].words[0], full.data(), light, num_full_pages);
+	}
+
+	uint32_t const indices[] = { 0, 7, 48, 49, 1u << 31, 12345, 3, 0xffffffff };
+	for (int b = 0; b != ETHASH_BACKEND_COUNT; ++b) {
+		ethash_backend_t const backend = (ethash_backend_t) b;
+		ethash_kernels_t const* kernels = ethash_kernels_for(backend);
+		char const* name = ethash_backend_name(backend);
+		BOOST_REQUIRE(name);
+		if (!kernels) {
+			BOOST_REQUIRE(!ethash_cpu_supports(backend));
+			continue;
+		}
+		BOOST_REQUIRE_EQUAL(kernels->backend, backend);
+
+		uint64_t keccak[25];
+		memcpy(keccak, keccak_init, sizeof(keccak_init));
+		kernels->keccakf(keccak);
+		BOOST_REQUIRE_MESSAGE(memcmp(keccak, keccak_expected, sizeof(keccak)) == 0, name << " keccakf");
+
+		for (uint32_t index: indices) {
+			node scalar, item;
+			ethash_calculate_dag_item_scalar(&scalar, index, light);
+			kernels->dag_item(&item, index, light);
+			BOOST_REQUIRE_MESSAGE(memcmp(&scalar, &item, sizeof(node)) == 0, name << " item " << index);
+		}
+		node mix[MIX_NODES];
+		memcpy(mix, mix_init, sizeof(mix_init));
+		kernels->hashimoto_mix(mix, 0xdeadbeef, full.data(), light, num_full_pages);
+		BOOST_REQUIRE_MESSAGE(memcmp(mix, expected_full, sizeof(mix)) == 0, name << " full mix");
+		memcpy(mix, mix_init, sizeof(mix_init));
+		kernels->hashimoto_mix(mix, 0xdeadbeef, NULL, light, num_full_pages);
+		BOOST_REQUIRE_MESSAGE(memcmp(mix, expected_full, sizeof(mix)) == 0, name << " light mix");
+
+		node lanes_mix[ETHASH_HASH_LANES_MAX][MIX_NODES + 1];
+		memcpy(lanes_mix, lanes_init, sizeof(lanes_mix));
+		kernels->hashimoto_lanes(lanes_mix, full.data(), num_full_pages, lanes);
+		for (unsigned l = 0; l != lanes; ++l) {
+			BOOST_REQUIRE_MESSAGE(
+				memcmp(lanes_mix[l] + 1, lanes_expected[l], sizeof(mix)) == 0,
+				name << " interleaved lane " << l
+			);
+		}
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(backend_selection) {
+	ethash_backend_t const best = ethash_choose_backend(NULL);
+	BOOST_REQUIRE(ethash_cpu_supports(best));
+	BOOST_REQUIRE(best == ETHASH_BACKEND_COUNT - 1 || !ethash_cpu_supports((ethash_backend_t) (best + 1)));
+	BOOST_REQUIRE_EQUAL(ethash_choose_backend("scalar"), ETHASH_BACKEND_SCALAR);
+	BOOST_REQUIRE_EQUAL(ethash_choose_backend("no-such-backend"), best);
+	BOOST_REQUIRE(ethash_choose_backend("avx2") <= ETHASH_BACKEND_AVX2);
+	BOOST_REQUIRE(ethash_choose_backend("avx512") == best);
+
+	// the active backend is fixed on first use and never above the best one
+	ethash_backend_t const active = ethash_get_backend();
+	BOOST_REQUIRE(active <= best);
+	BOOST_REQUIRE_EQUAL(ethash_get_backend(), active);
+	BOOST_REQUIRE(ethash_backend_name(ETHASH_BACKEND_COUNT) == NULL);
+}
+
 BOOST_AUTO_TEST_CASE(test_ethash_io_mutable_name) {
 	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
 	// should have at least 8 bytes provided since this is what we test :)
@@ -209,6 +435,8 @@ BOOST_AUTO_TEST_CASE(test_ethash_io_mutable_name) {
 	ethash_h256_t seed2 = ethash_h256_static_init(0, 0, 0, 0, 0, 0, 0, 0);
 	ethash_io_mutable_name(44, &seed2, mutable_name);
 	BOOST_REQUIRE_EQUAL(0, strcmp(mutable_name, "full-R44-0000000000000000"));
+	ethash_io_mutable_name_v2(23, &seed1, mutable_name);
+	BOOST_REQUIRE_EQUAL(0, strcmp(mutable_name, "full-v2-R23-000a41ff22371608"));
 }
 
 BOOST_AUTO_TEST_CASE(test_ethash_dir_creation) {
@@ -290,6 +518,139 @@ BOOST_AUTO_TEST_CASE(test_ethash_io_memo_file_size_mismatch) {
 	fs::remove_all("./test_ethash_directory/");
 }
 
+BOOST_AUTO_TEST_CASE(test_ethash_io_write_dag) {
+	// several write chunks and an unaligned tail
+	uint64_t const size = (20 << 20) + 136;
+	std::vector<uint8_t> dag(size);
+	for (uint64_t i = 0; i != size; ++i) {
+		dag[i] = (uint8_t)(i * 2654435761U >> 13);
+	}
+	ethash_h256_t seedhash = ethash_get_seedhash(0);
+	bool const direct_modes[] = { false, true };
+	for (bool direct: direct_modes) {
+		FILE *f = NULL;
+		BOOST_REQUIRE_EQUAL(
+			ETHASH_IO_MEMO_MISMATCH,
+			ethash_io_prepare("./test_ethash_directory/", seedhash, &f, size, true)
+		);
+		// written in two ranges that don't meet at a block boundary
+		uint64_t const split = (9 << 20) + 72;
+		BOOST_REQUIRE(ethash_io_write_dag(f, dag.data(), size, 0, split, direct, 0));
+		BOOST_REQUIRE(ethash_io_sync(f));
+		BOOST_REQUIRE(ethash_io_write_watermark(f, (uint32_t)(split / 64)));
+		uint32_t items;
+		BOOST_REQUIRE(ethash_io_read_watermark(f, &items));
+		BOOST_REQUIRE_EQUAL(items, split / 64);
+		BOOST_REQUIRE(ethash_io_write_dag(f, dag.data(), size, split, size, direct, 0));
+		size_t file_size;
+		BOOST_REQUIRE(ethash_file_size(f, &file_size));
+		BOOST_REQUIRE_EQUAL(file_size, size + ETHASH_DAG_HEADER_SIZE);
+		std::vector<uint8_t> back(size);
+		BOOST_REQUIRE_EQUAL(fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET), 0);
+		BOOST_REQUIRE_EQUAL(fread(back.data(), 1, size, f), size);
+		BOOST_REQUIRE(back == dag);
+		fclose(f);
+	}
+	fs::remove_all("./test_ethash_directory/");
+}
+
+static unsigned g_progress_calls = 0;
+static int test_count_progress(unsigned _progress)
+{
+	(void)_progress;
+	++g_progress_calls;
+	return 0;
+}
+
+BOOST_AUTO_TEST_CASE(test_ethash_io_dag_file_v2) {
+	uint64_t const full_size = 1024 * 32;
+	uint32_t const items = full_size / 64;
+	char const* dirname = "./test_ethash_directory/";
+	ethash_h256_t seed = ethash_get_seedhash(ETHASH_EPOCH_LENGTH * 3);
+	ethash_h256_t hash;
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all(dirname);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	std::vector<uint8_t> dag(full_size);
+	BOOST_REQUIRE(ethash_compute_full_data(dag.data(), full_size, light, NULL, 1));
+
+	// the header describes the DAG and the DAG starts on a page of its own
+	ethash_full_t full = ethash_full_new_internal(dirname, seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(full->file_mapped);
+	BOOST_REQUIRE_EQUAL((uintptr_t)full->data % ETHASH_DAG_HEADER_SIZE, 0U);
+	BOOST_REQUIRE(memcmp(full->data, dag.data(), full_size) == 0);
+	ethash_full_delete(full);
+	FILE* f = NULL;
+	BOOST_REQUIRE_EQUAL(ETHASH_IO_MEMO_MATCH, ethash_io_prepare(dirname, seed, &f, full_size, false));
+	struct ethash_dag_header header;
+	BOOST_REQUIRE(ethash_io_read_dag_header(f, seed, full_size, &header));
+	BOOST_REQUIRE_EQUAL(header.version, (uint32_t)ETHASH_DAG_FILE_VERSION);
+	BOOST_REQUIRE_EQUAL(header.revision, (uint32_t)ETHASH_REVISION);
+	BOOST_REQUIRE_EQUAL(header.epoch, 3U);
+	BOOST_REQUIRE_EQUAL(header.state, (uint32_t)ETHASH_DAG_COMPLETE);
+	BOOST_REQUIRE_EQUAL(header.items, items);
+	BOOST_REQUIRE(!ethash_io_read_dag_header(f, seed, full_size + 64, &header));
+	fclose(f);
+	fs::remove_all(dirname);
+
+	// a complete version 1 file is moved over instead of generating the DAG
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	BOOST_REQUIRE(ethash_io_mutable_name(ETHASH_REVISION, &seed, mutable_name));
+	std::string const v1_name = std::string(dirname) + mutable_name;
+	uint32_t const v1_items[] = { items, items / 2 };
+	for (uint32_t done: v1_items) {
+		fs::create_directory(dirname);
+		f = fopen(v1_name.c_str(), "wb");
+		BOOST_REQUIRE(f);
+		uint64_t const magic_num = done == items ?
+			ETHASH_DAG_MAGIC_NUM :
+			((uint64_t)ETHASH_DAG_PARTIAL_TAG << 32) | done;
+		BOOST_REQUIRE_EQUAL(fwrite(&magic_num, ETHASH_DAG_MAGIC_NUM_SIZE, 1, f), 1U);
+		BOOST_REQUIRE_EQUAL(fwrite(dag.data(), 1, full_size, f), full_size);
+		fclose(f);
+		g_progress_calls = 0;
+		full = ethash_full_new_internal(dirname, seed, full_size, light, test_count_progress);
+		BOOST_REQUIRE(full);
+		// a partial one carries on from where it was
+		BOOST_REQUIRE_EQUAL(g_progress_calls == 0, done == items);
+		BOOST_REQUIRE(!fs::exists(v1_name));
+		// and its temporary copy is gone too
+		BOOST_REQUIRE_EQUAL(std::distance(fs::directory_iterator(dirname), fs::directory_iterator()), 1);
+		BOOST_REQUIRE(memcmp(full->data, dag.data(), full_size) == 0);
+		for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+			ethash_return_value_t full_out = ethash_full_compute(full, hash, nonce);
+			ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, nonce);
+			BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+		}
+		ethash_full_delete(full);
+		BOOST_REQUIRE_EQUAL(ETHASH_IO_MEMO_MATCH, ethash_io_prepare(dirname, seed, &f, full_size, false));
+		fclose(f);
+		fs::remove_all(dirname);
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(test_ethash_seedhash_table) {
+	ethash_h256_t chained;
+	ethash_h256_reset(&chained);
+	for (uint64_t epoch = 0; epoch != 2050; ++epoch) {
+		ethash_h256_t const seedhash = ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH + 7);
+		BOOST_REQUIRE(memcmp(&seedhash, &chained, 32) == 0);
+		uint64_t found = 0;
+		// the lookup covers the epochs with tabulated sizes
+		BOOST_REQUIRE_EQUAL(ethash_get_epoch(seedhash, &found), epoch < 2048);
+		if (epoch < 2048) {
+			BOOST_REQUIRE_EQUAL(found, epoch);
+		}
+		SHA3_256(&chained, (uint8_t*)&chained, 32);
+	}
+	ethash_h256_t unknown;
+	memcpy(&unknown, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t found = 0;
+	BOOST_REQUIRE(!ethash_get_epoch(unknown, &found));
+}
+
 BOOST_AUTO_TEST_CASE(test_ethash_get_default_dirname) {
 	char result[256];
 	// this is really not an easy thing to test for in a unit test
@@ -517,6 +878,13 @@ static int test_full_callback_create_incomplete_dag(unsigned _progress)
 	return 0;
 }
 
+static unsigned g_first_progress = 100;
+static int test_full_callback_first_progress(unsigned _progress)
+{
+	g_first_progress = std::min(g_first_progress, _progress);
+	return 0;
+}
+
 BOOST_AUTO_TEST_CASE(full_client_callback) {
 	uint64_t full_size;
 	uint64_t cache_size;
@@ -545,6 +913,920 @@ BOOST_AUTO_TEST_CASE(full_client_callback) {
 	fs::remove_all("./test_ethash_directory/");
 }
 
+BOOST_AUTO_TEST_CASE(full_client_parallel_dag_generation) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	std::vector<node> serial(full_size / sizeof(node));
+	std::vector<node> parallel(full_size / sizeof(node));
+	BOOST_REQUIRE(ethash_compute_full_data(serial.data(), full_size, light, NULL, 1));
+	g_prev_progress = 0;
+	BOOST_REQUIRE(ethash_compute_full_data(parallel.data(), full_size, light, test_full_callback, 4));
+	BOOST_REQUIRE_EQUAL(g_prev_progress, 100);
+	BOOST_REQUIRE(memcmp(serial.data(), parallel.data(), full_size) == 0);
+
+	ethash_full_params_t params = {};
+	params.threads = 3;
+	ethash_full_t full = ethash_full_new_internal_with_params(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		NULL,
+		&params
+	);
+	BOOST_ASSERT(full);
+	BOOST_REQUIRE(memcmp(serial.data(), ethash_full_dag(full), full_size) == 0);
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(full_client_search) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_internal(
+		"./test_ethash_directory/",
+		seed,
+		1024 * 32,
+		light,
+		NULL
+	);
+	BOOST_ASSERT(full);
+
+	// roughly one nonce in 16 satisfies this boundary
+	ethash_h256_t boundary;
+	memset(&boundary, 0xff, 32);
+	ethash_h256_set(&boundary, 0, 0x0f);
+	uint64_t const start = 0xfffffffffffffff0ULL, count = 300;
+	std::vector<ethash_search_result_t> expected;
+	for (uint64_t i = 0; i != count; ++i) {
+		ethash_return_value_t ret = ethash_full_compute(full, hash, start + i);
+		BOOST_REQUIRE(ret.success);
+		if (ethash_check_difficulty(&ret.result, &boundary)) {
+			ethash_search_result_t r;
+			r.nonce = start + i;
+			r.result = ret.result;
+			r.mix_hash = ret.mix_hash;
+			expected.push_back(r);
+		}
+	}
+	BOOST_REQUIRE(expected.size() > 2);
+
+	std::vector<ethash_search_result_t> found(count);
+	unsigned n = ethash_full_search(full, hash, start, count, &boundary, found.data(), (unsigned) count);
+	BOOST_REQUIRE_EQUAL(n, expected.size());
+	for (unsigned i = 0; i != n; ++i) {
+		BOOST_REQUIRE_EQUAL(found[i].nonce, expected[i].nonce);
+		BOOST_REQUIRE(memcmp(&found[i].result, &expected[i].result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&found[i].mix_hash, &expected[i].mix_hash, 32) == 0);
+	}
+
+	// a search stopped by max_results resumes after the last winner
+	n = ethash_full_search(full, hash, start, count, &boundary, found.data(), 2);
+	BOOST_REQUIRE_EQUAL(n, 2);
+	BOOST_REQUIRE_EQUAL(found[1].nonce, expected[1].nonce);
+	uint64_t const resume = found[1].nonce + 1;
+	n = ethash_full_search(full, hash, resume, count - (resume - start), &boundary, found.data(), 1);
+	BOOST_REQUIRE_EQUAL(n, 1);
+	BOOST_REQUIRE_EQUAL(found[0].nonce, expected[2].nonce);
+
+	BOOST_REQUIRE_EQUAL(ethash_full_search(full, hash, start, 0, &boundary, found.data(), 1), 0);
+	ethash_full_delete(full);
+
+	// any number of interleaved nonces finds the same winners. This also
+	// reopens the DAG file written above.
+	unsigned const lane_counts[] = { 1, 3, 16, 100 };
+	for (unsigned lanes: lane_counts) {
+		ethash_full_params_t params = {};
+		params.search_lanes = lanes;
+		full = ethash_full_new_internal_with_params(
+			"./test_ethash_directory/",
+			seed,
+			1024 * 32,
+			light,
+			NULL,
+			&params
+		);
+		BOOST_ASSERT(full);
+		n = ethash_full_search(full, hash, start, count, &boundary, found.data(), (unsigned) count);
+		BOOST_REQUIRE_EQUAL(n, expected.size());
+		for (unsigned i = 0; i != n; ++i) {
+			BOOST_REQUIRE_EQUAL(found[i].nonce, expected[i].nonce);
+			BOOST_REQUIRE(memcmp(&found[i].mix_hash, &expected[i].mix_hash, 32) == 0);
+		}
+		ethash_full_delete(full);
+	}
+
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(huge_page_backing) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const cache_size = 1024, full_size = 1024 * 32;
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE_EQUAL(ethash_light_pages(light), ETHASH_PAGES_NORMAL);
+
+	ethash_pages_t const requests[] = { ETHASH_PAGES_TRANSPARENT, ETHASH_PAGES_2MB, ETHASH_PAGES_1GB };
+	for (ethash_pages_t pages: requests) {
+		ethash_light_params_t light_params = {};
+		light_params.pages = pages;
+		ethash_light_t huge_light = ethash_light_new_internal_with_params(cache_size, &seed, &light_params);
+		BOOST_REQUIRE(huge_light);
+		// the pool may be empty so anything up to the requested size is fine
+		BOOST_REQUIRE(ethash_light_pages(huge_light) <= pages);
+		BOOST_REQUIRE(memcmp(huge_light->cache, light->cache, cache_size) == 0);
+
+		// generates the DAG file, then reads it back
+		for (int pass = 0; pass != 2; ++pass) {
+			ethash_full_params_t params = {};
+			params.pages = pages;
+			ethash_full_t full = ethash_full_new_internal_with_params(
+				"./test_ethash_directory/",
+				seed,
+				full_size,
+				huge_light,
+				NULL,
+				&params
+			);
+			BOOST_REQUIRE(full);
+			BOOST_REQUIRE(ethash_full_pages(full) <= pages);
+			for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+				ethash_return_value_t full_out = ethash_full_compute(full, hash, nonce);
+				ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, nonce);
+				BOOST_REQUIRE(full_out.success);
+				BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+				BOOST_REQUIRE(memcmp(&full_out.mix_hash, &light_out.mix_hash, 32) == 0);
+			}
+			ethash_full_delete(full);
+		}
+		ethash_light_delete(huge_light);
+
+		// the file written from huge pages is a regular DAG file
+		ethash_full_t full = ethash_full_new_internal(
+			"./test_ethash_directory/",
+			seed,
+			full_size,
+			light,
+			NULL
+		);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE_EQUAL(ethash_full_pages(full), ETHASH_PAGES_NORMAL);
+		ethash_return_value_t full_out = ethash_full_compute(full, hash, 7);
+		ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, 7);
+		BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+		ethash_full_delete(full);
+		fs::remove_all("./test_ethash_directory/");
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(numa_placement) {
+	unsigned const nodes = ethash_numa_nodes();
+	BOOST_REQUIRE(nodes >= 1);
+	BOOST_REQUIRE(!ethash_numa_bind_thread(nodes));
+	BOOST_REQUIRE(ethash_numa_current() < ETHASH_NUMA_MAX_NODES);
+	BOOST_REQUIRE((ethash_numa_online() >> ethash_numa_current()) & 1);
+
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_numa_t const modes[] = { ETHASH_NUMA_INTERLEAVE, ETHASH_NUMA_REPLICATE };
+	ethash_pages_t const pages[] = { ETHASH_PAGES_NORMAL, ETHASH_PAGES_TRANSPARENT };
+	for (ethash_numa_t numa: modes) {
+		for (ethash_pages_t page: pages) {
+			ethash_full_params_t params = {};
+			params.numa = numa;
+			params.pages = page;
+			ethash_full_t full = ethash_full_new_internal_with_params(
+				"./test_ethash_directory/",
+				seed,
+				full_size,
+				light,
+				NULL,
+				&params
+			);
+			BOOST_REQUIRE(full);
+			BOOST_REQUIRE_EQUAL(ethash_full_replicas(full), numa == ETHASH_NUMA_REPLICATE ? nodes : 1);
+			// every copy holds the same DAG
+			for (unsigned id = 0; id != ETHASH_NUMA_MAX_NODES; ++id) {
+				if (full->replicas[id]) {
+					BOOST_REQUIRE(memcmp(full->replicas[id], full->data, full_size) == 0);
+				}
+			}
+			ethash_return_value_t full_out = ethash_full_compute(full, hash, 5);
+			ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, 5);
+			BOOST_REQUIRE(memcmp(&full_out.mix_hash, &light_out.mix_hash, 32) == 0);
+			ethash_full_delete(full);
+		}
+	}
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(full_client_in_memory) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_pages_t const pages[] = { ETHASH_PAGES_NORMAL, ETHASH_PAGES_TRANSPARENT, ETHASH_PAGES_2MB };
+	for (ethash_pages_t page: pages) {
+		ethash_full_params_t params = {};
+		params.pages = page;
+		ethash_full_t full = ethash_full_new_internal_in_memory(full_size, light, NULL, &params);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE(!full->file);
+		BOOST_REQUIRE_EQUAL(ethash_full_dag_size(full), full_size);
+		for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+			ethash_return_value_t full_out = ethash_full_compute(full, hash, nonce);
+			ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, nonce);
+			BOOST_REQUIRE(full_out.success);
+			BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+			BOOST_REQUIRE(memcmp(&full_out.mix_hash, &light_out.mix_hash, 32) == 0);
+		}
+		ethash_full_delete(full);
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(full_client_lazy) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	// big enough that the first hashes run while the DAG is being built
+	uint64_t const full_size = 8 * 1024 * 1024;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_params_t params = {};
+	params.threads = 2;
+	ethash_full_t full = ethash_full_new_internal_lazy(full_size, light, &params);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(!full->file);
+	for (uint64_t nonce = 0; nonce != 8; ++nonce) {
+		ethash_return_value_t full_out = ethash_full_compute(full, hash, nonce);
+		ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, nonce);
+		BOOST_REQUIRE(full_out.success);
+		BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&full_out.mix_hash, &light_out.mix_hash, 32) == 0);
+	}
+	ethash_h256_t boundary = ethash_h256_static_init(0x7f);
+	ethash_search_result_t results[4];
+	unsigned const found = ethash_full_search(full, hash, 100, 32, &boundary, results, 4);
+	for (unsigned i = 0; i != found; ++i) {
+		ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, results[i].nonce);
+		BOOST_REQUIRE(memcmp(&results[i].result, &light_out.result, 32) == 0);
+	}
+
+	// a second waiter must not join the fillers again
+	std::thread waiter([full] { ethash_full_wait(full); });
+	ethash_full_wait(full);
+	waiter.join();
+	ethash_full_wait(full);
+	BOOST_REQUIRE_EQUAL(ethash_full_progress(full), 100U);
+	std::vector<uint8_t> dag(full_size);
+	BOOST_REQUIRE(ethash_compute_full_data(dag.data(), full_size, light, NULL, 1));
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), dag.data(), full_size) == 0);
+	ethash_full_delete(full);
+
+	// deleting while the DAG is still being built stops the fillers
+	full = ethash_full_new_internal_lazy(full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+struct test_arena {
+	std::vector<uint8_t> buf;
+	size_t used;
+	size_t skew;           // bytes the next allocation is shifted by to misalign it
+	unsigned allocs;
+	unsigned frees;
+};
+
+static void* test_arena_alloc(size_t size, size_t alignment, void* context)
+{
+	test_arena* arena = (test_arena*)context;
+	uintptr_t const base = (uintptr_t)arena->buf.data();
+	size_t const offset = ((base + arena->used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base + arena->skew;
+	if (offset + size > arena->buf.size()) {
+		return NULL;
+	}
+	arena->used = offset + size;
+	++arena->allocs;
+	return arena->buf.data() + offset;
+}
+
+static void test_arena_free(void* p, size_t size, void* context)
+{
+	(void)p;
+	(void)size;
+	++((test_arena*)context)->frees;
+}
+
+BOOST_AUTO_TEST_CASE(caller_allocated_cache_and_dag) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const cache_size = 1024 * 4;
+	uint64_t const full_size = 1024 * 32;
+	char const* dirname = "./test_ethash_directory/";
+	fs::remove_all(dirname);
+	test_arena arena = {};
+	arena.buf.resize(1024 * 1024);
+	ethash_allocator_t allocator = { test_arena_alloc, test_arena_free, &arena };
+
+	// the library's own memory is aligned too
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	BOOST_REQUIRE_EQUAL((uintptr_t)light->cache % ETHASH_CACHE_ALIGNMENT, 0U);
+
+	ethash_light_params_t light_params = {};
+	light_params.allocator = &allocator;
+	ethash_light_t arena_light = ethash_light_new_internal_with_params(cache_size, &seed, &light_params);
+	BOOST_REQUIRE(arena_light);
+	BOOST_REQUIRE_EQUAL(arena.allocs, 1U);
+	BOOST_REQUIRE((uint8_t*)arena_light->cache >= arena.buf.data());
+	BOOST_REQUIRE((uint8_t*)arena_light->cache < arena.buf.data() + arena.buf.size());
+	BOOST_REQUIRE_EQUAL((uintptr_t)arena_light->cache % ETHASH_CACHE_ALIGNMENT, 0U);
+	BOOST_REQUIRE(memcmp(arena_light->cache, light->cache, cache_size) == 0);
+	ethash_light_delete(arena_light);
+	BOOST_REQUIRE_EQUAL(arena.frees, 1U);
+
+	// a persisted cache is read into the arena rather than mapped
+	light_params.persist = true;
+	light_params.dirname = dirname;
+	for (int pass = 0; pass != 2; ++pass) {
+		arena_light = ethash_light_new_internal_with_params(cache_size, &seed, &light_params);
+		BOOST_REQUIRE(arena_light);
+		BOOST_REQUIRE(!arena_light->mapped);
+		BOOST_REQUIRE((uint8_t*)arena_light->cache >= arena.buf.data());
+		BOOST_REQUIRE(memcmp(arena_light->cache, light->cache, cache_size) == 0);
+		ethash_light_delete(arena_light);
+	}
+
+	ethash_full_params_t params = {};
+	params.allocator = &allocator;
+	params.numa = ETHASH_NUMA_REPLICATE;
+	for (int kind = 0; kind != 3; ++kind) {
+		unsigned const allocs = arena.allocs;
+		ethash_full_t full = kind == 0 ?
+			ethash_full_new_internal_in_memory(full_size, light, NULL, &params) :
+			ethash_full_new_internal_with_params(dirname, seed, full_size, light, NULL, &params);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE_EQUAL(arena.allocs, allocs + 1);
+		BOOST_REQUIRE(!full->file_mapped);
+		BOOST_REQUIRE_EQUAL(full->num_replicas, 0U);
+		BOOST_REQUIRE((uint8_t*)full->data >= arena.buf.data());
+		BOOST_REQUIRE_EQUAL((uintptr_t)full->data % ETHASH_DAG_ALIGNMENT, 0U);
+		for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+			ethash_return_value_t full_out = ethash_full_compute(full, hash, nonce);
+			ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, nonce);
+			BOOST_REQUIRE(full_out.success);
+			BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+			BOOST_REQUIRE(memcmp(&full_out.mix_hash, &light_out.mix_hash, 32) == 0);
+		}
+		// kind 1 generates the DAG file, kind 2 reads it back
+		ethash_full_delete(full);
+	}
+	BOOST_REQUIRE_EQUAL(arena.frees, arena.allocs);
+
+	// misaligned memory is handed back and the creation fails
+	arena.skew = 8;
+	light_params.persist = false;
+	BOOST_REQUIRE(!ethash_light_new_internal_with_params(cache_size, &seed, &light_params));
+	BOOST_REQUIRE(!ethash_full_new_internal_in_memory(full_size, light, NULL, &params));
+	BOOST_REQUIRE_EQUAL(arena.frees, arena.allocs);
+
+	ethash_light_delete(light);
+	fs::remove_all(dirname);
+}
+
+BOOST_AUTO_TEST_CASE(dag_range) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	uint32_t const items = full_size / 64;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	std::vector<uint8_t> dag(full_size);
+	BOOST_REQUIRE(ethash_compute_full_data(dag.data(), full_size, light, NULL, 1));
+
+	uint32_t const bounds[] = { 0, 1, 77, 256, 257, items };
+	for (unsigned i = 0; i + 1 != sizeof(bounds) / sizeof(bounds[0]); ++i) {
+		uint32_t const begin = bounds[i], end = bounds[i + 1];
+		std::vector<uint8_t> slice((end - begin) * 64);
+		BOOST_REQUIRE(ethash_compute_dag_range(light, begin, end, slice.data(), 2, NULL));
+		BOOST_REQUIRE(memcmp(slice.data(), &dag[begin * 64], slice.size()) == 0);
+	}
+	BOOST_REQUIRE(ethash_compute_dag_range(light, 10, 10, NULL, 1, NULL));
+	BOOST_REQUIRE(!ethash_compute_dag_range(light, 11, 10, dag.data(), 1, NULL));
+
+	// slices written out of order by separate calls make up the DAG file
+	fs::remove_all("./test_ethash_directory/");
+	char const* dirname = "./test_ethash_directory/";
+	BOOST_REQUIRE(ethash_dag_file_write_range_internal(dirname, seed, full_size, light, 0, 100, 1, NULL));
+	BOOST_REQUIRE(!ethash_dag_file_seal_internal(dirname, seed, full_size));
+	BOOST_REQUIRE(ethash_dag_file_write_range_internal(dirname, seed, full_size, light, 300, items, 1, NULL));
+	BOOST_REQUIRE(ethash_dag_file_write_range_internal(dirname, seed, full_size, light, 100, 300, 1, NULL));
+	BOOST_REQUIRE(!ethash_dag_file_write_range_internal(dirname, seed, full_size, light, 0, items + 1, 1, NULL));
+	BOOST_REQUIRE(ethash_dag_file_seal_internal(dirname, seed, full_size));
+	FILE* f = NULL;
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_MATCH,
+		ethash_io_prepare(dirname, seed, &f, full_size, false)
+	);
+	std::vector<uint8_t> back(full_size);
+	BOOST_REQUIRE_EQUAL(fread(back.data(), 1, full_size, f), full_size);
+	BOOST_REQUIRE(back == dag);
+
+	// and a damaged part is regenerated on its own
+	BOOST_REQUIRE_EQUAL(fseek(f, ETHASH_DAG_HEADER_SIZE + 200 * 64, SEEK_SET), 0);
+	BOOST_REQUIRE_EQUAL(fwrite(std::vector<uint8_t>(640).data(), 1, 640, f), 640U);
+	fclose(f);
+	BOOST_REQUIRE(ethash_dag_file_write_range_internal(dirname, seed, full_size, light, 200, 210, 1, NULL));
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_MATCH,
+		ethash_io_prepare(dirname, seed, &f, full_size, false)
+	);
+	BOOST_REQUIRE_EQUAL(fread(back.data(), 1, full_size, f), full_size);
+	BOOST_REQUIRE(back == dag);
+	fclose(f);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(light_client_persisted_cache) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const cache_size = 1024 * 4;
+	char const* dirname = "./test_ethash_directory/";
+	fs::remove_all(dirname);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+
+	ethash_light_params_t params = {};
+	params.persist = true;
+	params.dirname = dirname;
+	// computed and saved, then mapped from the file
+	for (int pass = 0; pass != 2; ++pass) {
+		ethash_light_t persisted = ethash_light_new_internal_with_params(cache_size, &seed, &params);
+		BOOST_REQUIRE(persisted);
+		BOOST_REQUIRE_EQUAL(persisted->mapped, pass == 1);
+		BOOST_REQUIRE(memcmp(persisted->cache, light->cache, cache_size) == 0);
+		ethash_light_delete(persisted);
+	}
+	// huge pages read the file instead
+	params.pages = ETHASH_PAGES_TRANSPARENT;
+	ethash_light_t huge = ethash_light_new_internal_with_params(cache_size, &seed, &params);
+	BOOST_REQUIRE(huge);
+	BOOST_REQUIRE(!huge->mapped);
+	BOOST_REQUIRE(memcmp(huge->cache, light->cache, cache_size) == 0);
+	ethash_light_delete(huge);
+	params.pages = ETHASH_PAGES_NORMAL;
+
+	// a cache of another size or seed is not taken from the file
+	std::vector<uint8_t> buf(cache_size);
+	ethash_h256_t other_seed = seed;
+	other_seed.b[0] ^= 1;
+	BOOST_REQUIRE(!ethash_io_read_cache(dirname, seed, buf.data(), cache_size - 64));
+	BOOST_REQUIRE(!ethash_io_map_cache(dirname, other_seed, cache_size));
+
+	// a damaged file is detected, recomputed and replaced
+	char mutable_name[CACHE_MUTABLE_NAME_MAX_SIZE];
+	BOOST_REQUIRE(ethash_io_cache_mutable_name(ETHASH_REVISION, &seed, mutable_name));
+	std::string const filename = std::string(dirname) + mutable_name;
+	FILE* f = fopen(filename.c_str(), "rb+");
+	BOOST_REQUIRE(f);
+	BOOST_REQUIRE_EQUAL(fseek(f, ETHASH_CACHE_HEADER_SIZE + 1000, SEEK_SET), 0);
+	BOOST_REQUIRE(fputc(((uint8_t*)light->cache)[1000] ^ 0xff, f) != EOF);
+	fclose(f);
+	BOOST_REQUIRE(!ethash_io_read_cache(dirname, seed, buf.data(), cache_size));
+	ethash_light_t recomputed = ethash_light_new_internal_with_params(cache_size, &seed, &params);
+	BOOST_REQUIRE(recomputed);
+	BOOST_REQUIRE(!recomputed->mapped);
+	BOOST_REQUIRE(memcmp(recomputed->cache, light->cache, cache_size) == 0);
+	ethash_light_delete(recomputed);
+	BOOST_REQUIRE(ethash_io_read_cache(dirname, seed, buf.data(), cache_size));
+	BOOST_REQUIRE(memcmp(buf.data(), light->cache, cache_size) == 0);
+
+	// writers racing each other each use their own temporary file
+	std::vector<std::thread> writers;
+	for (int i = 0; i != 4; ++i) {
+		writers.emplace_back([&] {
+			BOOST_CHECK(ethash_io_write_cache(dirname, seed, light->cache, cache_size));
+		});
+	}
+	for (auto& writer: writers) {
+		writer.join();
+	}
+	BOOST_REQUIRE(ethash_io_read_cache(dirname, seed, buf.data(), cache_size));
+	BOOST_REQUIRE(memcmp(buf.data(), light->cache, cache_size) == 0);
+	BOOST_REQUIRE_EQUAL(std::distance(fs::directory_iterator(dirname), fs::directory_iterator()), 1);
+
+	ethash_light_delete(light);
+	fs::remove_all(dirname);
+}
+
+BOOST_AUTO_TEST_CASE(light_client_shared_cache) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~S", 32);
+	uint64_t const cache_size = 1024 * 4;
+	BOOST_REQUIRE(ethash_shm_remove_cache(&seed));
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+
+	ethash_light_params_t params = {};
+	params.shared = true;
+	// built by the first handler, mapped by the second
+	ethash_light_t first = ethash_light_new_internal_with_params(cache_size, &seed, &params);
+	ethash_light_t second = ethash_light_new_internal_with_params(cache_size, &seed, &params);
+	BOOST_REQUIRE(first && second);
+	BOOST_REQUIRE(first->shared && second->shared);
+	BOOST_REQUIRE(first->cache != second->cache);
+	BOOST_REQUIRE(memcmp(first->cache, light->cache, cache_size) == 0);
+	BOOST_REQUIRE(memcmp(second->cache, light->cache, cache_size) == 0);
+
+	// another size under the same name gets a private cache
+	ethash_light_t other = ethash_light_new_internal_with_params(cache_size * 2, &seed, &params);
+	BOOST_REQUIRE(other);
+	BOOST_REQUIRE(!other->shared);
+	ethash_light_delete(other);
+
+	// removing the name leaves the mappings alone
+	BOOST_REQUIRE(ethash_shm_remove_cache(&seed));
+	BOOST_REQUIRE(memcmp(second->cache, light->cache, cache_size) == 0);
+	ethash_light_delete(first);
+	ethash_light_delete(second);
+
+#ifdef __linux__
+	// memory left by a builder that died before writing the header is rebuilt
+	char name[64];
+	uint64_t hash = *((uint64_t*)&seed);
+#if LITTLE_ENDIAN == BYTE_ORDER
+	hash = ethash_swap_u64(hash);
+#endif
+	snprintf(name, sizeof(name), "/ethash-R%u-%016" PRIx64, ETHASH_REVISION, hash);
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+	BOOST_REQUIRE(fd >= 0);
+	BOOST_REQUIRE_EQUAL(ftruncate(fd, cache_size + ETHASH_CACHE_HEADER_SIZE), 0);
+	BOOST_REQUIRE_EQUAL(pwrite(fd, "junk", 4, ETHASH_CACHE_HEADER_SIZE), 4);
+	close(fd);
+	ethash_light_t rebuilt = ethash_light_new_internal_with_params(cache_size, &seed, &params);
+	BOOST_REQUIRE(rebuilt);
+	BOOST_REQUIRE(rebuilt->shared);
+	BOOST_REQUIRE(memcmp(rebuilt->cache, light->cache, cache_size) == 0);
+	ethash_light_delete(rebuilt);
+	BOOST_REQUIRE(ethash_shm_remove_cache(&seed));
+
+	// a cache larger than /dev/shm is refused up front, not faulted on
+	struct statvfs shm_fs;
+	if (statvfs("/dev/shm", &shm_fs) == 0 && shm_fs.f_blocks != 0) {
+		uint64_t const oversized = (uint64_t)shm_fs.f_blocks * shm_fs.f_frsize + cache_size;
+		BOOST_REQUIRE(!ethash_shm_map_cache(&seed, oversized, NULL));
+		fd = shm_open(name, O_RDONLY, 0);
+		BOOST_REQUIRE(fd < 0 && errno == ENOENT);
+		void* cache = ethash_shm_map_cache(&seed, cache_size, NULL);
+		BOOST_REQUIRE(cache);
+		BOOST_REQUIRE(memcmp(cache, light->cache, cache_size) == 0);
+		ethash_shm_unmap_cache(cache, cache_size);
+		BOOST_REQUIRE(ethash_shm_remove_cache(&seed));
+	}
+#endif
+	ethash_light_delete(light);
+}
+
+struct test_epochs_getter {
+	ethash_epochs_t epochs;
+	ethash_epoch_t got;
+};
+
+static void* test_epochs_get(void* arg)
+{
+	test_epochs_getter* getter = (test_epochs_getter*)arg;
+	getter->got = ethash_epochs_get_light(getter->epochs, 0);
+	return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(epoch_contexts) {
+	uint64_t const cache_size = 1024, full_size = 1024 * 32;
+	ethash_epochs_params_t params = {};
+	params.budget = 2 * cache_size;
+	params.in_memory = true;
+	ethash_epochs_t epochs = ethash_epochs_new_internal(&params, cache_size, full_size);
+	BOOST_REQUIRE(epochs);
+
+	// built once for all the threads asking at the same time
+	test_epochs_getter getters[8];
+	ethash_thread_t threads[8];
+	for (unsigned i = 0; i != 8; ++i) {
+		getters[i].epochs = epochs;
+		getters[i].got = NULL;
+		BOOST_REQUIRE(ethash_thread_create(&threads[i], test_epochs_get, &getters[i]));
+	}
+	for (unsigned i = 0; i != 8; ++i) {
+		ethash_thread_join(threads[i]);
+	}
+	BOOST_REQUIRE(getters[0].got);
+	for (unsigned i = 1; i != 8; ++i) {
+		BOOST_REQUIRE(getters[i].got == getters[0].got);
+	}
+	ethash_h256_t seed = ethash_get_seedhash(0);
+	ethash_light_t expected = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(memcmp(ethash_epoch_light(getters[0].got)->cache, expected->cache, cache_size) == 0);
+	BOOST_REQUIRE(!ethash_epoch_full(getters[0].got));
+	ethash_light_delete(expected);
+	for (unsigned i = 0; i != 8; ++i) {
+		ethash_epoch_release(getters[i].got);
+	}
+
+	// idle contexts go least recently used first once over the budget
+	ethash_epoch_release(ethash_epochs_get_light(epochs, ETHASH_EPOCH_LENGTH));
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 0, false));
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, ETHASH_EPOCH_LENGTH, false));
+	ethash_epoch_release(ethash_epochs_get_light(epochs, 0));
+	ethash_epoch_t second = ethash_epochs_get_light(epochs, 2 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 0, false));
+	BOOST_REQUIRE(!ethash_epochs_cached_internal(epochs, ETHASH_EPOCH_LENGTH, false));
+	// but never while held
+	ethash_epoch_t third = ethash_epochs_get_light(epochs, 3 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(!ethash_epochs_cached_internal(epochs, 0, false));
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 2 * ETHASH_EPOCH_LENGTH, false));
+	ethash_epoch_release(second);
+
+	// a full context shares the light context of its epoch
+	ethash_epoch_t full = ethash_epochs_get_full(epochs, 3 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_epoch_full(full));
+	BOOST_REQUIRE(ethash_epoch_light(full) == ethash_epoch_light(third));
+	ethash_h256_t hash;
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_return_value_t full_out = ethash_full_compute(ethash_epoch_full(full), hash, 5);
+	ethash_return_value_t light_out = ethash_light_compute_internal(ethash_epoch_light(third), full_size, hash, 5);
+	BOOST_REQUIRE(full_out.success);
+	BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+	ethash_epoch_release(full);
+	BOOST_REQUIRE(!ethash_epochs_cached_internal(epochs, 3 * ETHASH_EPOCH_LENGTH, true));
+	ethash_epoch_release(third);
+	ethash_epochs_delete(epochs);
+
+	// the epoch after the newest one is built in the background
+	params.prefetch = true;
+	epochs = ethash_epochs_new_internal(&params, cache_size, full_size);
+	BOOST_REQUIRE(epochs);
+	ethash_epoch_release(ethash_epochs_get_light(epochs, 5 * ETHASH_EPOCH_LENGTH));
+	for (int i = 0; i != 1000 && !ethash_epochs_cached_internal(epochs, 6 * ETHASH_EPOCH_LENGTH, false); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 6 * ETHASH_EPOCH_LENGTH, false));
+	BOOST_REQUIRE(!ethash_epochs_cached_internal(epochs, 7 * ETHASH_EPOCH_LENGTH, false));
+	ethash_epochs_delete(epochs);
+
+	// the default budget keeps a released DAG
+	params.budget = 0;
+	params.prefetch = false;
+	epochs = ethash_epochs_new_internal(&params, cache_size, full_size);
+	BOOST_REQUIRE(epochs);
+	ethash_epoch_release(ethash_epochs_get_full(epochs, 5 * ETHASH_EPOCH_LENGTH));
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 5 * ETHASH_EPOCH_LENGTH, true));
+	ethash_epochs_delete(epochs);
+
+	// and with prefetch_full the next DAG too, next to the one in use
+	params.prefetch_full = true;
+	epochs = ethash_epochs_new_internal(&params, cache_size, full_size);
+	BOOST_REQUIRE(epochs);
+	full = ethash_epochs_get_full(epochs, 5 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(full);
+	for (int i = 0; i != 1000 && !ethash_epochs_cached_internal(epochs, 6 * ETHASH_EPOCH_LENGTH, true); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 6 * ETHASH_EPOCH_LENGTH, true));
+	ethash_epoch_release(full);
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 5 * ETHASH_EPOCH_LENGTH, true));
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 6 * ETHASH_EPOCH_LENGTH, true));
+	BOOST_REQUIRE(ethash_epochs_cached_internal(epochs, 6 * ETHASH_EPOCH_LENGTH, false));
+	ethash_epochs_delete(epochs);
+}
+
+BOOST_AUTO_TEST_CASE(full_client_async) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_params_t params = {};
+	params.cpu_priority = ETHASH_PRIORITY_LOW;
+	params.io_priority = ETHASH_PRIORITY_IDLE;
+	char const* const dirnames[] = { "./test_ethash_directory/", NULL };
+	for (char const* dirname: dirnames) {
+		ethash_full_async_t async = ethash_full_new_internal_async(dirname, seed, full_size, light, &params);
+		BOOST_REQUIRE(async);
+		ethash_full_t full = ethash_full_async_wait(async);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE(ethash_full_async_finished(async));
+		BOOST_REQUIRE_EQUAL(ethash_full_async_progress(async), 100U);
+		BOOST_REQUIRE_EQUAL(full->file != NULL, dirname != NULL);
+		// the handler was taken
+		BOOST_REQUIRE(!ethash_full_async_wait(async));
+		ethash_full_async_delete(async);
+		ethash_return_value_t full_out = ethash_full_compute(full, hash, 5);
+		ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, 5);
+		BOOST_REQUIRE(memcmp(&full_out.result, &light_out.result, 32) == 0);
+		ethash_full_delete(full);
+	}
+
+	// a cancelled generation gives no handler
+	ethash_full_async_t async = ethash_full_new_internal_async(NULL, seed, 8 * 1024 * 1024, light, NULL);
+	BOOST_REQUIRE(async);
+	ethash_full_async_cancel(async);
+	BOOST_REQUIRE(!ethash_full_async_wait(async));
+	BOOST_REQUIRE(ethash_full_async_finished(async));
+	ethash_full_async_delete(async);
+
+	// and deleting a finished one frees the handler nobody took
+	async = ethash_full_new_internal_async(NULL, seed, full_size, light, NULL);
+	BOOST_REQUIRE(async);
+	while (!ethash_full_async_finished(async)) {}
+	ethash_full_async_delete(async);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+#ifdef __linux__
+static void* test_background_priority(void* arg)
+{
+	ethash_thread_set_priority(ETHASH_PRIORITY_LOW, ETHASH_PRIORITY_IDLE);
+	*(int*)arg = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+	return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(thread_priority) {
+	int const own_nice_value = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+	int nice_value = 0;
+	ethash_thread_t thread;
+	BOOST_REQUIRE(ethash_thread_create(&thread, test_background_priority, &nice_value));
+	ethash_thread_join(thread);
+	BOOST_REQUIRE_EQUAL(nice_value, 19);
+	// the calling thread is left alone
+	BOOST_REQUIRE_EQUAL(getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid)), own_nice_value);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(full_client_streamed_dag_file) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_dag_io_t const modes[] = { ETHASH_DAG_IO_STREAM, ETHASH_DAG_IO_DIRECT };
+	for (ethash_dag_io_t mode: modes) {
+		fs::remove_all("./test_ethash_directory/");
+		ethash_full_params_t params = {};
+		params.dag_io = mode;
+		// the 32K DAG takes at least a quarter of a second at 128K/s
+		params.dag_io_rate = 128 * 1024;
+		auto const start = std::chrono::steady_clock::now();
+		ethash_full_t full = ethash_full_new_internal_with_params(
+			"./test_ethash_directory/",
+			seed,
+			full_size,
+			light,
+			NULL,
+			&params
+		);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE(!full->file_mapped);
+		BOOST_REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(200));
+		ethash_full_delete(full);
+
+		// the file is complete: it opens as an existing DAG with the same contents
+		full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, &test_full_callback_that_fails);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE(full->file_mapped);
+		ethash_return_value_t full_out = ethash_full_compute(full, hash, 3);
+		ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, 3);
+		BOOST_REQUIRE(memcmp(&full_out.mix_hash, &light_out.mix_hash, 32) == 0);
+		ethash_full_delete(full);
+	}
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+struct search_collector {
+	std::vector<ethash_search_result_t> found;
+	size_t stop_after;
+};
+
+static int collect_search_result(ethash_search_result_t const* result, void* context)
+{
+	search_collector* c = (search_collector*) context;
+	c->found.push_back(*result);
+	return c->found.size() == c->stop_after;
+}
+
+BOOST_AUTO_TEST_CASE(full_client_search_engine) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_internal(
+		"./test_ethash_directory/",
+		seed,
+		1024 * 32,
+		light,
+		NULL
+	);
+	BOOST_ASSERT(full);
+
+	ethash_h256_t boundary;
+	memset(&boundary, 0xff, 32);
+	ethash_h256_set(&boundary, 0, 0x0f);
+	uint64_t const start = 0xfffffffffffff800ULL, count = 3000;
+	std::vector<ethash_search_result_t> expected(count);
+	unsigned const n = ethash_full_search(full, hash, start, count, &boundary, expected.data(), (unsigned) count);
+	BOOST_REQUIRE(n > 0);
+	expected.resize(n);
+
+	// every nonce is tried exactly once, whatever the number of threads
+	unsigned const thread_counts[] = { 1, 3, 8 };
+	for (unsigned threads: thread_counts) {
+		search_collector c;
+		c.stop_after = 0;
+		ethash_search_t search = ethash_search_start(full, hash, &boundary, start, count, threads, collect_search_result, &c);
+		BOOST_REQUIRE(search);
+		BOOST_REQUIRE_EQUAL(ethash_search_threads(search), threads);
+		ethash_search_wait(search);
+		BOOST_REQUIRE(ethash_search_finished(search));
+		BOOST_REQUIRE_EQUAL(ethash_search_hashes(search), count);
+		uint64_t per_thread = 0;
+		for (unsigned i = 0; i != threads; ++i) {
+			per_thread += ethash_search_thread_hashes(search, i);
+		}
+		BOOST_REQUIRE_EQUAL(per_thread, count);
+		ethash_search_delete(search);
+
+		std::sort(c.found.begin(), c.found.end(), [](ethash_search_result_t const& a, ethash_search_result_t const& b) {
+			// order by offset from start, the range wraps around 2^64
+			return a.nonce - start < b.nonce - start;
+		});
+		BOOST_REQUIRE_EQUAL(c.found.size(), expected.size());
+		for (unsigned i = 0; i != n; ++i) {
+			BOOST_REQUIRE_EQUAL(c.found[i].nonce, expected[i].nonce);
+			BOOST_REQUIRE(memcmp(&c.found[i].mix_hash, &expected[i].mix_hash, 32) == 0);
+		}
+	}
+
+	// a non-zero callback return stops an unbounded search
+	ethash_h256_t easy;
+	memset(&easy, 0xff, 32);
+	search_collector c;
+	c.stop_after = 5;
+	ethash_search_t search = ethash_search_start(full, hash, &easy, 0, 0, 2, collect_search_result, &c);
+	BOOST_REQUIRE(search);
+	ethash_search_wait(search);
+	BOOST_REQUIRE_EQUAL(c.found.size(), 5);
+	ethash_search_delete(search);
+
+	// and so does ethash_search_stop()
+	ethash_h256_t impossible;
+	memset(&impossible, 0, 32);
+	c.found.clear();
+	search = ethash_search_start(full, hash, &impossible, 0, 0, 2, collect_search_result, &c);
+	BOOST_REQUIRE(search);
+	ethash_search_stop(search);
+	ethash_search_wait(search);
+	BOOST_REQUIRE(ethash_search_finished(search));
+	BOOST_REQUIRE(c.found.empty());
+	ethash_search_delete(search);
+
+	BOOST_REQUIRE(!ethash_search_start(full, hash, &boundary, 0, 0, 1, NULL, NULL));
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
 BOOST_AUTO_TEST_CASE(failing_full_client_callback) {
 	uint64_t full_size;
 	uint64_t cache_size;
@@ -581,7 +1863,7 @@ BOOST_AUTO_TEST_CASE(test_incomplete_dag_file) {
 	full_size = 1024 * 32;
 
 	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
-	// create a full but stop at 30%, so no magic number is written
+	// create a full but stop at 30%, so only a checkpoint is written
 	ethash_full_t full = ethash_full_new_internal(
 		"./test_ethash_directory/",
 		seed,
@@ -591,11 +1873,93 @@ BOOST_AUTO_TEST_CASE(test_incomplete_dag_file) {
 	);
 	BOOST_ASSERT(!full);
 	FILE *f = NULL;
-	// confirm that we get a size_mismatch because the magic number is missing
+	// the file is recognised as a generation that can be resumed
 	BOOST_REQUIRE_EQUAL(
-		ETHASH_IO_MEMO_SIZE_MISMATCH,
+		ETHASH_IO_MEMO_PARTIAL,
 		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
 	);
+	uint32_t items;
+	BOOST_REQUIRE(ethash_io_read_watermark(f, &items));
+	BOOST_REQUIRE(items > 0 && items < full_size / 64);
+	fclose(f);
+
+	// which picks up from its last checkpoint and yields the same DAG
+	g_first_progress = 100;
+	full = ethash_full_new_internal(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		test_full_callback_first_progress
+	);
+	BOOST_ASSERT(full);
+	BOOST_REQUIRE(g_first_progress > 0 && g_first_progress < 100);
+	ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, 0x7c7c597c);
+	ethash_return_value_t full_out = ethash_full_compute(full, hash, 0x7c7c597c);
+	BOOST_REQUIRE_EQUAL(
+		blockhashToHexString(&light_out.result),
+		blockhashToHexString(&full_out.result)
+	);
+	ethash_full_delete(full);
+	// and is complete now
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_MATCH,
+		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
+	);
+	fclose(f);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(test_incomplete_dag_file_streamed) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_params_t params;
+	memset(&params, 0, sizeof(params));
+	params.dag_io = ETHASH_DAG_IO_STREAM;
+	ethash_full_t full = ethash_full_new_internal_with_params(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		test_full_callback_create_incomplete_dag,
+		&params
+	);
+	BOOST_ASSERT(!full);
+	FILE *f = NULL;
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_PARTIAL,
+		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
+	);
+	fclose(f);
+
+	// resumed with the default writer
+	g_first_progress = 100;
+	full = ethash_full_new_internal(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		test_full_callback_first_progress
+	);
+	BOOST_ASSERT(full);
+	BOOST_REQUIRE(g_first_progress > 0 && g_first_progress < 100);
+	ethash_return_value_t light_out = ethash_light_compute_internal(light, full_size, hash, 0x7c7c597c);
+	ethash_return_value_t full_out = ethash_full_compute(full, hash, 0x7c7c597c);
+	BOOST_REQUIRE_EQUAL(
+		blockhashToHexString(&light_out.result),
+		blockhashToHexString(&full_out.result)
+	);
+	ethash_full_delete(full);
 	ethash_light_delete(light);
 	fs::remove_all("./test_ethash_directory/");
 }